@@ -0,0 +1,571 @@
+/*
+ * affine.c - Analytic miss counting for affine loop nests
+ *
+ * Every access of the nest has an address that is an affine function of
+ * the loop variables, so the engine computes addresses directly instead
+ * of reading a trace, and compresses the innermost loops: while no access
+ * of a loop body leaves the line it touched in the previous iteration,
+ * the body replays the same line sequence. Replaying a sequence on LRU
+ * sets is idempotent (the lines it touches end up in the same recency
+ * order whatever the starting state, and the untouched lines keep theirs
+ * below them), so the second iteration of such a run leaves the cache as
+ * it found it and every later one repeats its hits, misses and evictions
+ * exactly. The engine simulates the first two iterations of each run and
+ * multiplies, which skips about block_bytes / stride iterations out of
+ * every such run while staying exact.
+ */
+#include <ctype.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include "affine.h"
+
+#define MAX_DEPTH 8       /* nesting levels, each with its loop variable */
+#define MAX_ARRAYS 16     /* arrays a nest can declare */
+#define MAX_DIMS 4        /* dimensions of an array */
+#define MAX_NAME 32       /* longest array or variable name */
+#define MAX_LINE 256      /* longest line of a nest file */
+
+/* constant + sum of coeff[d] * (variable of the loop at depth d) */
+typedef struct affine_expr {
+    long long constant;
+    long long coeff[MAX_DEPTH];
+} affine_expr_t;
+
+typedef struct affine_array {
+    char name[MAX_NAME];
+    unsigned long long base;
+    long long element;
+    int num_dims;
+    long long dims[MAX_DIMS];
+} affine_array_t;
+
+/* A loop, or an access when depth is -1 */
+typedef struct affine_node {
+    int depth;           /* nesting level of the loop variable */
+    affine_expr_t lo;    /* first value of the variable */
+    affine_expr_t hi;    /* bound the variable stays below */
+    long long step;      /* positive increment */
+    int leaf;            /* a loop whose body holds accesses only */
+    char op;             /* 'L', 'S' or 'M' for an access */
+    affine_expr_t address; /* byte address of an access */
+    int first_child;     /* first node of a loop body, or -1 */
+    int next;            /* next node of the same body, or -1 */
+} affine_node_t;
+
+struct affine_nest {
+    affine_node_t* nodes;
+    int num_nodes;
+    int first;           /* first top-level node */
+};
+
+/* An LRU cache being evaluated, every set ordered most recent first */
+typedef struct lru_cache {
+    unsigned long long* lines; /* sets * ways line addresses */
+    int* used;                 /* valid lines in each set */
+    unsigned long long set_mask;
+    int ways;
+    int block_bits;
+    affine_counts_t* counts;
+} lru_cache_t;
+
+/* Parser state: the declared arrays and the loops still open */
+typedef struct parser {
+    const char* pos;
+    affine_array_t arrays[MAX_ARRAYS];
+    int num_arrays;
+    char vars[MAX_DEPTH][MAX_NAME];
+    int depth;
+} parser_t;
+
+static int parseSum(parser_t* p, affine_expr_t* value);
+
+/*
+ * skipSpaces - Advance over blanks
+ */
+static void skipSpaces(parser_t* p)
+{
+    while (*p->pos == ' ' || *p->pos == '\t')
+        p->pos++;
+}
+
+/*
+ * parseName - Read an identifier into name; 0 if there is none
+ */
+static int parseName(parser_t* p, char* name)
+{
+    int length = 0;
+
+    skipSpaces(p);
+    if (!isalpha((unsigned char)*p->pos) && *p->pos != '_')
+        return 0;
+    while ((isalnum((unsigned char)*p->pos) || *p->pos == '_') && length < MAX_NAME - 1)
+        name[length++] = *p->pos++;
+    name[length] = '\0';
+    return !isalnum((unsigned char)*p->pos) && *p->pos != '_';
+}
+
+/*
+ * parseFactor - A number, an open loop variable or a parenthesized sum
+ */
+static int parseFactor(parser_t* p, affine_expr_t* value)
+{
+    char name[MAX_NAME];
+
+    memset(value, 0, sizeof(*value));
+    skipSpaces(p);
+    if (*p->pos == '(') {
+        p->pos++;
+        if (!parseSum(p, value))
+            return 0;
+        skipSpaces(p);
+        return *p->pos++ == ')';
+    }
+    if (isdigit((unsigned char)*p->pos)) {
+        char* end;
+        value->constant = strtoll(p->pos, &end, 0);
+        p->pos = end;
+        return 1;
+    }
+    if (!parseName(p, name))
+        return 0;
+    for (int d = p->depth - 1; d >= 0; d--) {
+        if (strcmp(p->vars[d], name) == 0) {
+            value->coeff[d] = 1;
+            return 1;
+        }
+    }
+    return 0;
+}
+
+/*
+ * scale - Multiply an expression by a constant
+ */
+static void scale(affine_expr_t* value, long long factor)
+{
+    value->constant *= factor;
+    for (int d = 0; d < MAX_DEPTH; d++)
+        value->coeff[d] *= factor;
+}
+
+/*
+ * isConstant - Whether an expression uses no variable
+ */
+static int isConstant(const affine_expr_t* value)
+{
+    for (int d = 0; d < MAX_DEPTH; d++)
+        if (value->coeff[d] != 0)
+            return 0;
+    return 1;
+}
+
+/*
+ * parseProduct - Factors joined by '*', at most one of them not constant
+ */
+static int parseProduct(parser_t* p, affine_expr_t* value)
+{
+    if (!parseFactor(p, value))
+        return 0;
+    for (skipSpaces(p); *p->pos == '*'; skipSpaces(p)) {
+        affine_expr_t factor;
+        p->pos++;
+        if (!parseFactor(p, &factor))
+            return 0;
+        if (isConstant(&factor)) {
+            scale(value, factor.constant);
+        } else if (isConstant(value)) {
+            scale(&factor, value->constant);
+            *value = factor;
+        } else {
+            return 0; /* not affine */
+        }
+    }
+    return 1;
+}
+
+/*
+ * parseSum - Products joined by '+' and '-', with an optional leading sign
+ */
+static int parseSum(parser_t* p, affine_expr_t* value)
+{
+    int sign = 1;
+
+    skipSpaces(p);
+    if (*p->pos == '-') {
+        sign = -1;
+        p->pos++;
+    }
+    if (!parseProduct(p, value))
+        return 0;
+    scale(value, sign);
+    for (skipSpaces(p); *p->pos == '+' || *p->pos == '-'; skipSpaces(p)) {
+        affine_expr_t term;
+        sign = *p->pos++ == '+' ? 1 : -1;
+        if (!parseProduct(p, &term))
+            return 0;
+        value->constant += sign * term.constant;
+        for (int d = 0; d < MAX_DEPTH; d++)
+            value->coeff[d] += sign * term.coeff[d];
+    }
+    return 1;
+}
+
+/*
+ * parseAccess - "<name>[<index>]..." into the byte address of the element
+ */
+static int parseAccess(parser_t* p, affine_expr_t* address)
+{
+    char name[MAX_NAME];
+    affine_array_t* array = NULL;
+    int dim = 0;
+
+    if (!parseName(p, name))
+        return 0;
+    for (int a = 0; a < p->num_arrays; a++)
+        if (strcmp(p->arrays[a].name, name) == 0)
+            array = &p->arrays[a];
+    if (!array)
+        return 0;
+
+    /* Horner's rule over the row-major dimensions, then bytes */
+    memset(address, 0, sizeof(*address));
+    for (skipSpaces(p); *p->pos == '['; skipSpaces(p), dim++) {
+        affine_expr_t index;
+        p->pos++;
+        if (dim == array->num_dims || !parseSum(p, &index))
+            return 0;
+        skipSpaces(p);
+        if (*p->pos++ != ']')
+            return 0;
+        scale(address, array->dims[dim]);
+        address->constant += index.constant;
+        for (int d = 0; d < MAX_DEPTH; d++)
+            address->coeff[d] += index.coeff[d];
+    }
+    if (dim != array->num_dims)
+        return 0;
+    scale(address, array->element);
+    address->constant += array->base;
+    return 1;
+}
+
+/*
+ * parseArray - "<name> <base> <element bytes> <dim>..."
+ */
+static int parseArray(parser_t* p)
+{
+    affine_array_t* array = &p->arrays[p->num_arrays];
+    char* end;
+
+    if (p->num_arrays == MAX_ARRAYS || !parseName(p, array->name))
+        return 0;
+    array->base = strtoull(p->pos, &end, 0);
+    if (end == p->pos)
+        return 0;
+    array->element = strtoll(end, &end, 0);
+    if (array->element < 1)
+        return 0;
+    for (array->num_dims = 0;; array->num_dims++) {
+        const char* start = end;
+        long long dim = strtoll(start, &end, 0);
+        if (end == start)
+            break;
+        if (array->num_dims == MAX_DIMS || dim < 1)
+            return 0;
+        array->dims[array->num_dims] = dim;
+    }
+    p->pos = end;
+    skipSpaces(p);
+    p->num_arrays++;
+    return array->num_dims > 0 && *p->pos == '\0';
+}
+
+/*
+ * addNode - Append a node to the body of the innermost open loop
+ */
+static int addNode(affine_nest_t* nest, int* last, int depth)
+{
+    int id = nest->num_nodes++;
+    affine_node_t* node;
+
+    nest->nodes = realloc(nest->nodes, sizeof(affine_node_t) * nest->num_nodes);
+    node = &nest->nodes[id];
+    memset(node, 0, sizeof(*node));
+    node->first_child = -1;
+    node->next = -1;
+    if (last[depth] >= 0)
+        nest->nodes[last[depth]].next = id;
+    else if (depth == 0)
+        nest->first = id;
+    else
+        nest->nodes[last[depth - 1]].first_child = id;
+    last[depth] = id;
+    return id;
+}
+
+/*
+ * affineLoad - Parse a nest file
+ */
+affine_nest_t* affineLoad(const char* path, int* error_line)
+{
+    FILE* file = fopen(path, "r");
+    affine_nest_t* nest;
+    parser_t p;
+    char line[MAX_LINE];
+    int last[MAX_DEPTH + 1]; /* last node of the body open at each depth */
+    int line_number = 0;
+
+    *error_line = 0;
+    if (!file)
+        return NULL;
+    nest = calloc(1, sizeof(affine_nest_t));
+    nest->first = -1;
+    memset(&p, 0, sizeof(p));
+    for (int d = 0; d <= MAX_DEPTH; d++)
+        last[d] = -1;
+
+    while (fgets(line, sizeof(line), file)) {
+        char keyword[MAX_NAME];
+        char* comment = strchr(line, '#');
+        int ok;
+
+        line_number++;
+        if (comment)
+            *comment = '\0';
+        line[strcspn(line, "\r\n")] = '\0';
+        p.pos = line;
+        skipSpaces(&p);
+        if (*p.pos == '\0')
+            continue;
+        if (!parseName(&p, keyword)) {
+            ok = 0;
+        } else if (strcmp(keyword, "array") == 0) {
+            ok = parseArray(&p);
+        } else if (strcmp(keyword, "for") == 0) {
+            affine_node_t loop = {0};
+            char* end;
+            ok = p.depth < MAX_DEPTH && parseName(&p, p.vars[p.depth]) && parseSum(&p, &loop.lo) &&
+                 parseSum(&p, &loop.hi);
+            loop.step = 1;
+            skipSpaces(&p);
+            if (ok && *p.pos != '\0') {
+                loop.step = strtoll(p.pos, &end, 0);
+                p.pos = end;
+                skipSpaces(&p);
+                ok = loop.step > 0 && *p.pos == '\0';
+            }
+            if (ok) {
+                int id = addNode(nest, last, p.depth);
+                loop.depth = p.depth;
+                loop.leaf = 1;
+                loop.first_child = -1;
+                loop.next = -1;
+                nest->nodes[id] = loop;
+                if (p.depth > 0)
+                    nest->nodes[last[p.depth - 1]].leaf = 0;
+                last[++p.depth] = -1;
+            }
+        } else if (strcmp(keyword, "end") == 0) {
+            skipSpaces(&p);
+            ok = p.depth > 0 && *p.pos == '\0';
+            if (ok)
+                p.depth--;
+        } else if (strlen(keyword) == 1 && strchr("LSM", keyword[0])) {
+            affine_expr_t address;
+            ok = parseAccess(&p, &address);
+            skipSpaces(&p);
+            if (ok && *p.pos == '\0') {
+                int id = addNode(nest, last, p.depth);
+                nest->nodes[id].depth = -1;
+                nest->nodes[id].op = keyword[0];
+                nest->nodes[id].address = address;
+            } else {
+                ok = 0;
+            }
+        } else {
+            ok = 0;
+        }
+        if (!ok) {
+            fclose(file);
+            affineDestroy(nest);
+            *error_line = line_number;
+            return NULL;
+        }
+    }
+    fclose(file);
+    return nest;
+}
+
+/*
+ * affineDestroy - Free a nest
+ */
+void affineDestroy(affine_nest_t* nest)
+{
+    free(nest->nodes);
+    free(nest);
+}
+
+/*
+ * evaluate - Value of an expression for the current loop variables
+ */
+static long long evaluate(const affine_expr_t* expr, const long long* vars, int depth)
+{
+    long long value = expr->constant;
+
+    for (int d = 0; d < depth; d++)
+        value += expr->coeff[d] * vars[d];
+    return value;
+}
+
+/*
+ * touch - One access to the line holding address
+ */
+static void touch(lru_cache_t* cache, unsigned long long address)
+{
+    unsigned long long line = address >> cache->block_bits;
+    unsigned long long* set = &cache->lines[(line & cache->set_mask) * cache->ways];
+    int* used = &cache->used[line & cache->set_mask];
+    int position = 0;
+
+    cache->counts->accesses++;
+    while (position < *used && set[position] != line)
+        position++;
+    if (position < *used) {
+        cache->counts->hits++;
+    } else {
+        cache->counts->misses++;
+        if (*used == cache->ways) {
+            cache->counts->evictions++;
+            position = *used - 1;
+        } else {
+            position = (*used)++;
+        }
+    }
+    memmove(&set[1], &set[0], sizeof(unsigned long long) * position);
+    set[0] = line;
+}
+
+/*
+ * runBody - Execute the accesses of a leaf loop body once
+ */
+static void runBody(const affine_nest_t* nest, int first, lru_cache_t* cache, const long long* vars, int depth)
+{
+    for (int id = first; id >= 0; id = nest->nodes[id].next) {
+        unsigned long long address = evaluate(&nest->nodes[id].address, vars, depth);
+        touch(cache, address);
+        if (nest->nodes[id].op == 'M')
+            touch(cache, address); /* the store half of a modify */
+    }
+}
+
+/*
+ * sameLineSteps - Iterations after the current one in which an access
+ *     that moves by delta bytes per iteration stays in its line
+ */
+static unsigned long long sameLineSteps(unsigned long long address, long long delta, int block_bits)
+{
+    unsigned long long start = address >> block_bits << block_bits;
+
+    if (delta > 0)
+        return (start + (1ULL << block_bits) - 1 - address) / (unsigned long long)delta;
+    if (delta < 0)
+        return (address - start) / (unsigned long long)-delta;
+    return ~0ULL;
+}
+
+/*
+ * runLeaf - Execute a leaf loop, replaying runs of iterations that touch
+ *     the same lines by multiplying the counts of their first repeat
+ */
+static void runLeaf(const affine_nest_t* nest, const affine_node_t* loop, lru_cache_t* cache, long long* vars)
+{
+    int d = loop->depth;
+    long long lo = evaluate(&loop->lo, vars, d), hi = evaluate(&loop->hi, vars, d);
+    unsigned long long remaining = hi > lo ? (unsigned long long)(hi - lo + loop->step - 1) / loop->step : 0;
+
+    vars[d] = lo;
+    cache->counts->iterations += remaining;
+    while (remaining > 0) {
+        unsigned long long run = remaining - 1;
+        affine_counts_t before, repeat;
+
+        runBody(nest, loop->first_child, cache, vars, d + 1);
+        cache->counts->simulated++;
+        for (int id = loop->first_child; id >= 0 && run > 0; id = nest->nodes[id].next) {
+            const affine_expr_t* address = &nest->nodes[id].address;
+            unsigned long long steps = sameLineSteps(evaluate(address, vars, d + 1), address->coeff[d] * loop->step,
+                                                     cache->block_bits);
+            if (steps < run)
+                run = steps;
+        }
+        vars[d] += loop->step;
+        remaining--;
+        if (run == 0)
+            continue;
+
+        /* The first repeat leaves the cache as it found it; the rest copy it */
+        before = *cache->counts;
+        runBody(nest, loop->first_child, cache, vars, d + 1);
+        cache->counts->simulated++;
+        repeat = *cache->counts;
+        cache->counts->accesses += (repeat.accesses - before.accesses) * (run - 1);
+        cache->counts->hits += (repeat.hits - before.hits) * (run - 1);
+        cache->counts->misses += (repeat.misses - before.misses) * (run - 1);
+        cache->counts->evictions += (repeat.evictions - before.evictions) * (run - 1);
+        vars[d] += loop->step * run;
+        remaining -= run;
+    }
+}
+
+/*
+ * runNodes - Execute a list of loops and accesses
+ */
+static void runNodes(const affine_nest_t* nest, int first, lru_cache_t* cache, long long* vars, int depth)
+{
+    for (int id = first; id >= 0; id = nest->nodes[id].next) {
+        const affine_node_t* node = &nest->nodes[id];
+        if (node->depth < 0) {
+            unsigned long long address = evaluate(&node->address, vars, depth);
+            touch(cache, address);
+            if (node->op == 'M')
+                touch(cache, address);
+        } else if (node->leaf) {
+            runLeaf(nest, node, cache, vars);
+        } else {
+            long long hi = evaluate(&node->hi, vars, node->depth);
+            for (vars[node->depth] = evaluate(&node->lo, vars, node->depth); vars[node->depth] < hi;
+                 vars[node->depth] += node->step)
+                runNodes(nest, node->first_child, cache, vars, node->depth + 1);
+        }
+    }
+}
+
+/*
+ * affineCount - Evaluate a nest on an empty LRU cache
+ */
+int affineCount(const affine_nest_t* nest, int set_bits, int ways, int block_bits, affine_counts_t* counts)
+{
+    lru_cache_t cache;
+    long long vars[MAX_DEPTH] = {0};
+
+    memset(counts, 0, sizeof(*counts));
+    if (set_bits < 0 || set_bits > 30 || ways < 1 || block_bits < 0 || block_bits > 62)
+        return 0;
+    cache.lines = malloc(sizeof(unsigned long long) * ((size_t)ways << set_bits));
+    cache.used = calloc((size_t)1 << set_bits, sizeof(int));
+    if (!cache.lines || !cache.used) {
+        free(cache.lines);
+        free(cache.used);
+        return 0;
+    }
+    cache.set_mask = (1ULL << set_bits) - 1;
+    cache.ways = ways;
+    cache.block_bits = block_bits;
+    cache.counts = counts;
+
+    runNodes(nest, nest->first, &cache, vars, 0);
+
+    free(cache.lines);
+    free(cache.used);
+    return 1;
+}
@@ -0,0 +1,57 @@
+/*
+ * affine.h - Analytic miss counting for affine loop nests: exact LRU hits,
+ *     misses and evictions without a trace
+ *
+ * A nest file declares arrays and loops, one per line ('#' starts a
+ * comment):
+ *
+ *     array <name> <base> <element bytes> <dim> [<dim>]...
+ *     for <var> <lo> <hi> [<step>]     var = lo, lo + step, ... while < hi
+ *     L|S|M <name>[<index>]...         a load, store or modify
+ *     end                              closes the innermost open loop
+ *
+ * Arrays are row-major. Bounds and indices are affine expressions over
+ * the enclosing loop variables, e.g. "bi+8" or "2*(i-1)+j"; loops still
+ * open at the end of the file are closed there. The simple transpose of
+ * trans.c, for instance, is
+ *
+ *     array A 0x10000 4 32 32
+ *     array B 0x20000 4 32 32
+ *     for i 0 32
+ *     for j 0 32
+ *     L A[i][j]
+ *     S B[j][i]
+ */
+
+#ifndef AFFINE_H
+#define AFFINE_H
+
+typedef struct affine_nest affine_nest_t;
+
+/* Totals of one evaluation; a modify counts as two accesses, like in a trace */
+typedef struct affine_counts {
+    unsigned long long accesses;   /* memory accesses made by the nest */
+    unsigned long long hits;
+    unsigned long long misses;
+    unsigned long long evictions;
+    unsigned long long iterations; /* innermost loop iterations executed */
+    unsigned long long simulated;  /* of those, the ones actually simulated */
+} affine_counts_t;
+
+/*
+ * Read a nest file. Returns NULL if it cannot be read or is malformed;
+ * *error_line is then the offending line, or 0 if the file cannot be opened.
+ */
+affine_nest_t* affineLoad(const char* path, int* error_line);
+
+/* Free a nest */
+void affineDestroy(affine_nest_t* nest);
+
+/*
+ * Count the accesses of the nest on an LRU cache with 2^set_bits sets of
+ * ways lines of 2^block_bits bytes, starting empty. Returns 0 if the cache
+ * is too large to model.
+ */
+int affineCount(const affine_nest_t* nest, int set_bits, int ways, int block_bits, affine_counts_t* counts);
+
+#endif /* AFFINE_H */
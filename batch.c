@@ -0,0 +1,224 @@
+/*
+ * batch.c - Batched transposes of small matrices
+ *
+ * A 4 x 4 to 32 x 32 int matrix fits in L1 many times over, so
+ * transposing a batch of them one call at a time is bound by loop and
+ * call overhead rather than by misses. Here the batch is cut into one
+ * contiguous share per thread, and each share is transposed either by a
+ * kernel whose loop bounds are compile-time constants, or, in the
+ * interleaved layout, BATCH_LANES matrices at once: element (i, j) of
+ * eight matrices is one vector, and the whole transpose is a permutation
+ * of vectors.
+ */
+#define _POSIX_C_SOURCE 200809L /* For sysconf() */
+#include <string.h>
+#include <unistd.h>
+#include <pthread.h>
+#include "batch.h"
+
+/* One vector of the interleaved layout */
+typedef int lanes_t __attribute__((vector_size(BATCH_LANES * sizeof(int))));
+
+struct batch_job;
+
+/* Transposes a share's matrices, back to back or interleaved */
+typedef void (*batch_kernel_t)(const struct batch_job* job);
+
+/* A thread's share of a batch */
+typedef struct batch_job {
+    batch_kernel_t kernel;
+    int rows, cols;
+    size_t count;
+    const int* src;
+    int* dst;
+    pthread_t thread;
+} batch_job_t;
+
+#define MAX_BATCH_THREADS 64
+
+/*
+ * Fewest ints a thread is given: creating and joining a thread costs tens
+ * of microseconds, which below this is more than the share itself takes
+ */
+#define BATCH_MIN_PER_THREAD (64 * 1024)
+
+/*
+ * transposeAny - Back-to-back matrices of any size
+ */
+static void transposeAny(const batch_job_t* job)
+{
+    int rows = job->rows, cols = job->cols;
+    size_t size = (size_t)rows * cols;
+    const int* src = job->src;
+    int* dst = job->dst;
+
+    for (size_t m = 0; m < job->count; m++, src += size, dst += size)
+        for (int i = 0; i < rows; i++)
+            for (int j = 0; j < cols; j++)
+                dst[j * rows + i] = src[i * cols + j];
+}
+
+/*
+ * transposeSquareN - Back-to-back N x N matrices; the constant bounds let
+ *     the compiler unroll the inner loops
+ */
+#define TRANSPOSE_SQUARE(n)                                                \
+    static void transposeSquare##n(const batch_job_t* job)                 \
+    {                                                                      \
+        const int* src = job->src;                                         \
+        int* dst = job->dst;                                               \
+        for (size_t m = 0; m < job->count; m++, src += n * n, dst += n * n) \
+            for (int i = 0; i < n; i++)                                    \
+                for (int j = 0; j < n; j++)                                \
+                    dst[j * n + i] = src[i * n + j];                       \
+    }
+
+TRANSPOSE_SQUARE(4)
+TRANSPOSE_SQUARE(8)
+TRANSPOSE_SQUARE(16)
+TRANSPOSE_SQUARE(32)
+
+/*
+ * transposeLanes - Interleaved groups: move whole vectors, so every lane
+ *     is transposed by the same load and store
+ */
+static void transposeLanes(const batch_job_t* job)
+{
+    int rows = job->rows, cols = job->cols;
+    size_t size = (size_t)rows * cols * BATCH_LANES;
+    const int* src = job->src;
+    int* dst = job->dst;
+
+    for (size_t g = 0; g < job->count; g += BATCH_LANES, src += size, dst += size) {
+        for (int i = 0; i < rows; i++) {
+            for (int j = 0; j < cols; j++) {
+                lanes_t v;
+                memcpy(&v, &src[(i * cols + j) * BATCH_LANES], sizeof(v));
+                memcpy(&dst[(j * rows + i) * BATCH_LANES], &v, sizeof(v));
+            }
+        }
+    }
+}
+
+/*
+ * runJob - Thread body
+ */
+static void* runJob(void* arg)
+{
+    batch_job_t* job = arg;
+
+    job->kernel(job);
+    return NULL;
+}
+
+/*
+ * runBatch - Split count matrices into one share per thread, each a whole
+ *     number of groups of unit matrices and at least BATCH_MIN_PER_THREAD
+ *     ints, and run the shares in parallel; small batches run here
+ */
+static void runBatch(batch_kernel_t kernel, int rows, int cols, size_t count, const int* src, int* dst,
+                     int threads, size_t unit)
+{
+    batch_job_t jobs[MAX_BATCH_THREADS];
+    size_t groups = (count + unit - 1) / unit, size = (size_t)rows * cols, start = 0;
+    int n = 0;
+
+    if (threads <= 0)
+        threads = (int)sysconf(_SC_NPROCESSORS_ONLN);
+    if (threads > MAX_BATCH_THREADS)
+        threads = MAX_BATCH_THREADS;
+    if ((size_t)threads > groups)
+        threads = groups;
+    if ((size_t)threads > count * size / BATCH_MIN_PER_THREAD)
+        threads = count * size / BATCH_MIN_PER_THREAD;
+    if (threads <= 1) {
+        batch_job_t all = {kernel, rows, cols, count, src, dst};
+        if (count > 0)
+            kernel(&all);
+        return;
+    }
+
+    for (int t = 0; t < threads; t++) {
+        size_t end = groups * (t + 1) / threads * unit;
+        batch_job_t* job = &jobs[n];
+        if (end > count)
+            end = count;
+        job->kernel = kernel;
+        job->rows = rows;
+        job->cols = cols;
+        job->count = end - start;
+        job->src = src + start * size;
+        job->dst = dst + start * size;
+        start = end;
+        /* Fall back to running a share here if no thread can be had */
+        if (pthread_create(&job->thread, NULL, runJob, job) != 0)
+            runJob(job);
+        else
+            n++;
+    }
+    for (int t = 0; t < n; t++)
+        pthread_join(jobs[t].thread, NULL);
+}
+
+/*
+ * batchInterleavedSize - Ints of an interleaved batch
+ */
+size_t batchInterleavedSize(int rows, int cols, size_t count)
+{
+    return (count + BATCH_LANES - 1) / BATCH_LANES * BATCH_LANES * rows * cols;
+}
+
+/*
+ * batchInterleave - Scatter every matrix into its lane
+ */
+void batchInterleave(int rows, int cols, size_t count, const int* src, int* dst)
+{
+    size_t size = (size_t)rows * cols;
+
+    memset(dst, 0, sizeof(int) * batchInterleavedSize(rows, cols, count));
+    for (size_t m = 0; m < count; m++) {
+        int* group = &dst[m / BATCH_LANES * size * BATCH_LANES + m % BATCH_LANES];
+        for (size_t k = 0; k < size; k++)
+            group[k * BATCH_LANES] = src[m * size + k];
+    }
+}
+
+/*
+ * batchDeinterleave - Gather every lane back into its matrix
+ */
+void batchDeinterleave(int rows, int cols, size_t count, const int* src, int* dst)
+{
+    size_t size = (size_t)rows * cols;
+
+    for (size_t m = 0; m < count; m++) {
+        const int* group = &src[m / BATCH_LANES * size * BATCH_LANES + m % BATCH_LANES];
+        for (size_t k = 0; k < size; k++)
+            dst[m * size + k] = group[k * BATCH_LANES];
+    }
+}
+
+/*
+ * batchTranspose - Back-to-back batches
+ */
+void batchTranspose(int rows, int cols, size_t count, const int* src, int* dst, int threads)
+{
+    batch_kernel_t kernel = transposeAny;
+
+    if (rows == cols) {
+        switch (rows) {
+        case 4: kernel = transposeSquare4; break;
+        case 8: kernel = transposeSquare8; break;
+        case 16: kernel = transposeSquare16; break;
+        case 32: kernel = transposeSquare32; break;
+        }
+    }
+    runBatch(kernel, rows, cols, count, src, dst, threads, 1);
+}
+
+/*
+ * batchTransposeInterleaved - Interleaved batches; shares are whole groups
+ */
+void batchTransposeInterleaved(int rows, int cols, size_t count, const int* src, int* dst, int threads)
+{
+    runBatch(transposeLanes, rows, cols, count, src, dst, threads, BATCH_LANES);
+}
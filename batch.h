@@ -0,0 +1,37 @@
+/*
+ * batch.h - Batched transposes of many small same-shaped int matrices,
+ *     split over threads and, in the interleaved layout, vectorized
+ *     across matrices
+ */
+
+#ifndef BATCH_H
+#define BATCH_H
+
+#include <stddef.h>
+
+/*
+ * Matrices per vector in the interleaved layout: element k of matrix m
+ * sits at ((m / BATCH_LANES) * rows * cols + k) * BATCH_LANES + m % BATCH_LANES,
+ * so one vector holds the same element of BATCH_LANES matrices.
+ */
+#define BATCH_LANES 8
+
+/* Ints an interleaved batch takes; the last group of lanes is padded */
+size_t batchInterleavedSize(int rows, int cols, size_t count);
+
+/* Convert count back-to-back rows x cols matrices to the interleaved layout and back */
+void batchInterleave(int rows, int cols, size_t count, const int* src, int* dst);
+void batchDeinterleave(int rows, int cols, size_t count, const int* src, int* dst);
+
+/*
+ * Transpose count back-to-back rows x cols matrices of src into dst, as
+ * many cols x rows matrices, on up to threads threads (0: one per CPU);
+ * batches too small to repay a thread's startup run on the caller's thread.
+ * Square sizes 4, 8, 16 and 32 use kernels compiled for their size.
+ */
+void batchTranspose(int rows, int cols, size_t count, const int* src, int* dst, int threads);
+
+/* The same on interleaved batches, moving a vector of BATCH_LANES elements at a time */
+void batchTransposeInterleaved(int rows, int cols, size_t count, const int* src, int* dst, int threads);
+
+#endif /* BATCH_H */
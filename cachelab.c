@@ -10,6 +10,9 @@
 trans_func_t func_list[MAX_TRANS_FUNCS];
 int func_counter = 0; 
 
+kernel_func_t kernel_list[MAX_KERNEL_FUNCS];
+int kernel_counter = 0;
+
 /* 
  * printSummary - Summarize the cache simulation statistics. Student cache simulators
  *                must call this function in order to be properly autograded. 
@@ -97,4 +100,231 @@ void registerTransFunction(void (*trans)(int M, int N, int[N][M], int[M][N]),
     func_list[func_counter].num_misses = 0;
     func_list[func_counter].num_evictions =0;
     func_counter++;
+    registerKernelFunction(&transpose_kernel, (kernel_impl_t)trans, desc);
+}
+
+/* 
+ * registerKernelFunction - Add a function of the given kernel family
+ *     into the list of kernels to be tested
+ */
+void registerKernelFunction(const kernel_desc_t* kernel, kernel_impl_t func, char* desc)
+{
+    if (kernel_counter == MAX_KERNEL_FUNCS)
+        return;
+    kernel_list[kernel_counter].kernel = kernel;
+    kernel_list[kernel_counter].func_ptr = func;
+    kernel_list[kernel_counter].description = desc;
+    kernel_list[kernel_counter].correct = 0;
+    kernel_list[kernel_counter].skipped = 0;
+    kernel_list[kernel_counter].num_hits = 0;
+    kernel_list[kernel_counter].num_misses = 0;
+    kernel_list[kernel_counter].num_evictions = 0;
+    kernel_list[kernel_counter].seconds = 0;
+    kernel_counter++;
+}
+
+/*
+ * parseExtent - Recursive descent over "sum := term {+|- term}",
+ *     "term := factor {* factor}", "factor := number | M | N | K | (sum)"
+ */
+static int parseExtent(const char** pos, const kernel_dims_t* dims, int* ok);
+
+static int parseFactor(const char** pos, const kernel_dims_t* dims, int* ok)
+{
+    int value = 0;
+
+    switch (**pos) {
+    case 'M': (*pos)++; return dims->M;
+    case 'N': (*pos)++; return dims->N;
+    case 'K': (*pos)++; return dims->K;
+    case '(':
+        (*pos)++;
+        value = parseExtent(pos, dims, ok);
+        if (**pos != ')')
+            *ok = 0;
+        else
+            (*pos)++;
+        return value;
+    }
+    if (**pos < '0' || **pos > '9')
+        *ok = 0;
+    while (**pos >= '0' && **pos <= '9')
+        value = value * 10 + *(*pos)++ - '0';
+    return value;
+}
+
+static int parseTerm(const char** pos, const kernel_dims_t* dims, int* ok)
+{
+    int value = parseFactor(pos, dims, ok);
+
+    while (**pos == '*') {
+        (*pos)++;
+        value *= parseFactor(pos, dims, ok);
+    }
+    return value;
+}
+
+static int parseExtent(const char** pos, const kernel_dims_t* dims, int* ok)
+{
+    int value = parseTerm(pos, dims, ok);
+
+    while (**pos == '+' || **pos == '-') {
+        char op = *(*pos)++;
+        int term = parseTerm(pos, dims, ok);
+        value = op == '+' ? value + term : value - term;
+    }
+    return value;
+}
+
+/* 
+ * kernelExtent - Evaluate a row or column expression of an operand
+ */
+int kernelExtent(const char* expr, const kernel_dims_t* dims)
+{
+    int ok = 1;
+    int value = parseExtent(&expr, dims, &ok);
+
+    return ok && *expr == '\0' ? value : -1;
+}
+
+/* 
+ * kernelElemSize - Bytes of one element
+ */
+int kernelElemSize(kernel_elem_t type)
+{
+    switch (type) {
+    case KERNEL_INT: return sizeof(int);
+    case KERNEL_FLOAT: return sizeof(float);
+    case KERNEL_DOUBLE: return sizeof(double);
+    }
+    return 0;
+}
+
+/*
+ * Transpose: B = A^T, the family registered by registerTransFunction
+ */
+static void invokeTranspose(kernel_impl_t impl, const kernel_dims_t* dims, void* operands[])
+{
+    int M = dims->M, N = dims->N;
+    void (*trans)(int, int, int[N][M], int[M][N]) =
+        (void (*)(int, int, int[N][M], int[M][N]))impl;
+
+    trans(M, N, operands[0], operands[1]);
 }
+
+const kernel_desc_t transpose_kernel = {
+    "transpose", 2,
+    {{"A", KERNEL_INT, KERNEL_IN, "N", "M"},
+     {"B", KERNEL_INT, KERNEL_OUT, "M", "N"}},
+    invokeTranspose, (kernel_impl_t)correctTrans, NULL
+};
+
+/* 
+ * correctGemm - baseline C = A * B
+ */
+void correctGemm(int M, int N, int K, double A[M][K], double B[K][N], double C[M][N])
+{
+    int i, j, k;
+    for (i = 0; i < M; i++) {
+        for (j = 0; j < N; j++) {
+            double sum = 0;
+            for (k = 0; k < K; k++)
+                sum += A[i][k] * B[k][j];
+            C[i][j] = sum;
+        }
+    }
+}
+
+static void invokeGemm(kernel_impl_t impl, const kernel_dims_t* dims, void* operands[])
+{
+    int M = dims->M, N = dims->N, K = dims->K;
+    void (*gemm)(int, int, int, double[M][K], double[K][N], double[M][N]) =
+        (void (*)(int, int, int, double[M][K], double[K][N], double[M][N]))impl;
+
+    gemm(M, N, K, operands[0], operands[1], operands[2]);
+}
+
+const kernel_desc_t gemm_kernel = {
+    "gemm", 3,
+    {{"A", KERNEL_DOUBLE, KERNEL_IN, "M", "K"},
+     {"B", KERNEL_DOUBLE, KERNEL_IN, "K", "N"},
+     {"C", KERNEL_DOUBLE, KERNEL_OUT, "M", "N"}},
+    invokeGemm, (kernel_impl_t)correctGemm, NULL
+};
+
+/* 
+ * correctStencil - baseline 5-point average, copying the border
+ */
+void correctStencil(int M, int N, float in[N][M], float out[N][M])
+{
+    int i, j;
+    for (i = 0; i < N; i++) {
+        for (j = 0; j < M; j++) {
+            if (i == 0 || j == 0 || i == N - 1 || j == M - 1)
+                out[i][j] = in[i][j];
+            else
+                out[i][j] = 0.2f * (in[i][j] + in[i - 1][j] + in[i + 1][j] +
+                                    in[i][j - 1] + in[i][j + 1]);
+        }
+    }
+}
+
+static void invokeStencil(kernel_impl_t impl, const kernel_dims_t* dims, void* operands[])
+{
+    int M = dims->M, N = dims->N;
+    void (*stencil)(int, int, float[N][M], float[N][M]) =
+        (void (*)(int, int, float[N][M], float[N][M]))impl;
+
+    stencil(M, N, operands[0], operands[1]);
+}
+
+const kernel_desc_t stencil_kernel = {
+    "stencil", 2,
+    {{"in", KERNEL_FLOAT, KERNEL_IN, "N", "M"},
+     {"out", KERNEL_FLOAT, KERNEL_OUT, "N", "M"}},
+    invokeStencil, (kernel_impl_t)correctStencil, NULL
+};
+
+/* 
+ * correctConv - baseline direct 2D convolution (cross-correlation) of
+ *     an N x M image with a K x K filter, valid region only
+ */
+void correctConv(int M, int N, int K, float img[N][M], float filt[K][K],
+                 float out[N - K + 1][M - K + 1], float work[][K * K])
+{
+    int i, j, u, v;
+    for (i = 0; i < N - K + 1; i++) {
+        for (j = 0; j < M - K + 1; j++) {
+            float sum = 0;
+            for (u = 0; u < K; u++)
+                for (v = 0; v < K; v++)
+                    sum += img[i + u][j + v] * filt[u][v];
+            out[i][j] = sum;
+        }
+    }
+}
+
+static void invokeConv(kernel_impl_t impl, const kernel_dims_t* dims, void* operands[])
+{
+    int M = dims->M, N = dims->N, K = dims->K;
+    void (*conv)(int, int, int, float[N][M], float[K][K], float[N - K + 1][M - K + 1],
+                 float[][K * K]) =
+        (void (*)(int, int, int, float[N][M], float[K][K], float[N - K + 1][M - K + 1],
+                  float[][K * K]))impl;
+
+    conv(M, N, K, operands[0], operands[1], operands[2], operands[3]);
+}
+
+static int validConv(const kernel_dims_t* dims)
+{
+    return dims->K >= 1 && dims->K <= dims->M && dims->K <= dims->N;
+}
+
+const kernel_desc_t conv_kernel = {
+    "conv", 4,
+    {{"img", KERNEL_FLOAT, KERNEL_IN, "N", "M"},
+     {"filt", KERNEL_FLOAT, KERNEL_IN, "K", "K"},
+     {"out", KERNEL_FLOAT, KERNEL_OUT, "N-K+1", "M-K+1"},
+     {"work", KERNEL_FLOAT, KERNEL_SCRATCH, "(N-K+1)*(M-K+1)", "K*K"}},
+    invokeConv, (kernel_impl_t)correctConv, validConv
+};
@@ -37,4 +37,95 @@ void correctTrans(int M, int N, int A[N][M], int B[M][N]);
 void registerTransFunction(
     void (*trans)(int M,int N,int[N][M],int[M][N]), char* desc);
 
+/*
+ * Generalized kernels. A kernel family (transpose, GEMM, stencil, ...) is
+ * described by its operands, an adapter that calls a function of the
+ * family's own signature, and a reference implementation used as the
+ * correctness oracle. Functions of any family are registered in one list
+ * and evaluated by the same harness (test-kernels).
+ */
+#define MAX_KERNEL_FUNCS 100
+#define MAX_KERNEL_OPERANDS 4
+
+/* Element type of an operand */
+typedef enum {
+  KERNEL_INT,
+  KERNEL_FLOAT,
+  KERNEL_DOUBLE
+} kernel_elem_t;
+
+/* How a kernel uses an operand */
+typedef enum {
+  KERNEL_IN,      /* read only, filled with test data */
+  KERNEL_OUT,     /* written, compared against the oracle */
+  KERNEL_SCRATCH  /* workspace, e.g. an im2col buffer */
+} kernel_role_t;
+
+/*
+ * A row-major matrix operand. rows and cols are expressions over the
+ * dimensions M, N and K with +, -, * and parentheses, e.g. "N-K+1".
+ */
+typedef struct kernel_operand{
+  char* name;
+  kernel_elem_t type;
+  kernel_role_t role;
+  char* rows;
+  char* cols;
+} kernel_operand_t;
+
+/* Problem size of one evaluation */
+typedef struct kernel_dims{
+  int M;
+  int N;
+  int K;
+} kernel_dims_t;
+
+/* Any kernel function; the family's adapter casts it back to its real type */
+typedef void (*kernel_impl_t)(void);
+
+typedef struct kernel_desc{
+  char* name;
+  int num_operands;
+  kernel_operand_t operands[MAX_KERNEL_OPERANDS];
+  /* Call impl, which has the family's signature, on the operands */
+  void (*invoke)(kernel_impl_t impl, const kernel_dims_t* dims, void* operands[]);
+  kernel_impl_t oracle;
+  /* Whether the family supports these dimensions, or NULL if it supports all */
+  int (*valid)(const kernel_dims_t* dims);
+} kernel_desc_t;
+
+typedef struct kernel_func{
+  const kernel_desc_t* kernel;
+  kernel_impl_t func_ptr;
+  char* description;
+  char correct;
+  char skipped; /* the dimensions did not fit, so it never ran */
+  unsigned int num_hits;
+  unsigned int num_misses;
+  unsigned int num_evictions;
+  double seconds; /* best wall-clock time of one call */
+} kernel_func_t;
+
+/* Kernel families provided with the harness */
+extern const kernel_desc_t transpose_kernel; /* trans(M, N, int A[N][M], int B[M][N]) */
+extern const kernel_desc_t gemm_kernel;      /* gemm(M, N, K, double A[M][K], double B[K][N], double C[M][N]) */
+extern const kernel_desc_t stencil_kernel;   /* stencil(M, N, float in[N][M], float out[N][M]), 5 points */
+extern const kernel_desc_t conv_kernel;      /* conv(M, N, K, float img[N][M], float filt[K][K],
+                                                     float out[N-K+1][M-K+1], float work[..][K*K]) */
+
+/* Baseline implementations the kernel families use as oracles */
+void correctGemm(int M, int N, int K, double A[M][K], double B[K][N], double C[M][N]);
+void correctStencil(int M, int N, float in[N][M], float out[N][M]);
+void correctConv(int M, int N, int K, float img[N][M], float filt[K][K],
+                 float out[N - K + 1][M - K + 1], float work[][K * K]);
+
+/* Add a function of the given family to the kernel list */
+void registerKernelFunction(const kernel_desc_t* kernel, kernel_impl_t func, char* desc);
+
+/* Rows or columns of an operand for dims; -1 if the expression is malformed */
+int kernelExtent(const char* expr, const kernel_dims_t* dims);
+
+/* Bytes of one element of the given type */
+int kernelElemSize(kernel_elem_t type);
+
 #endif /* CACHELAB_TOOLS_H */
@@ -1,212 +1,3069 @@
+#define _POSIX_C_SOURCE 200809L // For fork(), pipe(), fdopen() and POSIX threads.
+
+#include "affine.h"
 #include "cachelab.h"
+#include "dram.h"
+#include "llc.h"
+#include "numa.h"
+#include "ocache.h"
+#include "shards.h"
+#include "tinylfu.h"
 #include <assert.h>
+#include <ctype.h>
 #include <errno.h>
+#include <fcntl.h>
 #include <getopt.h>
 #include <limits.h>
 #include <math.h>
+#include <pthread.h>
 #include <stdio.h>
 #include <stdlib.h>
 #include <string.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <sys/wait.h>
 #include <unistd.h>
 
 #define ADDR_LEN 64 // Defines the maximum address length for our simulation.
 
-// Define a custom type for handling addresses within our cache.
-typedef unsigned long long int address_t;
+// Define a custom type for handling addresses within our cache.
+typedef unsigned long long int address_t;
+
+// Structure to represent a cache line, with metadata for cache management.
+typedef struct cache_entry {
+    char is_valid; // Valid bit indicating if this cache line is in use.
+    address_t entry_tag; // The tag part of the cached address.
+    unsigned long long int usage_counter; // Counter for implementing LRU eviction policy.
+    char is_dirty; // Indicates if the line has been written to since being loaded.
+    address_t access_time; // Tracks the last time this line was accessed.
+    unsigned char rrpv; // Re-reference prediction value for RRIP-based policies.
+    unsigned char outcome; // Set once the line is re-referenced after insertion (SHiP).
+    unsigned short signature; // PC signature of the access that filled the line.
+    unsigned short dead_signature; // PC signature of the last access, for dead-block prediction.
+} cache_entry_t;
+
+// Replacement policies selectable with -r.
+typedef enum {
+    POLICY_LRU, // Least recently used (default).
+    POLICY_SHIP, // Signature-based hit prediction over SRRIP.
+    POLICY_HAWKEYE, // OPT-trained PC predictor over RRIP.
+    POLICY_BIP, // Bimodal insertion: LRU that mostly inserts at the LRU position.
+    POLICY_DIP, // Set dueling between LRU and BIP.
+    POLICY_SRRIP, // Static RRIP: insert with a long re-reference interval.
+    POLICY_BRRIP, // Bimodal RRIP: mostly insert with a distant re-reference interval.
+    POLICY_DRRIP // Set dueling between SRRIP and BRRIP.
+} policy_t;
+
+// Names accepted by -r, indexed by policy_t.
+const char* policy_names[] = {"lru", "ship", "hawkeye", "bip", "dip", "srrip", "brrip", "drrip"};
+
+// Way predictors selectable with -p: which way to read first on a lookup.
+typedef enum {
+    WAY_PREDICT_NONE, // Every way is read in parallel.
+    WAY_PREDICT_MRU, // The most recently used way of the set.
+    WAY_PREDICT_PC, // The way last used by the access PC.
+    WAY_PREDICT_XOR // The way last used by the PC XOR block address.
+} way_predictor_t;
+
+// Names accepted by -p, indexed by way_predictor_t.
+const char* way_predictor_names[] = {"none", "mru", "pc", "xor"};
+
+#define WAY_PREDICT_BITS 10 // Default log2 of the PC and XOR predictor table sizes.
+#define WAY_PREDICT_HIT_CYCLES 1 // Latency of a hit in the predicted way.
+#define WAY_PREDICT_MISS_CYCLES 2 // Extra latency of a hit in another way: the second probe.
+
+#define RRIP_RRPV_MAX 3 // 2-bit RRPV used by SRRIP, BRRIP and SHiP.
+#define BIMODAL_THROTTLE 32 // Bimodal policies insert near-MRU once every this many fills.
+
+#define DUEL_LEADER_SETS 32 // Leader sets dedicated to each dueling candidate.
+#define PSEL_MAX 1023 // 10-bit saturating policy selector.
+#define DUEL_EPOCH 10000 // Accesses between samples of the dueling winner.
+
+#define MAX_PARTITIONS 16 // Way partitions selectable with -P, including the default one.
+#define MAX_STREAM_RANGES 16 // Address ranges whose stores stream past the cache (-T).
+#define MAX_REMAPS 16 // Address remapping rules given with -A.
+#define MAX_LOCKS 16 // Address ranges pinned into the cache with -L.
+#define REMAP_PAGE_BYTES 4096 // Page size assumed by the page-coloring remap.
+#define ALL_WAYS (~0ULL) // Way mask that allows every line of a set.
+#define UMON_SAMPLE_STRIDE 32 // UCP utility monitors shadow one set in this many.
+
+#define MAX_TRACES 16 // Traces that can share the cache with repeated -t.
+#define TRACE_TAG_SHIFT 56 // Address bit where the trace index is tagged in when mixing.
+#define TRACE_ADDRESS_MASK ((1ULL << TRACE_TAG_SHIFT) - 1) // Address bits below the trace tag.
+#define MIX_HIT_CYCLES 4 // Cost of a hit in the mixing slowdown estimate.
+#define MIX_MISS_CYCLES 200 // Extra cost of a miss in the mixing slowdown estimate.
+
+#define WB_DRAIN_CYCLES 16 // Default cycles for the write buffer to retire one line.
+
+#define MSHR_MISS_CYCLES 200 // Default miss latency of the MSHR model without DRAM.
+#define MSHR_PENDING ULLONG_MAX // Ready time of a fill DRAM has not scheduled yet.
+
+#define PARSE_MIN_CHUNK (1 << 20) // Smallest share of a trace file worth its own parser thread.
+#define TRACE_INDEX_SUFFIX ".idx" // Appended to a trace's path to name its sparse index.
+#define TRACE_INDEX_MAGIC "CSIMIDX1" // First eight bytes of a sparse index.
+#define TRACE_INDEX_STRIDE 4096 // Records between entries of a sparse index.
+
+// How -m interleaves several traces.
+typedef enum {
+    SCHEDULE_ROUND_ROBIN, // One record from each trace in turn.
+    SCHEDULE_WEIGHTED, // Records in proportion to the -w weights.
+    SCHEDULE_PROPORTIONAL // Records in proportion to each trace's length, so all end together.
+} schedule_t;
+
+// One data access read from a trace.
+typedef struct trace_record {
+    char operation; // L, S or M.
+    address_t address; // Accessed address, as the trace gives it.
+    int size; // Access size in bytes.
+    int thread; // Thread ID from the optional third field, or 0.
+    address_t pc; // Address of the most recent instruction fetch before this access.
+} trace_record_t;
+
+// A trace being streamed, with its share of a mixed run.
+typedef struct trace_stream {
+    char* path; // Trace file path.
+    FILE* file; // Open trace file.
+    address_t pc; // Most recent instruction fetch seen in this trace.
+    address_t tag; // Bits ORed into every address to keep traces apart.
+    double stride; // Scheduling pass increment, the inverse of the trace's weight.
+    double pass; // Scheduling position; the lowest pass goes next.
+    int done; // Whether the trace is exhausted.
+    int hits; // Hits by this trace on the shared cache.
+    int misses; // Misses by this trace on the shared cache.
+    trace_record_t* records; // Data accesses of a mixed trace, loaded up front.
+    unsigned long long count; // Number of loaded records.
+    unsigned long long next; // Next loaded record to replay.
+    pthread_t loader; // Thread loading this trace of a mix.
+    pid_t alone_pid; // Child simulating this trace on a private cache.
+    int alone_fd; // Pipe carrying the child's results.
+    int alone_hits; // Hits when running alone.
+    int alone_misses; // Misses when running alone.
+} trace_stream_t;
+#define SHIP_SHCT_BITS 14 // log2 of the signature history counter table size.
+#define SHIP_SHCT_MAX 7 // 3-bit saturating SHCT counters.
+
+#define HAWKEYE_RRPV_MAX 7 // 3-bit RRPV used by Hawkeye.
+#define HAWKEYE_PRED_BITS 11 // log2 of the PC predictor table size.
+#define HAWKEYE_PRED_MAX 7 // 3-bit saturating predictor counters.
+#define HAWKEYE_SAMPLED_SETS 64 // Number of sets that train OPTgen.
+#define HAWKEYE_HISTORY 8 // OPTgen history length, in multiples of the associativity.
+
+#define DBP_BITS 12 // log2 of the dead-block predictor table size.
+#define DBP_MAX 3 // 2-bit saturating dead-block counters.
+#define DBP_THRESHOLD 2 // Counter value at which a block is predicted dead.
+#define DBP_SAMPLE_FILLS 32 // One in this many predicted-dead fills is kept for training.
+
+// A previously seen block in a Hawkeye sampled set.
+typedef struct hawkeye_entry {
+    address_t tag; // Tag of the sampled block.
+    unsigned long long last_time; // OPTgen quantum of the previous access.
+    unsigned short signature; // PC signature of the previous access.
+    char is_valid; // Whether this history slot is in use.
+} hawkeye_entry_t;
+
+// A group of accesses confined to a subset of the ways, as with CAT class-of-service masks.
+typedef struct partition {
+    int by_thread; // Whether the partition matches a thread ID rather than an address range.
+    int thread_id; // Thread ID matched when by_thread is set.
+    address_t range_start; // First address of the matched region.
+    address_t range_end; // One past the last address of the matched region.
+    address_t way_mask; // Ways this partition may allocate into.
+    int hits; // Hits by accesses of this partition.
+    int misses; // Misses by accesses of this partition.
+    address_t* umon_tags; // UCP shadow tags per sampled set, most recently used first.
+    unsigned long long* umon_hits; // UCP shadow hits per LRU stack position.
+    unsigned long long umon_accesses; // Accesses seen by the UCP shadow tags.
+} partition_t;
+
+// An address range pinned into the cache, as with cache-as-RAM or pseudo-locking.
+typedef struct lock_range {
+    address_t start; // First address of the locked region.
+    address_t end; // One past the last address of the region.
+    address_t way_mask; // Ways its lines may be locked into.
+} lock_range_t;
+
+// How a remapping rule moves the addresses of its region.
+typedef enum {
+    REMAP_PAD, // Shift every address by amount bytes.
+    REMAP_PITCH, // Rows of amount bytes become rows of pitch bytes.
+    REMAP_COLOR // Page i of the region lands on the i-th page of color amount out of pitch colors.
+} remap_kind_t;
+
+// A what-if change of data layout, applied to trace addresses before they reach the cache.
+typedef struct remap_rule {
+    address_t start; // First address of the remapped region.
+    address_t end; // One past the last address of the region.
+    remap_kind_t kind; // What the rule does to the region.
+    long long amount; // Padding, old row pitch, or page color.
+    long long pitch; // New row pitch, or number of page colors.
+} remap_rule_t;
+
+// OPTgen state for one sampled set.
+typedef struct optgen {
+    unsigned char* occupancy; // Lines OPT would hold per quantum (circular).
+    hawkeye_entry_t* history; // Recently accessed blocks of this set.
+    unsigned long long timer; // Accesses seen by this set.
+} optgen_t;
+
+// A miss status holding register: one line being fetched.
+typedef struct mshr {
+    address_t line; // Address of the line in flight.
+    unsigned long long ready; // Cycle its data arrives, or MSHR_PENDING until DRAM has scheduled it.
+    char in_use; // Whether the register holds a miss.
+} mshr_t;
+
+// A divisor prepared for division by multiplication: n / d is the high half of n * magic, with
+// a fix-up when add is set, shifted right by shift (the libdivide round-up method).
+typedef struct fastdiv {
+    unsigned long long divisor; // The divisor d, or 0 if unused.
+    unsigned long long magic; // Multiplier, about 2^(64 + shift) / d.
+    int shift; // Right shift after the multiplication.
+    int add; // Whether magic overflowed 64 bits and the numerator must be added back.
+} fastdiv_t;
+
+// Counters of one LLC slice.
+typedef struct slice_stats {
+    unsigned long long accesses; // Lookups that hashed to the slice.
+    unsigned long long misses; // Of those, misses.
+    unsigned long long latency; // Summed core-to-slice cycles of the lookups.
+} slice_stats_t;
+
+typedef cache_entry_t* set_ptr; // Defines a pointer to a set of cache lines.
+typedef set_ptr* cache_mem; // Defines a pointer to the entire cache.
+
+// Everything one simulated cache needs: its configuration, contents, policy state and counters.
+// Each context is independent, so several caches can be simulated side by side.
+typedef struct cache_ctx {
+    // Configuration.
+    int set_bits; // The number of bits used for the set index.
+    int block_bits; // The number of bits used to identify the block offset.
+    int lines_per_set; // The associativity, i.e., number of lines per set.
+    policy_t replacement_policy; // Policy selected with -r.
+    int dead_block_bypass; // Flag to enable dead-block prediction and bypass.
+    int admission_mode; // Flag to enable the TinyLFU admission filter (-a).
+    int ucp_mode; // Flag to suggest a utility-based allocation of the ways.
+    partition_t partitions[MAX_PARTITIONS]; // The last partition catches every access no rule matched.
+    int num_partitions; // Partitions given with -P.
+    address_t stream_ranges[MAX_STREAM_RANGES][2]; // Start and end of every -T range.
+    int num_stream_ranges; // Ranges given with -T.
+    remap_rule_t remaps[MAX_REMAPS]; // Layout changes given with -A; the first matching rule wins.
+    int num_remaps; // Rules given with -A.
+    lock_range_t locks[MAX_LOCKS]; // Ranges given with -L, loaded and locked before the trace runs.
+    int num_locks; // Ranges given with -L.
+    unsigned long long cache_bytes; // Capacity given with -C instead of -s, or 0.
+    int hashed_index; // Flag to hash block numbers before picking their set (-H).
+
+    // Derived configuration values.
+    int num_sets; // Total number of sets in the cache, computed from set_bits or cache_bytes.
+    int block_size; // Block size, computed from block_bits.
+    address_t set_mask; // Mask for extracting the set index from an address.
+    fastdiv_t set_divider; // Reduces block numbers modulo a set count that is not a power of two.
+    int full_tags; // Whether tags hold the whole block number rather than the bits above the index.
+    int slice_sets; // Sets per LLC slice when the cache is sliced, else 0.
+
+    // Performance counters.
+    int misses; // Total cache misses.
+    int hits; // Total cache hits.
+    int evictions; // Total lines evicted.
+    int evicted_dirty_bytes; // Number of dirty bytes evicted.
+    int active_dirty_bytes; // Number of dirty bytes currently in the cache.
+    int repeated_accesses; // Number of sequential accesses to the same address.
+    unsigned long long cycle_counter; // Global counter for LRU policy.
+    address_t* last_memory_access; // Tracks the most recent access per set.
+    address_t last_accessed_address;
+
+    cache_mem main_cache; // The primary cache data structure.
+
+    // Replacement engine state.
+    address_t current_pc; // Address of the most recent instruction fetch.
+    int current_thread; // Thread ID of the current trace record.
+    address_t trace_tag; // Bits ORed into the current record's address when mixing traces, or 0.
+    int bypasses; // Misses that were not allocated because the block was predicted dead.
+    unsigned char* ship_shct; // SHiP signature history counter table.
+    unsigned char* hawkeye_predictor; // Hawkeye PC-indexed cache-friendliness counters.
+    optgen_t* hawkeye_optgen; // Per sampled set OPTgen state, or NULL for unsampled sets.
+    int hawkeye_sample_stride; // Every this many sets one is sampled.
+    int opt_hits; // Accesses on which OPTgen found that OPT would hit.
+    int opt_misses; // Accesses on which OPTgen found that OPT would miss.
+    unsigned char* dbp_table; // Dead-block predictor counters.
+    unsigned int dbp_fills; // Predicted-dead fills seen, for training samples.
+    unsigned int bimodal_fills; // Fills seen by bimodal insertion, for the throttle.
+
+    // Set-dueling state for DIP and DRRIP.
+    int duel_constituency; // Each constituency of this many sets holds one leader per candidate.
+    unsigned int psel; // Grows on misses in the first candidate's leaders.
+    unsigned long long duel_accesses; // Accesses seen, for epoch sampling.
+    int duel_epochs_won[2]; // Epochs in which each candidate was used by followers.
+
+    // TinyLFU admission: a missed block only displaces a victim that is less popular.
+    tinylfu_t* admission_filter; // Frequency sketch shared by every set.
+    int admission_rejects; // Misses that were not allocated because the victim was more popular.
+
+    // Streaming (non-temporal) stores: 'N' records and stores inside a -T range skip the cache.
+    unsigned long long nt_stores; // Streaming stores seen.
+    unsigned long long nt_invalidated; // Cached copies the streaming stores invalidated.
+    unsigned long long nt_fills_avoided; // Missed lines a normal store would have allocated.
+    unsigned long long nt_evictions_avoided; // Of those, fills that would have evicted a valid line.
+
+    // Way prediction (-p): the predicted way is probed first, the others only if it misses.
+    way_predictor_t way_predictor; // Predictor selected with -p.
+    int way_predict_bits; // log2 of the PC and XOR table sizes.
+    unsigned short* way_predict_table; // Predicted way per set (MRU) or per hashed PC, or NULL.
+    unsigned long long wp_correct; // Hits in the predicted way.
+    unsigned long long wp_wrong; // Hits in another way, which needed a second probe.
+    unsigned long long wp_ways_read; // Tag and data ways read by every lookup.
+
+    // Sliced LLC (-l): the sets are split evenly over slices picked by an address hash.
+    int llc_enabled; // Flag set by -l.
+    llc_config_t llc_config; // Slice count, hash and core-to-slice latencies.
+    slice_stats_t* slice_stats; // Per-slice counters, or NULL.
+
+    // Line locking (-L): locked ways never become victims.
+    address_t* locked_ways; // Per set, a mask of the ways holding locked lines, or NULL.
+    int locked_lines; // Lines locked into the cache.
+    unsigned long long lock_hits; // Hits on locked lines.
+    unsigned long long lock_bypasses; // Misses that found every way they may use locked.
+
+    // Timing extension: misses and writebacks go to a DRAM model on a core clock.
+    int dram_enabled; // Flag set by -D.
+    dram_config_t dram_config; // DRAM organization, policies and timings.
+    dram_t* dram; // Memory behind the cache, or NULL.
+    unsigned long long core_cycle; // Cycle at which the current access issues.
+
+    // Write buffer between the cache and memory (-B): dirty lines wait here to be written.
+    int wb_entries; // Capacity in lines; 0 disables the buffer.
+    int wb_drain_cycles; // Cycles to retire one entry.
+    address_t* wb_lines; // Buffered line addresses, a ring with the oldest at wb_head.
+    int wb_head; // Ring position of the oldest entry.
+    int wb_count; // Entries in the buffer.
+    unsigned long long wb_drain_free; // Cycle at which the oldest entry can retire.
+    unsigned long long wb_inserts; // Lines written into the buffer.
+    unsigned long long wb_coalesced; // Writes merged into an entry for the same line.
+    unsigned long long wb_forwards; // Misses served from the buffer instead of memory.
+    unsigned long long wb_full_stalls; // Writes that found the buffer full.
+    unsigned long long wb_stall_cycles; // Cycles the core waited for a free entry.
+
+    // Miss status holding registers (-M): how many misses are in flight at once.
+    int mshr_entries; // Registers; 0 leaves misses unlimited and untracked.
+    int mshr_latency; // Miss latency when no DRAM model is attached.
+    mshr_t* mshrs; // The registers.
+    int mshr_used; // Registers holding a miss.
+    unsigned long long mshr_last_event; // Time up to which occupancy has been accounted.
+    unsigned long long mshr_primary; // Misses that took a register.
+    unsigned long long mshr_merged; // Accesses to a line already in flight.
+    unsigned long long mshr_full_stalls; // Misses that found every register busy.
+    unsigned long long mshr_stall_cycles; // Cycles the core waited for a free register.
+    unsigned long long mshr_busy_cycles; // Cycles with at least one miss in flight.
+    unsigned long long mshr_miss_cycles; // Sum over cycles of the misses in flight.
+
+    // NUMA placement (-N): which node each page of memory traffic is homed on.
+    int numa_enabled; // Flag set by -N.
+    numa_config_t numa_config; // Nodes, placement policy, latencies and regions.
+    numa_t* numa; // Page placement and per-region counts, or NULL.
+} cache_ctx_t;
+
+// Global variables for configuring the run.
+int output_details = 0; // Flag to enable detailed output.
+char* access_trace = NULL; // File path for the memory access trace.
+trace_stream_t trace_streams[MAX_TRACES]; // Every trace given with -t.
+int num_traces = 0; // Number of traces given with -t.
+schedule_t mix_schedule = SCHEDULE_ROUND_ROBIN; // How several traces are interleaved.
+double trace_weights[MAX_TRACES]; // Per-trace weights for weighted scheduling.
+int num_weights = 0; // Number of weights given with -w.
+trace_record_t* trace_records = NULL; // A whole trace loaded into memory, shared read-only by worker threads.
+unsigned long long num_records = 0; // Records in trace_records.
+unsigned long long record_first = 0; // First data record simulated from each trace, from -n.
+unsigned long long record_limit = 0; // Records simulated from each trace, from -n; 0 runs to the end.
+int build_index = 0; // Flag set by -X to write a sparse index of the trace and exit.
+
+// Object-cache mode: records are (key, size) requests against a byte-capacity cache.
+int object_mode = 0; // Flag set by -o.
+ocache_policy_t object_policy = OC_LRU; // Object cache replacement policy.
+unsigned long long object_capacity = 0; // Object cache capacity in bytes, from -c.
+
+#define OBJECT_SIZE_HINT 512 // Typical object size used to size the object-mode admission sketch.
+
+// Miss-ratio curve mode: SHARDS sampling with a fixed number of tracked blocks.
+unsigned int mrc_samples = 0; // Blocks tracked by SHARDS, from -R; 0 disables the mode.
+
+#define MRC_MAX_POINTS 512 // Upper bound on the points of a printed curve.
+
+// Time-partitioned mode: contiguous slices of the trace are simulated in parallel.
+int slice_count = 0; // Slices or sweep workers given with -j, 0 if not given; 0 and 1 simulate sequentially.
+unsigned long long slice_warmup = 0; // Records replayed before each slice, from -W; 0 picks a default.
+
+// Sweep mode: a grid of cache geometries simulated by a pool of workers over one loaded trace.
+#define SWEEP_MAX_AXIS 64 // Values per axis of a -S grid.
+#define SWEEP_BATCH 4 // Configurations a worker advances through the trace together.
+#define SWEEP_CHUNK_RECORDS 16384 // Records a batch simulates before moving on; about an L2's worth.
+#define SWEEP_BASE_COST 8 // Per-access cost of a configuration besides its tag scan, in ways.
+
+// One configuration of a sweep.
+typedef struct sweep_job {
+    cache_ctx_t ctx; // Configuration, then the finished counters.
+    double cost; // Estimated simulation cost, for longest-first scheduling.
+} sweep_job_t;
+
+char* sweep_spec = NULL; // Grid given with -S, as <sets>/<ways>/<blocks>.
+sweep_job_t* sweep_jobs = NULL; // Every configuration of the grid, in grid order.
+int* sweep_order = NULL; // Job indices, most expensive first.
+int sweep_num_jobs = 0; // Configurations in the grid.
+int sweep_next = 0; // Position in sweep_order of the next job to hand out.
+int sweep_workers = 0; // Worker threads of the sweep.
+pthread_mutex_t sweep_lock = PTHREAD_MUTEX_INITIALIZER; // Guards sweep_next.
+int remap_sweep_rule = -1; // The -A rule whose padding is swept, or -1.
+int remap_pads[SWEEP_MAX_AXIS]; // Padding values of the swept rule.
+int num_remap_pads = 0; // Values in remap_pads.
+
+// Analytic mode: a loop nest whose accesses are counted without a trace.
+char* nest_path = NULL; // Nest file given with -e.
+
+// Prepares division by d, which must be at least 1.
+void fastdivInit(fastdiv_t* div, unsigned long long d) {
+    int log2d = 63 - __builtin_clzll(d);
+    div->divisor = d;
+    div->add = 0;
+    if ((d & (d - 1)) == 0) {
+        div->magic = 0; // A power of two only needs the shift.
+        div->shift = log2d;
+        return;
+    }
+    // magic = ceil(2^(64 + log2d) / d) fits in 64 bits unless the rounding error is too large; then
+    // one more bit of precision is kept by adding the numerator back after the multiplication.
+    unsigned __int128 power = (unsigned __int128)1 << (64 + log2d);
+    unsigned long long quotient = (unsigned long long)(power / d);
+    unsigned long long remainder = (unsigned long long)(power % d);
+    if (d - remainder < (1ULL << log2d)) {
+        div->magic = quotient + 1;
+        div->shift = log2d;
+    } else {
+        unsigned long long twice = remainder + remainder;
+        quotient += quotient;
+        if (twice >= d || twice < remainder) {
+            quotient++;
+        }
+        div->magic = quotient + 1;
+        div->shift = log2d;
+        div->add = 1;
+    }
+}
+
+// Returns n / d with one multiplication.
+unsigned long long fastDivide(const fastdiv_t* div, unsigned long long n) {
+    if (div->magic == 0) {
+        return n >> div->shift;
+    }
+    unsigned long long q = (unsigned long long)(((unsigned __int128)n * div->magic) >> 64);
+    if (div->add) {
+        return (((n - q) >> 1) + q) >> div->shift;
+    }
+    return q >> div->shift;
+}
+
+// Returns n % d with two multiplications.
+unsigned long long fastMod(const fastdiv_t* div, unsigned long long n) {
+    return n - fastDivide(div, n) * div->divisor;
+}
+
+// Spreads a block number over all its bits, so consecutive or strided blocks land on unrelated sets.
+address_t hashBlock(address_t block) {
+    address_t h = block * 0x9E3779B97F4A7C15ULL;
+    return h ^ (h >> 29);
+}
+
+// Returns the set a block number maps to; a sliced cache numbers the sets of each slice in turn.
+address_t setIndex(cache_ctx_t* ctx, address_t block) {
+    address_t hashed = ctx->hashed_index ? hashBlock(block) : block;
+    address_t index = ctx->set_divider.divisor ? fastMod(&ctx->set_divider, hashed) : hashed & ctx->set_mask;
+    if (ctx->slice_sets > 0) {
+        index += (address_t)llcSlice(&ctx->llc_config, block << ctx->block_bits) * ctx->slice_sets;
+    }
+    return index;
+}
+
+// Returns the tag stored for a block number.
+address_t blockTag(cache_ctx_t* ctx, address_t block) {
+    return ctx->full_tags ? block : block >> ctx->set_bits;
+}
+
+// Rebuilds the block number of a line from its tag and set.
+address_t tagBlock(cache_ctx_t* ctx, address_t tag, address_t index) {
+    return ctx->full_tags ? tag : (tag << ctx->set_bits) | index;
+}
+
+// Loads the lines of every -L range and locks each into the lowest free way its mask allows.
+void lockRanges(cache_ctx_t* ctx) {
+    ctx->locked_ways = (address_t*)calloc(ctx->num_sets, sizeof(address_t));
+    for (int l = 0; l < ctx->num_locks; l++) {
+        const lock_range_t* lock = &ctx->locks[l];
+        for (address_t line = lock->start >> ctx->block_bits; line <= (lock->end - 1) >> ctx->block_bits; line++) {
+            address_t index = setIndex(ctx, line);
+            address_t tag_val = blockTag(ctx, line);
+            set_ptr current_set = ctx->main_cache[index];
+            int way = -1;
+            for (int i = 0; i < ctx->lines_per_set; i++) {
+                if (current_set[i].is_valid && current_set[i].entry_tag == tag_val) {
+                    way = -2; // Already locked by an overlapping range.
+                    break;
+                }
+                if (way == -1 && i < 64 && !current_set[i].is_valid && (lock->way_mask >> i & 1)) {
+                    way = i;
+                }
+            }
+            if (way == -2) {
+                continue;
+            }
+            if (way < 0) {
+                fprintf(stderr, "Locked range %d does not fit: set %llu has no free way left in mask 0x%llx\n", l,
+                        index, lock->way_mask);
+                exit(1);
+            }
+            current_set[way].is_valid = 1;
+            current_set[way].entry_tag = tag_val;
+            current_set[way].usage_counter = ctx->cycle_counter++;
+            ctx->locked_ways[index] |= 1ULL << way;
+            ctx->locked_lines++;
+        }
+    }
+}
+
+// Initialize cache based on the configuration fields of ctx; every counter and predictor starts fresh.
+void initializeCache(cache_ctx_t* ctx) {
+    // Compute the number of sets and block size based on provided bits.
+    ctx->block_size = (int)pow(2, ctx->block_bits);
+    if (ctx->cache_bytes > 0) {
+        // -C gives the capacity; a power-of-two set count still indexes with bits.
+        ctx->num_sets = (int)(ctx->cache_bytes / ctx->block_size / ctx->lines_per_set);
+        ctx->set_bits = 63 - __builtin_clzll(ctx->num_sets);
+    } else {
+        ctx->num_sets = (int)pow(2, ctx->set_bits);
+    }
+    // A sliced cache indexes within the slice the address hashes to.
+    int index_sets = ctx->num_sets;
+    ctx->slice_sets = 0;
+    if (ctx->llc_enabled) {
+        if (ctx->num_sets % ctx->llc_config.slices != 0) {
+            fprintf(stderr, "%d sets do not split evenly into %d slices\n", ctx->num_sets, ctx->llc_config.slices);
+            exit(1);
+        }
+        index_sets = ctx->slice_sets = ctx->num_sets / ctx->llc_config.slices;
+    }
+    memset(&ctx->set_divider, 0, sizeof(ctx->set_divider));
+    if ((index_sets & (index_sets - 1)) != 0) {
+        fastdivInit(&ctx->set_divider, index_sets);
+    }
+    ctx->full_tags = ctx->set_divider.divisor != 0 || ctx->hashed_index || ctx->slice_sets > 0;
+
+    ctx->misses = ctx->hits = ctx->evictions = 0;
+    ctx->evicted_dirty_bytes = ctx->active_dirty_bytes = ctx->repeated_accesses = 0;
+    ctx->cycle_counter = 1;
+    ctx->last_accessed_address = ULLONG_MAX;
+    ctx->current_pc = 0;
+    ctx->current_thread = 0;
+    ctx->trace_tag = 0;
+    ctx->bypasses = ctx->opt_hits = ctx->opt_misses = ctx->admission_rejects = 0;
+    ctx->nt_stores = ctx->nt_invalidated = ctx->nt_fills_avoided = ctx->nt_evictions_avoided = 0;
+    ctx->locked_ways = NULL;
+    ctx->locked_lines = 0;
+    ctx->way_predict_table = NULL;
+    ctx->slice_stats = NULL;
+    ctx->wp_correct = ctx->wp_wrong = ctx->wp_ways_read = 0;
+    ctx->lock_hits = ctx->lock_bypasses = 0;
+    ctx->ship_shct = ctx->hawkeye_predictor = ctx->dbp_table = NULL;
+    ctx->hawkeye_optgen = NULL;
+    ctx->hawkeye_sample_stride = 1;
+    ctx->dbp_fills = ctx->bimodal_fills = 0;
+    ctx->duel_constituency = 1;
+    ctx->psel = (PSEL_MAX + 1) / 2;
+    ctx->duel_accesses = 0;
+    ctx->duel_epochs_won[0] = ctx->duel_epochs_won[1] = 0;
+    ctx->admission_filter = NULL;
+    ctx->dram = NULL;
+    ctx->core_cycle = 0;
+    ctx->wb_lines = NULL;
+    ctx->wb_head = ctx->wb_count = 0;
+    ctx->wb_drain_free = 0;
+    ctx->wb_inserts = ctx->wb_coalesced = ctx->wb_forwards = ctx->wb_full_stalls = ctx->wb_stall_cycles = 0;
+    ctx->mshrs = NULL;
+    ctx->numa = NULL;
+    ctx->mshr_used = 0;
+    ctx->mshr_last_event = 0;
+    ctx->mshr_primary = ctx->mshr_merged = ctx->mshr_full_stalls = ctx->mshr_stall_cycles = 0;
+    ctx->mshr_busy_cycles = ctx->mshr_miss_cycles = 0;
+    for (int p = 0; p < MAX_PARTITIONS; p++) {
+        ctx->partitions[p].hits = ctx->partitions[p].misses = 0;
+        ctx->partitions[p].umon_tags = NULL;
+        ctx->partitions[p].umon_hits = NULL;
+        ctx->partitions[p].umon_accesses = 0;
+    }
+
+    ctx->main_cache = (set_ptr*)malloc(sizeof(set_ptr) * ctx->num_sets);
+    ctx->last_memory_access = (address_t*)malloc(sizeof(address_t) * ctx->num_sets);
+    for (int i = 0; i < ctx->num_sets; i++) {
+        ctx->main_cache[i] = (cache_entry_t*)malloc(sizeof(cache_entry_t) * ctx->lines_per_set);
+        ctx->last_memory_access[i] = ULLONG_MAX; // Initialize to max to signify no access yet.
+        for (int j = 0; j < ctx->lines_per_set; j++) {
+            ctx->main_cache[i][j].is_valid = 0;
+            ctx->main_cache[i][j].entry_tag = 0;
+            ctx->main_cache[i][j].usage_counter = 0;
+            ctx->main_cache[i][j].is_dirty = 0;
+            ctx->main_cache[i][j].access_time = 0; // Not used, consider removing for clarity.
+            ctx->main_cache[i][j].rrpv = 0;
+            ctx->main_cache[i][j].outcome = 0;
+            ctx->main_cache[i][j].signature = 0;
+            ctx->main_cache[i][j].dead_signature = 0;
+        }
+    }
+    ctx->set_mask = (address_t)(index_sets - 1); // Precompute the set mask for later use.
+
+    if (ctx->replacement_policy == POLICY_DIP || ctx->replacement_policy == POLICY_DRRIP) {
+        ctx->duel_constituency = ctx->num_sets / DUEL_LEADER_SETS;
+        if (ctx->duel_constituency < 2) {
+            ctx->duel_constituency = 2; // Small caches still need one leader of each kind.
+        }
+    }
+    if (ctx->replacement_policy == POLICY_SHIP) {
+        ctx->ship_shct = (unsigned char*)calloc(1 << SHIP_SHCT_BITS, 1);
+        // Start every signature at weakly-reused so new code is not inserted at distant RRPV.
+        memset(ctx->ship_shct, 1, 1 << SHIP_SHCT_BITS);
+    }
+    if (ctx->replacement_policy == POLICY_HAWKEYE) {
+        ctx->hawkeye_predictor = (unsigned char*)malloc(1 << HAWKEYE_PRED_BITS);
+        // Start every PC as weakly cache-friendly.
+        memset(ctx->hawkeye_predictor, (HAWKEYE_PRED_MAX + 1) / 2, 1 << HAWKEYE_PRED_BITS);
+        ctx->hawkeye_optgen = (optgen_t*)calloc(ctx->num_sets, sizeof(optgen_t));
+        if (ctx->num_sets > HAWKEYE_SAMPLED_SETS) {
+            ctx->hawkeye_sample_stride = ctx->num_sets / HAWKEYE_SAMPLED_SETS;
+        }
+        int history_len = HAWKEYE_HISTORY * ctx->lines_per_set;
+        for (int i = 0; i < ctx->num_sets; i += ctx->hawkeye_sample_stride) {
+            ctx->hawkeye_optgen[i].occupancy = (unsigned char*)calloc(history_len, 1);
+            ctx->hawkeye_optgen[i].history = (hawkeye_entry_t*)calloc(history_len, sizeof(hawkeye_entry_t));
+        }
+    }
+    if (ctx->dead_block_bypass) {
+        ctx->dbp_table = (unsigned char*)calloc(1 << DBP_BITS, 1);
+    }
+    if (ctx->admission_mode) {
+        ctx->admission_filter = tinylfuCreate((unsigned long long)ctx->num_sets * ctx->lines_per_set);
+    }
+    if (ctx->dram_enabled) {
+        ctx->dram = dramCreate(&ctx->dram_config, ctx->block_size);
+    }
+    if (ctx->wb_entries > 0) {
+        ctx->wb_lines = (address_t*)malloc(sizeof(address_t) * ctx->wb_entries);
+    }
+    if (ctx->mshr_entries > 0) {
+        ctx->mshrs = (mshr_t*)calloc(ctx->mshr_entries, sizeof(mshr_t));
+    }
+    if (ctx->numa_enabled) {
+        ctx->numa = numaCreate(&ctx->numa_config);
+    }
+    if (ctx->num_partitions > 0) {
+        ctx->partitions[ctx->num_partitions].way_mask = ALL_WAYS; // The default partition.
+    }
+    if (ctx->num_locks > 0) {
+        lockRanges(ctx);
+    }
+    if (ctx->llc_enabled) {
+        ctx->slice_stats = (slice_stats_t*)calloc(ctx->llc_config.slices, sizeof(slice_stats_t));
+    }
+    if (ctx->way_predictor == WAY_PREDICT_MRU) {
+        ctx->way_predict_table = (unsigned short*)calloc(ctx->num_sets, sizeof(unsigned short));
+    } else if (ctx->way_predictor != WAY_PREDICT_NONE) {
+        ctx->way_predict_table = (unsigned short*)calloc(1 << ctx->way_predict_bits, sizeof(unsigned short));
+    }
+    if (ctx->ucp_mode) {
+        int sampled_sets = (ctx->num_sets + UMON_SAMPLE_STRIDE - 1) / UMON_SAMPLE_STRIDE;
+        for (int p = 0; p <= ctx->num_partitions; p++) {
+            ctx->partitions[p].umon_tags = (address_t*)malloc(sizeof(address_t) * sampled_sets * ctx->lines_per_set);
+            memset(ctx->partitions[p].umon_tags, 0xff, sizeof(address_t) * sampled_sets * ctx->lines_per_set);
+            ctx->partitions[p].umon_hits = (unsigned long long*)calloc(ctx->lines_per_set, sizeof(unsigned long long));
+        }
+    }
+}
+
+// Deallocate all allocated memory for the cache, avoiding memory leaks.
+void clearCache(cache_ctx_t* ctx) {
+    for (int i = 0; i < ctx->num_sets; i++) {
+        free(ctx->main_cache[i]); // Free each set individually.
+    }
+    free(ctx->main_cache); // Free the array of pointers to sets.
+    free(ctx->last_memory_access); // Free the last access tracking array.
+
+    free(ctx->ship_shct);
+    free(ctx->hawkeye_predictor);
+    if (ctx->hawkeye_optgen) {
+        for (int i = 0; i < ctx->num_sets; i += ctx->hawkeye_sample_stride) {
+            free(ctx->hawkeye_optgen[i].occupancy);
+            free(ctx->hawkeye_optgen[i].history);
+        }
+        free(ctx->hawkeye_optgen);
+    }
+    free(ctx->dbp_table);
+    if (ctx->admission_filter) {
+        tinylfuDestroy(ctx->admission_filter);
+    }
+    if (ctx->dram) {
+        dramDestroy(ctx->dram);
+    }
+    free(ctx->wb_lines);
+    free(ctx->mshrs);
+    free(ctx->locked_ways);
+    free(ctx->way_predict_table);
+    free(ctx->slice_stats);
+    if (ctx->numa) {
+        numaDestroy(ctx->numa);
+    }
+    for (int p = 0; p <= ctx->num_partitions && ctx->ucp_mode; p++) {
+        free(ctx->partitions[p].umon_tags);
+        free(ctx->partitions[p].umon_hits);
+    }
+}
+
+// Folds a PC into a table index of the given width.
+unsigned short pcSignature(address_t pc, int bits) {
+    address_t folded = pc ^ (pc >> bits) ^ (pc >> (2 * bits));
+    return (unsigned short)(folded & ((1u << bits) - 1));
+}
+
+// Moves a saturating counter up or down by one.
+void trainCounter(unsigned char* counter, int up, unsigned char max) {
+    if (up && *counter < max) {
+        (*counter)++;
+    } else if (!up && *counter > 0) {
+        (*counter)--;
+    }
+}
+
+// Replays an access on OPTgen for a sampled set and trains the Hawkeye predictor.
+void hawkeyeObserve(cache_ctx_t* ctx, address_t index, address_t tag_val) {
+    if (index % ctx->hawkeye_sample_stride != 0) {
+        return;
+    }
+    optgen_t* gen = &ctx->hawkeye_optgen[index];
+    unsigned long long history_len = HAWKEYE_HISTORY * ctx->lines_per_set;
+    unsigned long long now = gen->timer++;
+    int slot = -1, oldest = 0;
+
+    gen->occupancy[now % history_len] = 0; // A new quantum starts empty.
+
+    for (int i = 0; i < (int)history_len; i++) {
+        if (gen->history[i].is_valid && gen->history[i].tag == tag_val) {
+            slot = i;
+            break;
+        }
+        if (!gen->history[i].is_valid || gen->history[i].last_time < gen->history[oldest].last_time) {
+            oldest = i;
+        }
+    }
+
+    if (slot >= 0) {
+        hawkeye_entry_t* entry = &gen->history[slot];
+        int opt_hit = now - entry->last_time < history_len;
+        // OPT keeps the line only if the set has room for it over its whole usage interval.
+        for (unsigned long long t = entry->last_time; opt_hit && t < now; t++) {
+            if (gen->occupancy[t % history_len] >= ctx->lines_per_set) {
+                opt_hit = 0;
+            }
+        }
+        if (opt_hit) {
+            for (unsigned long long t = entry->last_time; t < now; t++) {
+                gen->occupancy[t % history_len]++;
+            }
+            ctx->opt_hits++;
+        } else {
+            ctx->opt_misses++;
+        }
+        trainCounter(&ctx->hawkeye_predictor[entry->signature], opt_hit, HAWKEYE_PRED_MAX);
+    } else {
+        slot = oldest;
+        gen->history[slot].is_valid = 1;
+        gen->history[slot].tag = tag_val;
+    }
+    gen->history[slot].last_time = now;
+    gen->history[slot].signature = pcSignature(ctx->current_pc, HAWKEYE_PRED_BITS);
+}
+
+// Returns whether the policy tracks recency with RRPVs rather than LRU counters.
+int isRripPolicy(policy_t policy) {
+    return policy == POLICY_SHIP || policy == POLICY_HAWKEYE || policy == POLICY_SRRIP ||
+           policy == POLICY_BRRIP || policy == POLICY_DRRIP;
+}
+
+// Returns 0 or 1 for the leader sets of the first or second dueling candidate, -1 for followers.
+int leaderSet(cache_ctx_t* ctx, address_t index) {
+    int offset = index % ctx->duel_constituency;
+    if (offset == 0) {
+        return 0;
+    }
+    if (offset == ctx->duel_constituency - 1) {
+        return 1;
+    }
+    return -1;
+}
+
+// Returns the first (0) or second (1) candidate of the selected dueling policy.
+policy_t duelCandidate(cache_ctx_t* ctx, int which) {
+    if (ctx->replacement_policy == POLICY_DIP) {
+        return which ? POLICY_BIP : POLICY_LRU;
+    }
+    return which ? POLICY_BRRIP : POLICY_SRRIP;
+}
+
+// Resolves a dueling policy into the candidate a set currently follows.
+policy_t effectivePolicy(cache_ctx_t* ctx, address_t index) {
+    if (ctx->replacement_policy != POLICY_DIP && ctx->replacement_policy != POLICY_DRRIP) {
+        return ctx->replacement_policy;
+    }
+    int leader = leaderSet(ctx, index);
+    return duelCandidate(ctx, leader >= 0 ? leader : ctx->psel > PSEL_MAX / 2);
+}
+
+// Charges a miss in a leader set against its candidate.
+void duelOnMiss(cache_ctx_t* ctx, address_t index) {
+    int leader = leaderSet(ctx, index);
+    if (leader == 0 && ctx->psel < PSEL_MAX) {
+        ctx->psel++;
+    } else if (leader == 1 && ctx->psel > 0) {
+        ctx->psel--;
+    }
+}
+
+// Samples which candidate the followers use once per epoch.
+void duelTick(cache_ctx_t* ctx) {
+    if (++ctx->duel_accesses % DUEL_EPOCH != 0) {
+        return;
+    }
+    int winner = ctx->psel > PSEL_MAX / 2;
+    ctx->duel_epochs_won[winner]++;
+    if (output_details) {
+        printf("epoch:%llu winner:%s psel:%u\n", ctx->duel_accesses / DUEL_EPOCH,
+               policy_names[duelCandidate(ctx, winner)], ctx->psel);
+    }
+}
+
+// Returns whether the dead-block predictor expects a block touched at this PC to see no reuse.
+int predictDead(cache_ctx_t* ctx, unsigned short dead_signature) {
+    return ctx->dbp_table[dead_signature] >= DBP_THRESHOLD;
+}
+
+// Parses a -P rule of the form t<thread>=<mask> or <start>-<end>=<mask>.
+int parsePartition(cache_ctx_t* ctx, char* spec) {
+    partition_t* part = &ctx->partitions[ctx->num_partitions];
+    char* end;
+    memset(part, 0, sizeof(*part));
+    if (ctx->num_partitions >= MAX_PARTITIONS - 1) {
+        return 0;
+    }
+    if (spec[0] == 't') {
+        part->by_thread = 1;
+        part->thread_id = (int)strtol(spec + 1, &end, 0);
+    } else {
+        part->range_start = strtoull(spec, &end, 0);
+        if (*end != '-') {
+            return 0;
+        }
+        part->range_end = strtoull(end + 1, &end, 0);
+    }
+    if (*end != '=') {
+        return 0;
+    }
+    part->way_mask = strtoull(end + 1, &end, 0);
+    if (*end != '\0' || part->way_mask == 0) {
+        return 0;
+    }
+    ctx->num_partitions++;
+    return 1;
+}
+
+// Parses a -L range of the form <start>-<end>[=<mask>]; without a mask any way may be locked.
+int parseLock(cache_ctx_t* ctx, char* spec) {
+    lock_range_t* lock = &ctx->locks[ctx->num_locks];
+    char* end;
+    if (ctx->num_locks >= MAX_LOCKS) {
+        return 0;
+    }
+    lock->start = strtoull(spec, &end, 0);
+    if (*end != '-') {
+        return 0;
+    }
+    lock->end = strtoull(end + 1, &end, 0);
+    lock->way_mask = ALL_WAYS;
+    if (*end == '=') {
+        lock->way_mask = strtoull(end + 1, &end, 0);
+        if (lock->way_mask == 0) {
+            return 0;
+        }
+    }
+    if (*end != '\0' || lock->end <= lock->start) {
+        return 0;
+    }
+    ctx->num_locks++;
+    return 1;
+}
+
+// Parses a -T range of the form <start>-<end>.
+int parseStreamRange(cache_ctx_t* ctx, char* spec) {
+    char* end;
+    if (ctx->num_stream_ranges >= MAX_STREAM_RANGES) {
+        return 0;
+    }
+    address_t start = strtoull(spec, &end, 0);
+    if (*end != '-') {
+        return 0;
+    }
+    address_t stop = strtoull(end + 1, &end, 0);
+    if (*end != '\0' || stop <= start) {
+        return 0;
+    }
+    ctx->stream_ranges[ctx->num_stream_ranges][0] = start;
+    ctx->stream_ranges[ctx->num_stream_ranges][1] = stop;
+    ctx->num_stream_ranges++;
+    return 1;
+}
+
+// Drops the trace tag of a mixed run, so address ranges match every trace's own addresses.
+address_t untagAddress(address_t mem_addr) {
+    return num_traces > 1 ? mem_addr & TRACE_ADDRESS_MASK : mem_addr;
+}
+
+// Returns whether an untagged address lies in a -L range.
+int isLockedAddress(cache_ctx_t* ctx, address_t address) {
+    for (int l = 0; l < ctx->num_locks; l++) {
+        if (address >= ctx->locks[l].start && address < ctx->locks[l].end) {
+            return 1;
+        }
+    }
+    return 0;
+}
+
+// Returns whether a store to mem_addr is hinted to stream past the cache.
+int isStreamingStore(cache_ctx_t* ctx, address_t mem_addr) {
+    mem_addr = untagAddress(mem_addr);
+    for (int r = 0; r < ctx->num_stream_ranges; r++) {
+        if (mem_addr >= ctx->stream_ranges[r][0] && mem_addr < ctx->stream_ranges[r][1]) {
+            return 1;
+        }
+    }
+    return 0;
+}
+
+// Applies the first -A rule whose region holds address; other addresses are unchanged.
+address_t remapAddress(cache_ctx_t* ctx, address_t address) {
+    for (int r = 0; r < ctx->num_remaps; r++) {
+        const remap_rule_t* rule = &ctx->remaps[r];
+        if (address < rule->start || address >= rule->end) {
+            continue;
+        }
+        address_t offset = address - rule->start;
+        switch (rule->kind) {
+        case REMAP_PAD:
+            return address + rule->amount;
+        case REMAP_PITCH:
+            return rule->start + offset / rule->amount * rule->pitch + offset % rule->amount;
+        case REMAP_COLOR: {
+            // Consecutive pages of the region are spread pitch pages apart, all with the same color.
+            address_t base = rule->start / REMAP_PAGE_BYTES / rule->pitch * rule->pitch;
+            address_t page = base + offset / REMAP_PAGE_BYTES * rule->pitch + rule->amount;
+            return page * REMAP_PAGE_BYTES + address % REMAP_PAGE_BYTES;
+        }
+        }
+    }
+    return address;
+}
+
+// Finds the partition an access belongs to; the first matching rule wins.
+partition_t* partitionOf(cache_ctx_t* ctx, address_t mem_addr) {
+    mem_addr = untagAddress(mem_addr);
+    for (int p = 0; p < ctx->num_partitions; p++) {
+        if (ctx->partitions[p].by_thread ? ctx->partitions[p].thread_id == ctx->current_thread
+                                    : mem_addr >= ctx->partitions[p].range_start && mem_addr < ctx->partitions[p].range_end) {
+            return &ctx->partitions[p];
+        }
+    }
+    return &ctx->partitions[ctx->num_partitions];
+}
+
+// Returns whether a way may be chosen as a victim under a partition mask.
+int wayAllowed(address_t way_mask, int way) {
+    return way < 64 ? (way_mask >> way) & 1 : way_mask == ALL_WAYS;
+}
+
+// Records an access in a partition's shadow LRU stack to learn its hits for every way count.
+void umonObserve(cache_ctx_t* ctx, partition_t* part, address_t index, address_t tag_val) {
+    if (index % UMON_SAMPLE_STRIDE != 0) {
+        return;
+    }
+    address_t* stack = &part->umon_tags[(index / UMON_SAMPLE_STRIDE) * ctx->lines_per_set];
+    int depth = ctx->lines_per_set - 1;
+    part->umon_accesses++;
+    for (int i = 0; i < ctx->lines_per_set; i++) {
+        if (stack[i] == tag_val) {
+            part->umon_hits[i]++; // Would hit with i + 1 or more ways.
+            depth = i;
+            break;
+        }
+    }
+    memmove(&stack[1], &stack[0], sizeof(address_t) * depth);
+    stack[0] = tag_val;
+}
+
+// Shadow hits a partition would get with the given number of ways.
+unsigned long long umonHits(partition_t* part, int ways) {
+    unsigned long long total = 0;
+    for (int i = 0; i < ways; i++) {
+        total += part->umon_hits[i];
+    }
+    return total;
+}
+
+// Splits the ways between the partitions with UCP's lookahead algorithm and prints the masks.
+void reportUcpAllocation(cache_ctx_t* ctx) {
+    int parts = ctx->num_partitions + 1;
+    int alloc[MAX_PARTITIONS];
+    int balance = ctx->lines_per_set - parts;
+    int next_way = 0;
+
+    if (balance < 0 || ctx->lines_per_set > 64) {
+        printf("ucp: cannot split %d ways between %d partitions\n", ctx->lines_per_set, parts);
+        return;
+    }
+    for (int p = 0; p < parts; p++) {
+        alloc[p] = 1; // Every class of service needs at least one way.
+    }
+    while (balance > 0) {
+        double best_utility = -1;
+        int best_part = 0, best_ways = 1;
+        // Give the next ways to the partition with the highest marginal utility per way.
+        for (int p = 0; p < parts; p++) {
+            unsigned long long base = umonHits(&ctx->partitions[p], alloc[p]);
+            for (int k = 1; k <= balance; k++) {
+                double utility = (double)(umonHits(&ctx->partitions[p], alloc[p] + k) - base) / k;
+                if (utility > best_utility) {
+                    best_utility = utility;
+                    best_part = p;
+                    best_ways = k;
+                }
+            }
+        }
+        if (best_utility <= 0) {
+            // Nobody gains from more ways; leave the spare ways with the busiest partition.
+            for (int p = 0; p < parts; p++) {
+                if (ctx->partitions[p].umon_accesses > ctx->partitions[best_part].umon_accesses) {
+                    best_part = p;
+                }
+            }
+            best_ways = balance;
+        }
+        alloc[best_part] += best_ways;
+        balance -= best_ways;
+    }
+    for (int p = 0; p < parts; p++) {
+        address_t mask = (alloc[p] == 64 ? ALL_WAYS : ((1ULL << alloc[p]) - 1)) << next_way;
+        unsigned long long shadow_misses = ctx->partitions[p].umon_accesses - umonHits(&ctx->partitions[p], alloc[p]);
+        printf("ucp_partition:%d ways:%d mask:0x%llx sampled_misses:%llu\n", p, alloc[p], mask,
+               shadow_misses);
+        next_way += alloc[p];
+    }
+}
+
+// Updates replacement state for a line that was just hit.
+void policyOnHit(cache_ctx_t* ctx, cache_entry_t* line) {
+    switch (ctx->replacement_policy) {
+    case POLICY_SRRIP:
+    case POLICY_BRRIP:
+    case POLICY_DRRIP:
+        line->rrpv = 0;
+        break;
+    case POLICY_SHIP:
+        line->rrpv = 0;
+        if (!line->outcome) {
+            line->outcome = 1;
+            trainCounter(&ctx->ship_shct[line->signature], 1, SHIP_SHCT_MAX);
+        }
+        break;
+    case POLICY_HAWKEYE:
+        line->signature = pcSignature(ctx->current_pc, HAWKEYE_PRED_BITS);
+        line->rrpv = ctx->hawkeye_predictor[line->signature] > HAWKEYE_PRED_MAX / 2 ? 0 : HAWKEYE_RRPV_MAX;
+        break;
+    default:
+        break;
+    }
+    if (ctx->dead_block_bypass) {
+        // The previous touch was not the last one, so its PC did not kill the block.
+        trainCounter(&ctx->dbp_table[line->dead_signature], 0, DBP_MAX);
+        line->dead_signature = pcSignature(ctx->current_pc, DBP_BITS);
+    }
+}
+
+// Chooses the line to replace among the ways in way_mask; invalid lines are always preferred.
+// Leaves the policy state alone, so the fill can still be rejected; see policyOnVictim.
+unsigned int selectVictim(cache_ctx_t* ctx, set_ptr current_set, address_t way_mask) {
+    unsigned long long eviction_metric = ULONG_MAX;
+    int evict_line = -1;
+
+    if (ctx->replacement_policy != POLICY_LRU || ctx->dead_block_bypass || way_mask != ALL_WAYS) {
+        // Only plain LRU keeps its original scan, which settles on the last invalid line.
+        for (int i = 0; i < ctx->lines_per_set; ++i) {
+            if (!current_set[i].is_valid && wayAllowed(way_mask, i)) {
+                return i;
+            }
+        }
+    }
+
+    if (ctx->dead_block_bypass) {
+        for (int i = 0; i < ctx->lines_per_set; ++i) {
+            if (predictDead(ctx, current_set[i].dead_signature) && wayAllowed(way_mask, i)) {
+                return i;
+            }
+        }
+    }
+
+    if (isRripPolicy(ctx->replacement_policy)) {
+        // Evict the line predicted to be re-referenced furthest in the future.
+        for (int i = 0; i < ctx->lines_per_set; ++i) {
+            if (wayAllowed(way_mask, i) && (evict_line < 0 || current_set[i].rrpv > current_set[evict_line].rrpv)) {
+                evict_line = i;
+            }
+        }
+    } else {
+        // Find the LRU line or an empty line to use for this new entry.
+        for (int i = 0; i < ctx->lines_per_set; ++i) {
+            if (!wayAllowed(way_mask, i)) {
+                continue; // Another partition owns this way.
+            }
+            if (!current_set[i].is_valid || current_set[i].usage_counter < eviction_metric) {
+                evict_line = i; // Candidate line for eviction.
+                eviction_metric = current_set[i].usage_counter; // Update metric for LRU.
+            }
+        }
+    }
+    return evict_line;
+}
+
+// Commits an RRIP victim chosen by selectVictim once its replacement is certain: the allowed ways
+// age until the victim reaches the maximum RRPV. Invalid and predicted-dead victims skip the aging.
+void policyOnVictim(cache_ctx_t* ctx, set_ptr current_set, address_t way_mask, unsigned int evict_line) {
+    cache_entry_t* victim = &current_set[evict_line];
+    if (!isRripPolicy(ctx->replacement_policy) || !victim->is_valid ||
+        (ctx->dead_block_bypass && predictDead(ctx, victim->dead_signature))) {
+        return;
+    }
+    unsigned char max_rrpv = ctx->replacement_policy == POLICY_HAWKEYE ? HAWKEYE_RRPV_MAX : RRIP_RRPV_MAX;
+    unsigned char age = max_rrpv - victim->rrpv;
+    if (age > 0) {
+        for (int i = 0; i < ctx->lines_per_set; ++i) {
+            if (wayAllowed(way_mask, i)) {
+                current_set[i].rrpv += age;
+            }
+        }
+        if (ctx->replacement_policy == POLICY_HAWKEYE) {
+            // Evicting a line the predictor considered friendly means it was wrong.
+            trainCounter(&ctx->hawkeye_predictor[victim->signature], 0, HAWKEYE_PRED_MAX);
+        }
+    }
+}
+
+// Updates predictor state for a valid line that is about to be replaced.
+void policyOnEvict(cache_ctx_t* ctx, cache_entry_t* line) {
+    if (ctx->replacement_policy == POLICY_SHIP && !line->outcome) {
+        trainCounter(&ctx->ship_shct[line->signature], 0, SHIP_SHCT_MAX);
+    }
+    if (ctx->dead_block_bypass) {
+        trainCounter(&ctx->dbp_table[line->dead_signature], 1, DBP_MAX);
+    }
+}
+
+// Initializes replacement state for a newly placed line.
+void policyOnFill(cache_ctx_t* ctx, address_t index, set_ptr current_set, unsigned int fill_line) {
+    cache_entry_t* line = &current_set[fill_line];
+    line->outcome = 0;
+    switch (effectivePolicy(ctx, index)) {
+    case POLICY_BIP:
+        if (++ctx->bimodal_fills % BIMODAL_THROTTLE != 0) {
+            // Insert just below the current LRU line so it is the next victim.
+            unsigned long long lru_counter = line->usage_counter;
+            for (int i = 0; i < ctx->lines_per_set; ++i) {
+                if (current_set[i].is_valid && current_set[i].usage_counter < lru_counter) {
+                    lru_counter = current_set[i].usage_counter;
+                }
+            }
+            line->usage_counter = lru_counter > 0 ? lru_counter - 1 : 0;
+        }
+        break;
+    case POLICY_SRRIP:
+        line->rrpv = RRIP_RRPV_MAX - 1;
+        break;
+    case POLICY_BRRIP:
+        line->rrpv = ++ctx->bimodal_fills % BIMODAL_THROTTLE != 0 ? RRIP_RRPV_MAX : RRIP_RRPV_MAX - 1;
+        break;
+    case POLICY_SHIP:
+        line->signature = pcSignature(ctx->current_pc, SHIP_SHCT_BITS);
+        line->rrpv = ctx->ship_shct[line->signature] == 0 ? RRIP_RRPV_MAX : RRIP_RRPV_MAX - 1;
+        break;
+    case POLICY_HAWKEYE:
+        line->signature = pcSignature(ctx->current_pc, HAWKEYE_PRED_BITS);
+        if (ctx->hawkeye_predictor[line->signature] > HAWKEYE_PRED_MAX / 2) {
+            // Age the other friendly lines so stale friendly lines eventually leave.
+            for (int i = 0; i < ctx->lines_per_set; ++i) {
+                if (i != (int)fill_line && current_set[i].rrpv < HAWKEYE_RRPV_MAX - 1) {
+                    current_set[i].rrpv++;
+                }
+            }
+            line->rrpv = 0;
+        } else {
+            line->rrpv = HAWKEYE_RRPV_MAX;
+        }
+        break;
+    default:
+        break;
+    }
+    line->dead_signature = pcSignature(ctx->current_pc, DBP_BITS);
+}
+
+// Decides whether a missing block should skip allocation because it is predicted dead on arrival.
+int shouldBypass(cache_ctx_t* ctx) {
+    if (!ctx->dead_block_bypass || !predictDead(ctx, pcSignature(ctx->current_pc, DBP_BITS))) {
+        return 0;
+    }
+    // Keep a sample of predicted-dead fills so the predictor can unlearn stale decisions.
+    return ++ctx->dbp_fills % DBP_SAMPLE_FILLS != 0;
+}
+
+void processMemoryLoad(cache_ctx_t* ctx, address_t mem_addr) {
+    if (ctx->last_accessed_address == mem_addr) {
+        ctx->repeated_accesses++; // Increment if this is a repeated access.
+    }
+    ctx->last_accessed_address = mem_addr;
+}
+// Asks the admission filter whether a missed block may displace the chosen victim.
+int admitFill(cache_ctx_t* ctx, address_t mem_addr, address_t index, cache_entry_t* victim) {
+    if (!ctx->admission_mode || !victim->is_valid) {
+        return 1;
+    }
+    address_t victim_block = tagBlock(ctx, victim->entry_tag, index);
+    return tinylfuAdmit(ctx->admission_filter, mem_addr >> ctx->block_bits, victim_block);
+}
+
+// Sends a line fill or writeback to the DRAM model; the core stalls while the controller queue is full.
+// The completion cycle is stored in completion, unless it is NULL, once the controller issues it.
+void memoryRequest(cache_ctx_t* ctx, address_t mem_addr, int is_write, unsigned long long* completion) {
+    ctx->core_cycle = dramAccess(ctx->dram, mem_addr, is_write, ctx->core_cycle, completion);
+}
+
+// Sends the oldest write buffer entry to memory.
+void wbRetire(cache_ctx_t* ctx) {
+    address_t line = ctx->wb_lines[ctx->wb_head];
+    ctx->wb_head = (ctx->wb_head + 1) % ctx->wb_entries;
+    ctx->wb_count--;
+    ctx->wb_drain_free += ctx->wb_drain_cycles;
+    if (ctx->numa) {
+        numaAccess(ctx->numa, line, ctx->current_thread);
+    }
+    if (ctx->dram) {
+        // The buffer, not the core, waits when the controller queue is full.
+        unsigned long long accepted = dramAccess(ctx->dram, line, 1, ctx->core_cycle, NULL);
+        if (accepted + 1 > ctx->wb_drain_free) {
+            ctx->wb_drain_free = accepted + 1;
+        }
+    }
+}
+
+// Retires every write buffer entry whose turn came before the current cycle.
+void wbAdvance(cache_ctx_t* ctx) {
+    while (ctx->wb_count > 0 && ctx->wb_drain_free <= ctx->core_cycle) {
+        wbRetire(ctx);
+    }
+}
+
+// Finds the buffer entry holding line, or returns -1.
+int wbFind(cache_ctx_t* ctx, address_t line) {
+    for (int i = 0; i < ctx->wb_count; i++) {
+        int slot = (ctx->wb_head + i) % ctx->wb_entries;
+        if (ctx->wb_lines[slot] == line) {
+            return slot;
+        }
+    }
+    return -1;
+}
+
+// Puts a dirty line in the write buffer, merging it with a pending write of the same line. A full
+// buffer stalls the core until its oldest entry retires.
+void wbInsert(cache_ctx_t* ctx, address_t line) {
+    ctx->wb_inserts++;
+    if (wbFind(ctx, line) >= 0) {
+        ctx->wb_coalesced++;
+        return;
+    }
+    // A DRAM queue or MSHR stall may have moved the core past entries that are due by now.
+    wbAdvance(ctx);
+    if (ctx->wb_count == 0 && ctx->wb_drain_free < ctx->core_cycle + ctx->wb_drain_cycles) {
+        ctx->wb_drain_free = ctx->core_cycle + ctx->wb_drain_cycles; // An idle buffer starts draining now.
+    }
+    if (ctx->wb_count == ctx->wb_entries) {
+        ctx->wb_full_stalls++;
+        if (ctx->wb_drain_free > ctx->core_cycle) {
+            ctx->wb_stall_cycles += ctx->wb_drain_free - ctx->core_cycle;
+            ctx->core_cycle = ctx->wb_drain_free;
+        }
+        wbRetire(ctx);
+    }
+    ctx->wb_lines[(ctx->wb_head + ctx->wb_count++) % ctx->wb_entries] = line;
+}
+
+// Accounts MSHR occupancy from the last event up to cycle t; events must come in time order.
+void mshrAccount(cache_ctx_t* ctx, unsigned long long t) {
+    if (t > ctx->mshr_last_event) {
+        if (ctx->mshr_used > 0) {
+            ctx->mshr_busy_cycles += t - ctx->mshr_last_event;
+            ctx->mshr_miss_cycles += (t - ctx->mshr_last_event) * ctx->mshr_used;
+        }
+        ctx->mshr_last_event = t;
+    }
+}
+
+// Returns the in-use register whose data arrives first, among those whose arrival is known.
+mshr_t* mshrEarliest(cache_ctx_t* ctx) {
+    mshr_t* earliest = NULL;
+    for (int i = 0; i < ctx->mshr_entries; i++) {
+        mshr_t* m = &ctx->mshrs[i];
+        if (m->in_use && m->ready != MSHR_PENDING && (!earliest || m->ready < earliest->ready)) {
+            earliest = m;
+        }
+    }
+    return earliest;
+}
+
+// Frees, in completion order, every register whose data has arrived by cycle limit.
+void mshrRetire(cache_ctx_t* ctx, unsigned long long limit) {
+    mshr_t* m;
+    while (ctx->mshr_used > 0 && (m = mshrEarliest(ctx)) != NULL && m->ready <= limit) {
+        mshrAccount(ctx, m->ready);
+        m->in_use = 0;
+        ctx->mshr_used--;
+    }
+}
+
+// Whether line is already being fetched.
+int mshrFind(cache_ctx_t* ctx, address_t line) {
+    for (int i = 0; i < ctx->mshr_entries; i++) {
+        if (ctx->mshrs[i].in_use && ctx->mshrs[i].line == line) {
+            return 1;
+        }
+    }
+    return 0;
+}
+
+// Takes a register for a new miss, stalling the core until one frees up if all are busy.
+mshr_t* mshrAllocate(cache_ctx_t* ctx, address_t line) {
+    mshr_t* m;
+    if (ctx->mshr_used == ctx->mshr_entries) {
+        ctx->mshr_full_stalls++;
+        // Fills that DRAM has not scheduled yet get their times as the controller catches up.
+        while ((m = mshrEarliest(ctx)) == NULL && ctx->dram && dramStep(ctx->dram)) {
+        }
+        if (m->ready > ctx->core_cycle) {
+            ctx->mshr_stall_cycles += m->ready - ctx->core_cycle;
+            ctx->core_cycle = m->ready;
+        }
+        mshrRetire(ctx, ctx->core_cycle);
+    }
+    mshrAccount(ctx, ctx->core_cycle);
+    for (m = ctx->mshrs; m->in_use; m++) {
+    }
+    m->line = line;
+    m->ready = MSHR_PENDING;
+    m->in_use = 1;
+    ctx->mshr_used++;
+    ctx->mshr_primary++;
+    return m;
+}
+
+// Fetches a missing line from memory, through an MSHR when they are modeled. Without DRAM, the
+// fill takes the NUMA latency of the line's home node, or the fixed MSHR latency.
+void fetchLine(cache_ctx_t* ctx, address_t line) {
+    unsigned long long* completion = NULL;
+    int latency = ctx->mshr_latency;
+    if (ctx->numa) {
+        latency = numaAccess(ctx->numa, line, ctx->current_thread);
+    }
+    if (ctx->mshr_entries > 0) {
+        completion = &mshrAllocate(ctx, line)->ready;
+    }
+    if (ctx->dram) {
+        memoryRequest(ctx, line, 0, completion);
+    } else if (completion) {
+        *completion = ctx->core_cycle + latency;
+    }
+}
+
+// Moves the core clock to the next trace access and retires what memory finished before it.
+void advanceCore(cache_ctx_t* ctx) {
+    if (ctx->dram || ctx->wb_entries > 0 || ctx->mshr_entries > 0) {
+        ctx->core_cycle += ctx->dram_config.issue_cycles;
+        if (ctx->wb_count > 0) {
+            wbAdvance(ctx);
+        }
+        if (ctx->mshr_used > 0) {
+            if (ctx->dram) {
+                dramAdvance(ctx->dram, ctx->core_cycle); // Settle the fills that start before now.
+            }
+            mshrRetire(ctx, ctx->core_cycle);
+        }
+    }
+}
+
+// Sends a dirty line to memory, through the write buffer when there is one.
+void writeLine(cache_ctx_t* ctx, address_t line) {
+    if (ctx->wb_entries > 0) {
+        wbInsert(ctx, line);
+        return;
+    }
+    if (ctx->numa) {
+        numaAccess(ctx->numa, line, ctx->current_thread);
+    }
+    if (ctx->dram) {
+        memoryRequest(ctx, line, 1, NULL);
+    }
+}
+
+// Processes a non-temporal store: the line is not allocated, any cached copy is invalidated, and
+// the data goes to memory through the write buffer, which combines stores to the same line.
+// Streaming stores count as neither hits nor misses.
+void processStreamingStore(cache_ctx_t* ctx, address_t mem_addr) {
+    address_t index = setIndex(ctx, mem_addr >> ctx->block_bits);
+    address_t tag_val = blockTag(ctx, mem_addr >> ctx->block_bits);
+    address_t line = mem_addr >> ctx->block_bits << ctx->block_bits;
+    set_ptr current_set = ctx->main_cache[index];
+    int cached = 0, full = 1;
+
+    advanceCore(ctx);
+    ctx->nt_stores++;
+    for (int i = 0; i < ctx->lines_per_set; ++i) {
+        if (!current_set[i].is_valid) {
+            full = 0;
+        } else if (current_set[i].entry_tag == tag_val) {
+            cached = 1;
+            if (ctx->locked_ways && (ctx->locked_ways[index] >> i & 1)) {
+                continue; // Locked lines stay; the store writes through them.
+            }
+            // A plain invalidation: the line was overwritten rather than evicted, so SHiP, Hawkeye and
+            // the dead-block predictor learn nothing from it.
+            ctx->nt_invalidated++;
+            if (current_set[i].is_dirty) {
+                ctx->active_dirty_bytes -= ctx->block_size; // Its data leaves with the streaming store.
+            }
+            current_set[i].is_valid = 0;
+            current_set[i].is_dirty = 0;
+        }
+    }
+    if (!cached && !(ctx->wb_count > 0 && wbFind(ctx, line) >= 0)) {
+        ctx->nt_fills_avoided++;
+        ctx->nt_evictions_avoided += full;
+    }
+    writeLine(ctx, line);
+
+    if (ctx->last_accessed_address == mem_addr) {
+        ctx->repeated_accesses++;
+    }
+    ctx->last_accessed_address = mem_addr;
+}
+
+// Returns the way predictor entry an access reads and trains.
+unsigned short* wayPredictSlot(cache_ctx_t* ctx, address_t index, address_t mem_addr) {
+    switch (ctx->way_predictor) {
+    case WAY_PREDICT_PC:
+        return &ctx->way_predict_table[pcSignature(ctx->current_pc, ctx->way_predict_bits)];
+    case WAY_PREDICT_XOR:
+        return &ctx->way_predict_table[pcSignature(ctx->current_pc ^ (mem_addr >> ctx->block_bits),
+                                                   ctx->way_predict_bits)];
+    default:
+        return &ctx->way_predict_table[index];
+    }
+}
+
+// Scores the prediction of a lookup that found its line in way, or missed if way is -1, and
+// charges a wrong prediction's second probe to the core clock.
+void wayPredictOutcome(cache_ctx_t* ctx, unsigned short* slot, int way) {
+    if (way >= 0 && *slot == way) {
+        ctx->wp_correct++;
+        ctx->wp_ways_read++;
+        return;
+    }
+    ctx->wp_ways_read += ctx->lines_per_set; // The predicted way, then all the others.
+    if (way >= 0) {
+        ctx->wp_wrong++;
+        if (ctx->dram || ctx->wb_entries > 0 || ctx->mshr_entries > 0) {
+            ctx->core_cycle += WAY_PREDICT_MISS_CYCLES;
+        }
+    }
+}
+
+// Processes a memory access, updating the cache state accordingly.
+void processMemoryAccess(cache_ctx_t* ctx, address_t mem_addr, int ignore_repeat) {
+    int found = 0; // Flag to mark a hit.
+    unsigned int evict_line = 0;
+    address_t index = setIndex(ctx, mem_addr >> ctx->block_bits);
+    address_t tag_val = blockTag(ctx, mem_addr >> ctx->block_bits);
+    partition_t* part = ctx->num_partitions > 0 ? partitionOf(ctx, mem_addr) : NULL;
+
+    set_ptr current_set = ctx->main_cache[index]; // Get the relevant set.
+    unsigned short* predicted_way = ctx->way_predict_table ? wayPredictSlot(ctx, index, mem_addr) : NULL;
+    slice_stats_t* slice = NULL;
+
+    if (ctx->slice_stats) {
+        int slice_id = (int)(index / ctx->slice_sets);
+        slice = &ctx->slice_stats[slice_id];
+        slice->accesses++;
+        slice->latency += llcLatency(&ctx->llc_config, ctx->current_thread, slice_id);
+    }
+
+    if (ctx->ucp_mode) {
+        umonObserve(ctx, part, index, tag_val);
+    }
+    if (ctx->admission_mode) {
+        tinylfuRecord(ctx->admission_filter, mem_addr >> ctx->block_bits);
+    }
+
+    if (ctx->replacement_policy == POLICY_HAWKEYE) {
+        hawkeyeObserve(ctx, index, tag_val); // Train on what OPT would have done.
+    }
+    address_t line = mem_addr >> ctx->block_bits << ctx->block_bits;
+    advanceCore(ctx);
+
+    // Search for a hit or an empty line.
+    for (int i = 0; i < ctx->lines_per_set; ++i) {
+        if (current_set[i].is_valid && current_set[i].entry_tag == tag_val) {
+            ctx->hits++; // A hit!
+            if (part) {
+                part->hits++; // Partitions hit in any way, they only allocate in their own.
+            }
+            current_set[i].usage_counter = ctx->cycle_counter++; // Update LRU.
+            policyOnHit(ctx, &current_set[i]);
+            if (ctx->locked_ways && (ctx->locked_ways[index] >> i & 1)) {
+                ctx->lock_hits++;
+            }
+            if (predicted_way) {
+                wayPredictOutcome(ctx, predicted_way, i);
+                *predicted_way = i;
+            }
+            // A hit under the miss that is still bringing the line in. The store half of an M record
+            // (ignore_repeat) hits the line its own load just missed on, which is not a second request.
+            if (ctx->mshr_used > 0 && !ignore_repeat && mshrFind(ctx, line)) {
+                ctx->mshr_merged++;
+            }
+            if (!current_set[i].is_dirty) {
+                current_set[i].is_dirty = 1; // Mark as dirty if this is a write.
+                ctx->active_dirty_bytes += ctx->block_size;
+            }
+            found = 1; // Mark we've found our target.
+            break; // Stop searching.
+        }
+    }
+
+    // Handle a miss.
+    if (!found) {
+        ctx->misses++; // Increment miss count.
+        if (part) {
+            part->misses++;
+        }
+        if (predicted_way) {
+            wayPredictOutcome(ctx, predicted_way, -1);
+        }
+        if (slice) {
+            slice->misses++;
+        }
+        duelOnMiss(ctx, index);
+        if (ctx->wb_count > 0 && wbFind(ctx, line) >= 0) {
+            ctx->wb_forwards++; // The newest data is still waiting in the write buffer.
+        } else if (ctx->mshr_used > 0 && mshrFind(ctx, line)) {
+            // A secondary miss rides on the fetch already in flight, unless that fetch is its own load's.
+            ctx->mshr_merged += !ignore_repeat;
+        } else if (ctx->dram || ctx->mshr_entries > 0 || ctx->numa) {
+            fetchLine(ctx, line); // Bypassed and rejected blocks are still fetched.
+        }
+        address_t way_mask = part ? part->way_mask : ALL_WAYS;
+        if (ctx->locked_ways && ctx->locked_ways[index]) {
+            // Locked ways are never victims; locking needs E <= 64, so every way has a mask bit.
+            way_mask &= ~ctx->locked_ways[index] & (ctx->lines_per_set < 64 ? (1ULL << ctx->lines_per_set) - 1 : ALL_WAYS);
+        }
+        if (way_mask == 0) {
+            ctx->lock_bypasses++; // Every way this access may use is locked.
+        } else if (shouldBypass(ctx)) {
+            ctx->bypasses++; // The block goes straight to the requester without a fill.
+        } else {
+            evict_line = selectVictim(ctx, current_set, way_mask);
+            if (!admitFill(ctx, mem_addr, index, &current_set[evict_line])) {
+                ctx->admission_rejects++; // The victim is more popular, so it stays.
+            } else {
+                policyOnVictim(ctx, current_set, way_mask, evict_line);
+                // Evict if necessary.
+                if (current_set[evict_line].is_valid) {
+                    ctx->evictions++; // Increment evictions.
+                    policyOnEvict(ctx, &current_set[evict_line]);
+                    if (current_set[evict_line].is_dirty) {
+                        ctx->evicted_dirty_bytes += ctx->block_size; // Track evicted dirty data.
+                        ctx->active_dirty_bytes -= ctx->block_size; // Update active dirty byte count.
+                        address_t victim_line = tagBlock(ctx, current_set[evict_line].entry_tag, index)
+                                                << ctx->block_bits;
+                        writeLine(ctx, victim_line);
+                    }
+                }
+
+                // Place the new entry.
+                current_set[evict_line].is_valid = 1;
+                current_set[evict_line].entry_tag = tag_val;
+                current_set[evict_line].usage_counter = ctx->cycle_counter++; // Update LRU.
+                current_set[evict_line].is_dirty = 0; // New entry is not dirty.
+                policyOnFill(ctx, index, current_set, evict_line);
+                if (predicted_way) {
+                    *predicted_way = evict_line; // The next access to the block finds it here.
+                }
+            }
+        }
+    }
+
+    if (ctx->replacement_policy == POLICY_DIP || ctx->replacement_policy == POLICY_DRRIP) {
+        duelTick(ctx);
+    }
+
+    if (ctx->last_accessed_address == mem_addr && ignore_repeat == 0) {
+        ctx->repeated_accesses++; // Increment if this is a repeated access.
+    }
+    ctx->last_accessed_address = mem_addr;
+
+
+}
+
+// Opens a trace file for streaming.
+void openTrace(trace_stream_t* stream, char* trace_path) {
+    memset(stream, 0, sizeof(*stream));
+    stream->path = trace_path;
+    stream->file = fopen(trace_path, "r");
+    if (!stream->file) {
+        fprintf(stderr, "Error opening trace file: %s\n", trace_path);
+        exit(1);
+    }
+}
+
+// Reads the next data access of a trace; instruction fetches only update the stream's PC.
+int readRecord(trace_stream_t* stream, trace_record_t* record) {
+    char line[256];
+    int thread;
+
+    // An optional third field after the size carries a thread ID.
+    while (fgets(line, sizeof(line), stream->file) != NULL) {
+        int fields = sscanf(line, " %c %llx,%d,%d", &record->operation, &record->address, &record->size, &thread);
+        if (fields < 3) {
+            continue; // Skip tool banners and other non-record lines.
+        }
+        if (record->operation == 'I') {
+            stream->pc = record->address; // The PC of the following data accesses.
+            continue;
+        }
+        record->address |= stream->tag;
+        record->thread = fields == 4 ? thread : 0;
+        record->pc = stream->pc;
+        return 1;
+    }
+    return 0;
+}
+
+// Positions a freshly opened stream before data record first. A sparse index written by -X lets
+// this skip fewer than TRACE_INDEX_STRIDE records; without one, or if it is stale, every record
+// before first is read.
+void seekRecord(trace_stream_t* stream, unsigned long long first) {
+    char index_path[PATH_MAX];
+    char magic[8];
+    unsigned long long header[3], entry[2];
+    struct stat info;
+    trace_record_t record;
+    FILE* index;
+
+    snprintf(index_path, sizeof(index_path), "%s%s", stream->path, TRACE_INDEX_SUFFIX);
+    index = fopen(index_path, "rb");
+    if (index) {
+        unsigned long long slot;
+        // The header holds the indexed file size, the stride and the number of entries.
+        if (fread(magic, 1, 8, index) == 8 && memcmp(magic, TRACE_INDEX_MAGIC, 8) == 0 &&
+            fread(header, sizeof(header), 1, index) == 1 && fstat(fileno(stream->file), &info) == 0 &&
+            header[0] == (unsigned long long)info.st_size && header[1] > 0 && header[2] > 0) {
+            slot = first / header[1] < header[2] ? first / header[1] : header[2] - 1;
+            if (fseeko(index, (off_t)(8 + sizeof(header) + slot * sizeof(entry)), SEEK_SET) == 0 &&
+                fread(entry, sizeof(entry), 1, index) == 1 && fseeko(stream->file, (off_t)entry[0], SEEK_SET) == 0) {
+                stream->pc = entry[1];
+                first -= slot * header[1];
+            }
+        } else {
+            fprintf(stderr, "Ignoring stale trace index: %s\n", index_path);
+        }
+        fclose(index);
+    }
+    while (first > 0 && readRecord(stream, &record)) {
+        first--;
+    }
+}
+
+// Simulates one data access record.
+void simulateRecord(cache_ctx_t* ctx, trace_record_t* record) {
+    address_t address = ctx->num_remaps > 0 ? remapAddress(ctx, record->address) : record->address;
+    // Tag the address with its trace only now, after the remap; locked lines are shared by every trace.
+    if (ctx->trace_tag != 0 && !isLockedAddress(ctx, address)) {
+        address |= ctx->trace_tag;
+    }
+    ctx->current_pc = record->pc;
+    switch (record->operation) {
+    case 'L': // Load operation
+        processMemoryLoad(ctx, address);
+    case 'S': // Store operation
+        if (ctx->num_stream_ranges > 0 && record->operation == 'S' && isStreamingStore(ctx, address)) {
+            processStreamingStore(ctx, address);
+            break;
+        }
+        processMemoryAccess(ctx, address, 0); // Process the memory access.
+        break;
+    case 'N': // Non-temporal store, written around the cache.
+        processStreamingStore(ctx, address);
+        break;
+    case 'M': // Modify operation, processed as a load followed by a store.
+        processMemoryAccess(ctx, address, 0); // First access (load).
+        processMemoryAccess(ctx, address, 1); // Second access (store).
+        break;
+    default: // Ignore unrecognized operations.
+        break;
+    }
+}
+
+// Opens a trace positioned at the first record of the -n window.
+void openTraceWindow(trace_stream_t* stream, char* trace_path) {
+    openTrace(stream, trace_path);
+    if (record_first > 0) {
+        seekRecord(stream, record_first);
+    }
+}
+
+// Read and simulate memory access from the trace file.
+void analyzeTrace(cache_ctx_t* ctx, char* trace_path) {
+    trace_stream_t stream;
+    trace_record_t record;
+
+    unsigned long long simulated = 0;
+
+    openTraceWindow(&stream, trace_path);
+    while ((record_limit == 0 || simulated++ < record_limit) && readRecord(&stream, &record)) {
+        ctx->current_thread = record.thread;
+        simulateRecord(ctx, &record);
+    }
+    fclose(stream.file); // Close the trace file.
+}
+
+// One contiguous slice of the trace in a time-partitioned run.
+typedef struct time_slice {
+    cache_ctx_t ctx; // The slice's cache, warmed up and then run over the slice.
+    cache_ctx_t start; // Copy of the warmed cache taken just before the slice, for the fix-up.
+    unsigned long long first; // First record of the slice.
+    unsigned long long end; // One past the last record of the slice.
+    unsigned long long warmup_first; // First record of the overlapping warmup window.
+    pthread_t thread; // Worker simulating this slice.
+} time_slice_t;
+
+// A newline-aligned piece of a mapped trace, decoded by one parser thread.
+typedef struct parse_chunk {
+    const char* base; // Start of the mapped file, for record offsets.
+    const char* begin; // First byte of the chunk; always the start of a line.
+    const char* end; // One past the last byte; always just after a newline or the end of the file.
+    trace_record_t* records; // Decoded data accesses, in file order.
+    unsigned long long count; // Records decoded.
+    unsigned long long capacity; // Records allocated.
+    int with_offsets; // Whether to record line offsets for an index.
+    unsigned long long* offsets; // File offset of every record's line, when with_offsets is set.
+    unsigned long long leading; // Records before the chunk's first instruction fetch.
+    address_t last_pc; // Address of the chunk's last instruction fetch.
+    int saw_pc; // Whether the chunk contains an instruction fetch at all.
+    pthread_t thread; // Parser thread.
+} parse_chunk_t;
+
+// Decodes one trace line the way readRecord's " %c %llx,%d,%d" does. Returns 0 for lines that are
+// not records, 1 otherwise; instruction fetches are returned too, with operation 'I'.
+int parseRecordLine(const char* p, const char* end, trace_record_t* record) {
+    int negative;
+    while (p < end && (*p == ' ' || *p == '\t' || *p == '\r')) {
+        p++;
+    }
+    if (p == end) {
+        return 0;
+    }
+    record->operation = *p++;
+    while (p < end && (*p == ' ' || *p == '\t')) {
+        p++;
+    }
+    if (end - p > 2 && p[0] == '0' && (p[1] == 'x' || p[1] == 'X') && isxdigit((unsigned char)p[2])) {
+        p += 2;
+    }
+    if (p == end || !isxdigit((unsigned char)*p)) {
+        return 0;
+    }
+    record->address = 0;
+    for (; p < end && isxdigit((unsigned char)*p); p++) {
+        record->address = (record->address << 4) | (isdigit((unsigned char)*p) ? *p - '0' : (*p | 0x20) - 'a' + 10);
+    }
+    if (p == end || *p++ != ',') {
+        return 0;
+    }
+    while (p < end && (*p == ' ' || *p == '\t')) {
+        p++;
+    }
+    negative = p < end && *p == '-';
+    p += p < end && (*p == '-' || *p == '+');
+    if (p == end || !isdigit((unsigned char)*p)) {
+        return 0;
+    }
+    for (record->size = 0; p < end && isdigit((unsigned char)*p); p++) {
+        record->size = record->size * 10 + (*p - '0');
+    }
+    record->size = negative ? -record->size : record->size;
+    // The optional thread field keeps its default when it does not parse.
+    record->thread = 0;
+    if (p < end && *p == ',') {
+        const char* q = p + 1;
+        while (q < end && (*q == ' ' || *q == '\t')) {
+            q++;
+        }
+        negative = q < end && *q == '-';
+        q += q < end && (*q == '-' || *q == '+');
+        for (; q < end && isdigit((unsigned char)*q); q++) {
+            record->thread = record->thread * 10 + (*q - '0');
+        }
+        record->thread = negative ? -record->thread : record->thread;
+    }
+    return 1;
+}
+
+// Parser thread body: decodes every line of one chunk into the chunk's own record array.
+void* parseChunk(void* arg) {
+    parse_chunk_t* chunk = (parse_chunk_t*)arg;
+    trace_record_t record;
+    address_t pc = 0;
+    const char* line = chunk->begin;
+
+    chunk->capacity = 1024;
+    chunk->records = (trace_record_t*)malloc(sizeof(trace_record_t) * chunk->capacity);
+    if (chunk->with_offsets) {
+        chunk->offsets = (unsigned long long*)malloc(sizeof(unsigned long long) * chunk->capacity);
+    }
+    while (line < chunk->end) {
+        const char* next = memchr(line, '\n', chunk->end - line);
+        next = next ? next + 1 : chunk->end;
+        if (parseRecordLine(line, next, &record)) {
+            if (record.operation == 'I') {
+                pc = record.address;
+                chunk->last_pc = pc;
+                chunk->saw_pc = 1;
+            } else {
+                if (chunk->count == chunk->capacity) {
+                    chunk->capacity *= 2;
+                    chunk->records = (trace_record_t*)realloc(chunk->records, sizeof(trace_record_t) * chunk->capacity);
+                    if (chunk->offsets) {
+                        chunk->offsets = (unsigned long long*)realloc(chunk->offsets,
+                                                                      sizeof(unsigned long long) * chunk->capacity);
+                    }
+                }
+                record.pc = pc; // Fixed up after the join for records before the first fetch.
+                chunk->leading += !chunk->saw_pc;
+                if (chunk->offsets) {
+                    chunk->offsets[chunk->count] = line - chunk->base;
+                }
+                chunk->records[chunk->count++] = record;
+            }
+        }
+        line = next;
+    }
+    return NULL;
+}
+
+// Writes a sparse index next to the trace: the file offset and PC of every TRACE_INDEX_STRIDE-th
+// record, so a later run can start at any record after skipping fewer than a stride of lines.
+void writeTraceIndex(char* trace_path, unsigned long long file_size, trace_record_t* records,
+                     unsigned long long* offsets, unsigned long long count) {
+    char index_path[PATH_MAX];
+    unsigned long long header[3] = {file_size, TRACE_INDEX_STRIDE, (count + TRACE_INDEX_STRIDE - 1) / TRACE_INDEX_STRIDE};
+    FILE* out;
+
+    snprintf(index_path, sizeof(index_path), "%s%s", trace_path, TRACE_INDEX_SUFFIX);
+    out = fopen(index_path, "wb");
+    if (!out) {
+        fprintf(stderr, "Error creating trace index: %s\n", index_path);
+        exit(1);
+    }
+    fwrite(TRACE_INDEX_MAGIC, 1, 8, out);
+    fwrite(header, sizeof(header), 1, out);
+    for (unsigned long long r = 0; r < count; r += TRACE_INDEX_STRIDE) {
+        unsigned long long entry[2] = {offsets[r], records[r].pc};
+        fwrite(entry, sizeof(entry), 1, out);
+    }
+    fclose(out);
+}
+
+// Reads every data access of a trace into memory. The file is mapped and split at newlines into
+// one chunk per CPU, each decoded by its own thread; the chunks are then joined in file order.
+// With build_index, also writes the sparse record index.
+trace_record_t* loadTrace(char* trace_path, unsigned long long* count, int build_index) {
+    struct stat info;
+    int fd = open(trace_path, O_RDONLY);
+    int num_chunks;
+    const char* data;
+    parse_chunk_t* chunks;
+    trace_record_t* records;
+    unsigned long long* offsets = NULL;
+    address_t pc = 0;
+
+    if (fd < 0 || fstat(fd, &info) != 0) {
+        fprintf(stderr, "Error opening trace file: %s\n", trace_path);
+        exit(1);
+    }
+    data = info.st_size > 0 ? mmap(NULL, info.st_size, PROT_READ, MAP_PRIVATE, fd, 0) : "";
+    if (data == MAP_FAILED) {
+        fprintf(stderr, "Error mapping trace file: %s\n", trace_path);
+        exit(1);
+    }
+    num_chunks = (int)sysconf(_SC_NPROCESSORS_ONLN);
+    if ((long long)num_chunks > info.st_size / PARSE_MIN_CHUNK) {
+        num_chunks = (int)(info.st_size / PARSE_MIN_CHUNK);
+    }
+    if (num_chunks < 1) {
+        num_chunks = 1;
+    }
+
+    chunks = (parse_chunk_t*)calloc(num_chunks, sizeof(parse_chunk_t));
+    for (int k = 0; k < num_chunks; k++) {
+        chunks[k].base = data;
+        chunks[k].begin = k == 0 ? data : chunks[k - 1].end;
+        chunks[k].end = data + info.st_size * (k + 1) / num_chunks;
+        while (chunks[k].end < data + info.st_size && chunks[k].end[-1] != '\n') {
+            chunks[k].end++; // Move the split just past the next newline.
+        }
+        if (chunks[k].end < chunks[k].begin) {
+            chunks[k].end = chunks[k].begin; // A long line swallowed this whole chunk.
+        }
+        chunks[k].with_offsets = build_index;
+        if (pthread_create(&chunks[k].thread, NULL, parseChunk, &chunks[k]) != 0) {
+            fprintf(stderr, "Cannot start trace parser: %s\n", strerror(errno));
+            exit(1);
+        }
+    }
+
+    *count = 0;
+    for (int k = 0; k < num_chunks; k++) {
+        pthread_join(chunks[k].thread, NULL);
+        *count += chunks[k].count;
+    }
+    records = (trace_record_t*)malloc(sizeof(trace_record_t) * (*count > 0 ? *count : 1));
+    if (build_index) {
+        offsets = (unsigned long long*)malloc(sizeof(unsigned long long) * (*count > 0 ? *count : 1));
+    }
+    *count = 0;
+    for (int k = 0; k < num_chunks; k++) {
+        // Records before a chunk's first fetch belong to the last fetch of an earlier chunk.
+        for (unsigned long long r = 0; r < chunks[k].leading; r++) {
+            chunks[k].records[r].pc = pc;
+        }
+        if (chunks[k].saw_pc) {
+            pc = chunks[k].last_pc;
+        }
+        memcpy(records + *count, chunks[k].records, sizeof(trace_record_t) * chunks[k].count);
+        if (build_index) {
+            memcpy(offsets + *count, chunks[k].offsets, sizeof(unsigned long long) * chunks[k].count);
+            free(chunks[k].offsets);
+        }
+        *count += chunks[k].count;
+        free(chunks[k].records);
+    }
+
+    if (build_index) {
+        writeTraceIndex(trace_path, info.st_size, records, offsets, *count);
+        free(offsets);
+    }
+    if (info.st_size > 0) {
+        munmap((void*)data, info.st_size);
+    }
+    close(fd);
+    free(chunks);
+    return records;
+}
+
+// Cuts a loaded trace down to the -n window, in place.
+void windowRecords(trace_record_t* records, unsigned long long* count) {
+    unsigned long long first = record_first < *count ? record_first : *count;
+    unsigned long long kept = *count - first;
+    if (record_limit > 0 && record_limit < kept) {
+        kept = record_limit;
+    }
+    memmove(records, records + first, sizeof(trace_record_t) * kept);
+    *count = kept;
+}
+
+// Loads one trace of a mix into memory. Each trace gets its own loader thread, so all of them
+// are read at once, and the record count that proportional scheduling needs comes with the load.
+void* loadMixTrace(void* arg) {
+    trace_stream_t* stream = (trace_stream_t*)arg;
+    stream->records = loadTrace(stream->path, &stream->count, 0);
+    windowRecords(stream->records, &stream->count);
+    return NULL;
+}
+
+// Returns the next record of a loaded trace.
+int nextMixRecord(trace_stream_t* stream, trace_record_t* record) {
+    if (stream->next == stream->count) {
+        return 0;
+    }
+    *record = stream->records[stream->next++];
+    return 1;
+}
+
+// Forks a child that simulates one loaded trace alone on a private cache and reports through a pipe.
+void startAloneRun(cache_ctx_t* ctx, trace_stream_t* stream, int index) {
+    int fds[2];
+    if (pipe(fds) != 0) {
+        fprintf(stderr, "Error creating pipe: %s\n", strerror(errno));
+        exit(1);
+    }
+    fflush(stdout);
+    stream->alone_pid = fork();
+    if (stream->alone_pid < 0) {
+        fprintf(stderr, "Error forking: %s\n", strerror(errno));
+        exit(1);
+    }
+    if (stream->alone_pid == 0) {
+        FILE* out = fdopen(fds[1], "w");
+        trace_record_t record;
+        close(fds[0]);
+        output_details = 0; // Only the shared run narrates.
+        initializeCache(ctx);
+        while (nextMixRecord(stream, &record)) {
+            ctx->current_thread = index; // Keep the same partition as in the shared run.
+            ctx->trace_tag = stream->tag;
+            simulateRecord(ctx, &record);
+        }
+        fprintf(out, "%d %d\n", ctx->hits, ctx->misses);
+        fclose(out);
+        _exit(0);
+    }
+    close(fds[1]);
+    stream->alone_fd = fds[0];
+}
+
+// Collects the results of a trace's alone run.
+void finishAloneRun(trace_stream_t* stream) {
+    FILE* in = fdopen(stream->alone_fd, "r");
+    int status;
+    if (!in || fscanf(in, "%d %d", &stream->alone_hits, &stream->alone_misses) != 2) {
+        fprintf(stderr, "Error reading alone run of %s\n", stream->path);
+        exit(1);
+    }
+    fclose(in);
+    waitpid(stream->alone_pid, &status, 0);
+}
+
+// Interleaves several traces onto the shared cache with stride scheduling. The traces are loaded
+// concurrently, then replayed from memory by the shared run and by one forked alone run each.
+void mixTraces(cache_ctx_t* ctx) {
+    trace_stream_t* streams = trace_streams;
+    trace_record_t record;
+    int active = num_traces;
+
+    for (int i = 0; i < num_traces; i++) {
+        if (pthread_create(&streams[i].loader, NULL, loadMixTrace, &streams[i]) != 0) {
+            fprintf(stderr, "Cannot start trace loader: %s\n", strerror(errno));
+            exit(1);
+        }
+    }
+    for (int i = 0; i < num_traces; i++) {
+        pthread_join(streams[i].loader, NULL);
+    }
+
+    for (int i = 0; i < num_traces; i++) {
+        double weight = 1;
+        if (mix_schedule == SCHEDULE_WEIGHTED && i < num_weights) {
+            weight = trace_weights[i];
+        } else if (mix_schedule == SCHEDULE_PROPORTIONAL) {
+            weight = (double)streams[i].count + 1;
+        }
+        // Tag each trace's address space so identical addresses never alias across traces.
+        streams[i].tag = (address_t)i << TRACE_TAG_SHIFT;
+        streams[i].stride = 1.0 / weight;
+        startAloneRun(ctx, &streams[i], i);
+    }
+
+    // Always advance the stream that is furthest behind its share; ties go to the lowest index.
+    while (active > 0) {
+        trace_stream_t* next = NULL;
+        for (int i = 0; i < num_traces; i++) {
+            if (!streams[i].done && (!next || streams[i].pass < next->pass)) {
+                next = &streams[i];
+            }
+        }
+        if (!nextMixRecord(next, &record)) {
+            next->done = 1;
+            active--;
+            continue;
+        }
+        next->pass += next->stride;
+
+        int hits_before = ctx->hits, misses_before = ctx->misses;
+        ctx->current_thread = next - streams; // Trace index doubles as the thread ID for -P.
+        ctx->trace_tag = next->tag;
+        simulateRecord(ctx, &record);
+        next->hits += ctx->hits - hits_before;
+        next->misses += ctx->misses - misses_before;
+    }
+
+    for (int i = 0; i < num_traces; i++) {
+        free(streams[i].records);
+        finishAloneRun(&streams[i]);
+    }
+}
+
+// Prints per-trace results of a mixed run and the slowdown each trace suffers from sharing.
+void reportMix() {
+    for (int i = 0; i < num_traces; i++) {
+        trace_stream_t* stream = &trace_streams[i];
+        double shared_cycles = (double)(stream->hits + stream->misses) * MIX_HIT_CYCLES +
+                               (double)stream->misses * MIX_MISS_CYCLES;
+        double alone_cycles = (double)(stream->alone_hits + stream->alone_misses) * MIX_HIT_CYCLES +
+                              (double)stream->alone_misses * MIX_MISS_CYCLES;
+        printf("trace:%d file:%s hits:%d misses:%d alone_hits:%d alone_misses:%d slowdown:%.3f\n", i,
+               stream->path, stream->hits, stream->misses, stream->alone_hits, stream->alone_misses,
+               alone_cycles > 0 ? shared_cycles / alone_cycles : 1.0);
+    }
+}
 
-// Structure to represent a cache line, with metadata for cache management.
-typedef struct cache_entry {
-    char is_valid; // Valid bit indicating if this cache line is in use.
-    address_t entry_tag; // The tag part of the cached address.
-    unsigned long long int usage_counter; // Counter for implementing LRU eviction policy.
-    char is_dirty; // Indicates if the line has been written to since being loaded.
-    address_t access_time; // Tracks the last time this line was accessed.
-} cache_entry_t;
+// Makes dst an independent copy of a plain LRU cache and its counters.
+void cloneCache(cache_ctx_t* dst, cache_ctx_t* src) {
+    *dst = *src;
+    dst->main_cache = (set_ptr*)malloc(sizeof(set_ptr) * src->num_sets);
+    dst->last_memory_access = (address_t*)malloc(sizeof(address_t) * src->num_sets);
+    memcpy(dst->last_memory_access, src->last_memory_access, sizeof(address_t) * src->num_sets);
+    for (int i = 0; i < src->num_sets; i++) {
+        dst->main_cache[i] = (cache_entry_t*)malloc(sizeof(cache_entry_t) * src->lines_per_set);
+        memcpy(dst->main_cache[i], src->main_cache[i], sizeof(cache_entry_t) * src->lines_per_set);
+    }
+    if (src->locked_ways) {
+        dst->locked_ways = (address_t*)malloc(sizeof(address_t) * src->num_sets);
+        memcpy(dst->locked_ways, src->locked_ways, sizeof(address_t) * src->num_sets);
+    }
+}
 
-typedef cache_entry_t* set_ptr; // Defines a pointer to a set of cache lines.
-typedef set_ptr* cache_mem; // Defines a pointer to the entire cache.
+// Zeroes the counters a slice reports, keeping the cache contents.
+void resetCounters(cache_ctx_t* ctx) {
+    ctx->hits = ctx->misses = ctx->evictions = 0;
+    ctx->evicted_dirty_bytes = ctx->repeated_accesses = 0;
+    ctx->nt_stores = ctx->nt_invalidated = ctx->nt_fills_avoided = ctx->nt_evictions_avoided = 0;
+    ctx->lock_hits = ctx->lock_bypasses = 0;
+}
 
-// Global variables for configuring the cache and storing simulation results.
-int output_details = 0; // Flag to enable detailed output.
-int set_bits = 0; // The number of bits used for the set index.
-int block_bits = 0; // The number of bits used to identify the block offset.
-int lines_per_set = 0; // The associativity, i.e., number of lines per set.
-char* access_trace = NULL; // File path for the memory access trace.
+// Orders lines by recency, with invalid lines last.
+int compareRecency(const void* a, const void* b) {
+    const cache_entry_t* x = (const cache_entry_t*)a;
+    const cache_entry_t* y = (const cache_entry_t*)b;
+    if (x->is_valid != y->is_valid) {
+        return y->is_valid - x->is_valid;
+    }
+    return x->usage_counter < y->usage_counter ? -1 : x->usage_counter > y->usage_counter;
+}
 
-// Derived configuration values.
-int num_sets; // Total number of sets in the cache, computed from set_bits.
-int block_size; // Block size, computed from block_bits.
-
-// Performance counters.
-int misses = 0; // Total cache misses.
-int hits = 0; // Total cache hits.
-int evictions = 0; // Total lines evicted.
-int evicted_dirty_bytes = 0; // Number of dirty bytes evicted.
-int active_dirty_bytes = 0; // Number of dirty bytes currently in the cache.
-int repeated_accesses = 0; // Number of sequential accesses to the same address.
-unsigned long long cycle_counter = 1; // Global counter for LRU policy.
-address_t* last_memory_access; // Tracks the most recent access per set.
-
-address_t last_accessed_address = ULLONG_MAX;
-
-cache_mem main_cache; // The primary cache data structure.
-address_t set_mask; // Mask for extracting the set index from an address.
-
-// Initialize cache based on the global configuration parameters.
-void initializeCache() {
-    main_cache = (set_ptr*)malloc(sizeof(set_ptr) * num_sets);
-    last_memory_access = (address_t*)malloc(sizeof(address_t) * num_sets);
-    for (int i = 0; i < num_sets; i++) {
-        main_cache[i] = (cache_entry_t*)malloc(sizeof(cache_entry_t) * lines_per_set);
-        last_memory_access[i] = ULLONG_MAX; // Initialize to max to signify no access yet.
-        for (int j = 0; j < lines_per_set; j++) {
-            main_cache[i][j].is_valid = 0;
-            main_cache[i][j].entry_tag = 0;
-            main_cache[i][j].usage_counter = 0;
-            main_cache[i][j].is_dirty = 0;
-            main_cache[i][j].access_time = 0; // Not used, consider removing for clarity.
+// Whether a set holds the same blocks with the same dirty bits in the same LRU order in both caches.
+// From then on both caches behave identically on that set, whatever their absolute counters.
+int setsMatch(cache_ctx_t* a, cache_ctx_t* b, address_t index, cache_entry_t* scratch) {
+    cache_entry_t* x = scratch;
+    cache_entry_t* y = scratch + a->lines_per_set;
+    memcpy(x, a->main_cache[index], sizeof(cache_entry_t) * a->lines_per_set);
+    memcpy(y, b->main_cache[index], sizeof(cache_entry_t) * a->lines_per_set);
+    qsort(x, a->lines_per_set, sizeof(cache_entry_t), compareRecency);
+    qsort(y, a->lines_per_set, sizeof(cache_entry_t), compareRecency);
+    for (int i = 0; i < a->lines_per_set; i++) {
+        if (x[i].is_valid != y[i].is_valid) {
+            return 0;
+        }
+        if (x[i].is_valid && (x[i].entry_tag != y[i].entry_tag || x[i].is_dirty != y[i].is_dirty)) {
+            return 0;
         }
     }
-    set_mask = (address_t)(pow(2, set_bits) - 1); // Precompute the set mask for later use.
+    return 1;
 }
 
-// Deallocate all allocated memory for the cache, avoiding memory leaks.
-void clearCache() {
-    for (int i = 0; i < num_sets; i++) {
-        free(main_cache[i]); // Free each set individually.
+// Worker body: warm the slice's cache on the records just before it, then simulate the slice.
+void* simulateSlice(void* arg) {
+    time_slice_t* slice = (time_slice_t*)arg;
+    for (unsigned long long r = slice->warmup_first; r < slice->first; r++) {
+        simulateRecord(&slice->ctx, &trace_records[r]);
+    }
+    resetCounters(&slice->ctx);
+    cloneCache(&slice->start, &slice->ctx);
+    for (unsigned long long r = slice->first; r < slice->end; r++) {
+        slice->ctx.current_thread = trace_records[r].thread;
+        simulateRecord(&slice->ctx, &trace_records[r]);
     }
-    free(main_cache); // Free the array of pointers to sets.
-    free(last_memory_access); // Free the last access tracking array.
+    return NULL;
 }
 
-void processMemoryLoad(address_t mem_addr) {
-    if (last_accessed_address == mem_addr) {
-        repeated_accesses++; // Increment if this is a repeated access.
+// Corrects a slice whose cache was only warmed up: replays it from the exact end state of the
+// previous slice, next to a replay from its own warmed start, on every set the two still disagree
+// on. A set is dropped from the replay once both agree on it, so the replay usually covers only the
+// start of the slice. Returns the records replayed; the counters of slice are corrected in place.
+unsigned long long fixSliceBoundary(time_slice_t* prev, time_slice_t* slice, int* unconverged_sets, int* miss_error) {
+    cache_ctx_t exact, warm;
+    int num_sets = slice->ctx.num_sets;
+    char* converged = (char*)calloc(num_sets, 1);
+    int* since_check = (int*)calloc(num_sets, sizeof(int)); // Replayed records per set since its last comparison.
+    cache_entry_t* scratch = (cache_entry_t*)malloc(sizeof(cache_entry_t) * 2 * slice->ctx.lines_per_set);
+    int pending = 0;
+    unsigned long long replayed = 0;
+
+    cloneCache(&exact, &prev->ctx);
+    warm = slice->start; // Consumed here, so no copy is needed.
+    resetCounters(&exact);
+    for (int i = 0; i < num_sets; i++) {
+        converged[i] = setsMatch(&exact, &warm, i, scratch);
+        pending += !converged[i];
+    }
+
+    for (unsigned long long r = slice->first; r < slice->end && pending > 0; r++) {
+        address_t address = exact.num_remaps > 0 ? remapAddress(&exact, trace_records[r].address) : trace_records[r].address;
+        address_t index = setIndex(&exact, address >> exact.block_bits);
+        if (converged[index]) {
+            continue; // The slice already simulated this set exactly.
+        }
+        simulateRecord(&exact, &trace_records[r]);
+        simulateRecord(&warm, &trace_records[r]);
+        replayed++;
+        // Comparing costs a sort of the set, so only compare once per associativity's worth of
+        // records; converging a little late only replays a few more records.
+        if (++since_check[index] < exact.lines_per_set) {
+            continue;
+        }
+        since_check[index] = 0;
+        if (setsMatch(&exact, &warm, index, scratch)) {
+            converged[index] = 1;
+            pending--;
+        }
+    }
+
+    // The replays saw the same records, so their difference is the slice's warm-start error.
+    *miss_error = warm.misses - exact.misses;
+    slice->ctx.hits += exact.hits - warm.hits;
+    slice->ctx.misses += exact.misses - warm.misses;
+    slice->ctx.evictions += exact.evictions - warm.evictions;
+    slice->ctx.evicted_dirty_bytes += exact.evicted_dirty_bytes - warm.evicted_dirty_bytes;
+    slice->ctx.nt_invalidated += exact.nt_invalidated - warm.nt_invalidated;
+    slice->ctx.nt_fills_avoided += exact.nt_fills_avoided - warm.nt_fills_avoided;
+    slice->ctx.nt_evictions_avoided += exact.nt_evictions_avoided - warm.nt_evictions_avoided;
+    slice->ctx.lock_hits += exact.lock_hits - warm.lock_hits;
+    slice->ctx.lock_bypasses += exact.lock_bypasses - warm.lock_bypasses;
+
+    // Sets that never agreed were replayed to the end of the slice, so the exact replay holds
+    // their final state.
+    *unconverged_sets = pending;
+    for (int i = 0; i < num_sets && pending > 0; i++) {
+        if (!converged[i]) {
+            memcpy(slice->ctx.main_cache[i], exact.main_cache[i], sizeof(cache_entry_t) * exact.lines_per_set);
+        }
+    }
+    if (exact.cycle_counter > slice->ctx.cycle_counter) {
+        slice->ctx.cycle_counter = exact.cycle_counter; // Keep later fills the most recent in copied sets.
     }
-    last_accessed_address = mem_addr;
+
+    clearCache(&exact);
+    clearCache(&warm);
+    free(converged);
+    free(since_check);
+    free(scratch);
+    return replayed;
 }
-// Processes a memory access, updating the cache state accordingly.
-void processMemoryAccess(address_t mem_addr, int ignore_repeat) {
-    int found = 0; // Flag to mark a hit.
-    unsigned long long eviction_metric = ULONG_MAX;
-    unsigned int evict_line = 0;
-    address_t index = (mem_addr >> block_bits) & set_mask;
-    address_t tag_val = mem_addr >> (set_bits + block_bits);
 
-    set_ptr current_set = main_cache[index]; // Get the relevant set.
+// Simulates the trace as slice_count contiguous slices on parallel workers, each warmed on the
+// warmup records before its slice, then fixes up the slice boundaries in order so the totals match
+// a sequential run. Reports how far the warm-started slices alone were off.
+void analyzeTimeSlices(cache_ctx_t* ctx, char* trace_path) {
+    unsigned long long replayed = 0;
+    int raw_misses = 0, total_error = 0;
+    time_slice_t* slices;
 
-    // Search for a hit or an empty line.
-    for (int i = 0; i < lines_per_set; ++i) {
-        if (current_set[i].is_valid && current_set[i].entry_tag == tag_val) {
-            hits++; // A hit!
-            current_set[i].usage_counter = cycle_counter++; // Update LRU.
-            if (!current_set[i].is_dirty) {
-                current_set[i].is_dirty = 1; // Mark as dirty if this is a write.
-                active_dirty_bytes += block_size;
-            }
-            found = 1; // Mark we've found our target.
-            break; // Stop searching.
+    trace_records = loadTrace(trace_path, &num_records, 0);
+    windowRecords(trace_records, &num_records);
+    if ((unsigned long long)slice_count > num_records) {
+        slice_count = num_records > 0 ? (int)num_records : 1;
+    }
+    if (slice_warmup == 0) {
+        slice_warmup = 2ULL * ctx->num_sets * ctx->lines_per_set; // Enough to fill every line twice.
+    }
+    slices = (time_slice_t*)calloc(slice_count, sizeof(time_slice_t));
+    for (int k = 0; k < slice_count; k++) {
+        time_slice_t* slice = &slices[k];
+        slice->first = num_records * k / slice_count;
+        slice->end = num_records * (k + 1) / slice_count;
+        slice->warmup_first = slice->first > slice_warmup ? slice->first - slice_warmup : 0;
+        cloneCache(&slice->ctx, ctx);
+        if (pthread_create(&slice->thread, NULL, simulateSlice, slice) != 0) {
+            fprintf(stderr, "Cannot start slice worker: %s\n", strerror(errno));
+            exit(1);
         }
     }
+    for (int k = 0; k < slice_count; k++) {
+        pthread_join(slices[k].thread, NULL);
+        raw_misses += slices[k].ctx.misses;
+    }
+    clearCache(&slices[0].start); // The first slice starts cold, exactly like a sequential run.
 
-    // Handle a miss.
-    if (!found) {
-        misses++; // Increment miss count.
-        // Find the LRU line or an empty line to use for this new entry.
-        for (int i = 0; i < lines_per_set; ++i) {
-            if (!current_set[i].is_valid || current_set[i].usage_counter < eviction_metric) {
-                evict_line = i; // Candidate line for eviction.
-                eviction_metric = current_set[i].usage_counter; // Update metric for LRU.
+    for (int k = 1; k < slice_count; k++) {
+        int unconverged_sets, miss_error;
+        unsigned long long slice_replayed = fixSliceBoundary(&slices[k - 1], &slices[k], &unconverged_sets, &miss_error);
+        replayed += slice_replayed;
+        total_error += miss_error;
+        if (output_details) {
+            printf("boundary:%d replayed:%llu unconverged_sets:%d miss_error:%+d\n", k, slice_replayed,
+                   unconverged_sets, miss_error);
+        }
+    }
+
+    // Fold the corrected slices into ctx; the last slice holds the final cache contents.
+    resetCounters(ctx);
+    for (int k = 0; k < slice_count; k++) {
+        ctx->hits += slices[k].ctx.hits;
+        ctx->misses += slices[k].ctx.misses;
+        ctx->evictions += slices[k].ctx.evictions;
+        ctx->evicted_dirty_bytes += slices[k].ctx.evicted_dirty_bytes;
+        ctx->repeated_accesses += slices[k].ctx.repeated_accesses;
+        ctx->nt_stores += slices[k].ctx.nt_stores;
+        ctx->nt_invalidated += slices[k].ctx.nt_invalidated;
+        ctx->nt_fills_avoided += slices[k].ctx.nt_fills_avoided;
+        ctx->nt_evictions_avoided += slices[k].ctx.nt_evictions_avoided;
+        ctx->lock_hits += slices[k].ctx.lock_hits;
+        ctx->lock_bypasses += slices[k].ctx.lock_bypasses;
+    }
+    ctx->active_dirty_bytes = 0;
+    for (int i = 0; i < ctx->num_sets; i++) {
+        for (int j = 0; j < ctx->lines_per_set; j++) {
+            cache_entry_t* line = &slices[slice_count - 1].ctx.main_cache[i][j];
+            ctx->active_dirty_bytes += line->is_valid && line->is_dirty ? ctx->block_size : 0;
+        }
+    }
+    printf("time_slices:%d warmup:%llu replayed:%llu (%.2f%% of %llu) warm_start_error:%+d misses (%.3f%%)\n",
+           slice_count, slice_warmup, replayed, num_records ? 100.0 * replayed / num_records : 0.0, num_records, total_error,
+           raw_misses ? 100.0 * total_error / raw_misses : 0.0);
+
+    for (int k = 0; k < slice_count; k++) {
+        clearCache(&slices[k].ctx);
+    }
+    free(slices);
+    free(trace_records);
+}
+
+// Parses a sweep axis: comma-separated values or lo-hi ranges, which step by one, or double when
+// doubling is set; lo-hi:step ranges step by step. Returns the number of values, or -1 if the axis
+// is malformed or too long.
+int parseSweepAxis(char* text, int* values, int doubling) {
+    int count = 0;
+    for (char* item = strtok(text, ","); item; item = strtok(NULL, ",")) {
+        int lo, hi, step = 0, used = 0;
+        int fields = sscanf(item, "%d-%d%n:%d%n", &lo, &hi, &used, &step, &used);
+        if (fields == 1) {
+            hi = lo;
+        } else if (fields < 2 || item[used] != '\0' || hi < lo || lo < 0 || (fields == 3 && step < 1) ||
+                   (doubling && fields == 2 && lo == 0)) {
+            return -1;
+        }
+        for (int v = lo; v <= hi; v = step ? v + step : doubling ? v * 2 : v + 1) {
+            if (count == SWEEP_MAX_AXIS) {
+                return -1;
             }
+            values[count++] = v;
+        }
+    }
+    return count;
+}
+
+// Parses a -A rule <start>-<end>:pad=<bytes>, :pitch=<old>/<new> or :color=<color>/<colors>. The
+// padding may be a sweep axis, e.g. pad=0-256:32, which one rule at most can have.
+int parseRemap(cache_ctx_t* ctx, char* spec) {
+    remap_rule_t* rule = &ctx->remaps[ctx->num_remaps];
+    char* end;
+    int used = 0;
+    if (ctx->num_remaps >= MAX_REMAPS) {
+        return 0;
+    }
+    rule->start = strtoull(spec, &end, 0);
+    if (*end != '-') {
+        return 0;
+    }
+    rule->end = strtoull(end + 1, &end, 0);
+    if (*end != ':' || rule->end <= rule->start) {
+        return 0;
+    }
+    end++;
+    if (strncmp(end, "pad=", 4) == 0) {
+        int pads[SWEEP_MAX_AXIS];
+        int count = parseSweepAxis(end + 4, pads, 0);
+        if (count < 1 || (count > 1 && remap_sweep_rule >= 0)) {
+            return 0;
+        }
+        if (count > 1) {
+            remap_sweep_rule = ctx->num_remaps;
+            num_remap_pads = count;
+            memcpy(remap_pads, pads, sizeof(int) * count);
+        }
+        rule->kind = REMAP_PAD;
+        rule->amount = pads[0];
+    } else if (sscanf(end, "pitch=%lld/%lld%n", &rule->amount, &rule->pitch, &used) == 2 && end[used] == '\0') {
+        rule->kind = REMAP_PITCH;
+        if (rule->amount < 1 || rule->pitch < rule->amount) {
+            return 0;
+        }
+    } else if (sscanf(end, "color=%lld/%lld%n", &rule->amount, &rule->pitch, &used) == 2 && end[used] == '\0') {
+        rule->kind = REMAP_COLOR;
+        if (rule->amount < 0 || rule->pitch < 1 || rule->amount >= rule->pitch) {
+            return 0;
+        }
+    } else {
+        return 0;
+    }
+    ctx->num_remaps++;
+    return 1;
+}
+
+// Reads the -S grid into its three axes, or makes the -s/-E/-b geometry a one-point grid.
+void parseSweepGrid(cache_ctx_t* ctx, int* sets, int* ways, int* blocks, int* num_sets, int* num_ways,
+                    int* num_blocks) {
+    char* axes[3];
+    sets[0] = ctx->set_bits;
+    ways[0] = ctx->lines_per_set;
+    blocks[0] = ctx->block_bits;
+    *num_sets = *num_ways = *num_blocks = 1;
+    if (!sweep_spec) {
+        return;
+    }
+    axes[0] = strtok(sweep_spec, "/");
+    axes[1] = strtok(NULL, "/");
+    axes[2] = strtok(NULL, "/");
+    if (!axes[0] || !axes[1] || !axes[2] || strtok(NULL, "/")) {
+        fprintf(stderr, "A sweep needs <sets>/<ways>/<blocks>\n");
+        exit(1);
+    }
+    // The axes are already NUL-terminated, so parseSweepAxis can restart strtok on each.
+    *num_sets = parseSweepAxis(axes[0], sets, 0);
+    *num_ways = parseSweepAxis(axes[1], ways, 1);
+    *num_blocks = parseSweepAxis(axes[2], blocks, 0);
+    if (*num_sets <= 0 || *num_ways <= 0 || *num_blocks <= 0) {
+        fprintf(stderr, "Invalid sweep axis in -S\n");
+        exit(1);
+    }
+}
+
+// Orders sweep jobs by decreasing estimated cost, ties in grid order.
+int compareSweepCost(const void* a, const void* b) {
+    const sweep_job_t* x = &sweep_jobs[*(const int*)a];
+    const sweep_job_t* y = &sweep_jobs[*(const int*)b];
+    if (x->cost != y->cost) {
+        return x->cost < y->cost ? 1 : -1;
+    }
+    return *(const int*)a - *(const int*)b;
+}
+
+// Worker body: takes batches of configurations, most expensive first, and advances each batch
+// through the trace one chunk at a time so every configuration reads the chunk while it is hot.
+void* sweepWorker(void* arg) {
+    sweep_job_t* batch[SWEEP_BATCH];
+    (void)arg;
+    for (;;) {
+        int size = 0;
+        pthread_mutex_lock(&sweep_lock);
+        // Near the end of the queue hand out single jobs so no worker is left with a long tail.
+        int take = sweep_num_jobs - sweep_next > SWEEP_BATCH * sweep_workers ? SWEEP_BATCH : 1;
+        while (size < take && sweep_next < sweep_num_jobs) {
+            batch[size++] = &sweep_jobs[sweep_order[sweep_next++]];
+        }
+        pthread_mutex_unlock(&sweep_lock);
+        if (size == 0) {
+            return NULL;
         }
 
-        // Evict if necessary.
-        if (current_set[evict_line].is_valid) {
-            evictions++; // Increment evictions.
-            if (current_set[evict_line].is_dirty) {
-                evicted_dirty_bytes += block_size; // Track evicted dirty data.
-                active_dirty_bytes -= block_size; // Update active dirty byte count.
+        for (int i = 0; i < size; i++) {
+            initializeCache(&batch[i]->ctx);
+        }
+        for (unsigned long long first = 0; first < num_records; first += SWEEP_CHUNK_RECORDS) {
+            unsigned long long end = first + SWEEP_CHUNK_RECORDS < num_records ? first + SWEEP_CHUNK_RECORDS : num_records;
+            for (int i = 0; i < size; i++) {
+                for (unsigned long long r = first; r < end; r++) {
+                    batch[i]->ctx.current_thread = trace_records[r].thread;
+                    simulateRecord(&batch[i]->ctx, &trace_records[r]);
+                }
             }
         }
+        for (int i = 0; i < size; i++) {
+            clearCache(&batch[i]->ctx); // Only the counters are reported.
+        }
+    }
+}
+
+// Simulates every combination of the -S grid and the swept -A padding on the -j worker threads,
+// reading one shared copy of the trace, and prints one line per configuration in grid order.
+// Without -S the grid is the single -s/-E/-b geometry.
+void analyzeSweep(cache_ctx_t* ctx, char* trace_path) {
+    int sets[SWEEP_MAX_AXIS], ways[SWEEP_MAX_AXIS], blocks[SWEEP_MAX_AXIS];
+    int num_set_values, num_way_values, num_block_values;
+    int num_pad_values = remap_sweep_rule >= 0 ? num_remap_pads : 1;
+    pthread_t* threads;
 
-        // Place the new entry.
-        current_set[evict_line].is_valid = 1;
-        current_set[evict_line].entry_tag = tag_val;
-        current_set[evict_line].usage_counter = cycle_counter++; // Update LRU.
-        current_set[evict_line].is_dirty = 0; // New entry is not dirty.
+    parseSweepGrid(ctx, sets, ways, blocks, &num_set_values, &num_way_values, &num_block_values);
+
+    sweep_num_jobs = num_set_values * num_way_values * num_block_values * num_pad_values;
+    sweep_jobs = (sweep_job_t*)calloc(sweep_num_jobs, sizeof(sweep_job_t));
+    sweep_order = (int*)malloc(sizeof(int) * sweep_num_jobs);
+    for (int j = 0; j < sweep_num_jobs; j++) {
+        sweep_job_t* job = &sweep_jobs[j];
+        int g = j / num_pad_values; // Position in the geometry grid.
+        job->ctx = *ctx; // Policy and engine options are shared by the whole grid.
+        job->ctx.set_bits = sets[g / (num_way_values * num_block_values)];
+        job->ctx.lines_per_set = ways[g / num_block_values % num_way_values];
+        job->ctx.block_bits = blocks[g % num_block_values];
+        if (remap_sweep_rule >= 0) {
+            job->ctx.remaps[remap_sweep_rule].amount = remap_pads[j % num_pad_values];
+        }
+        // Every access scans the set's tags; the rest of the work barely depends on the geometry.
+        job->cost = job->ctx.lines_per_set + SWEEP_BASE_COST;
+        sweep_order[j] = j;
     }
+    qsort(sweep_order, sweep_num_jobs, sizeof(int), compareSweepCost);
 
-    if (last_accessed_address == mem_addr && ignore_repeat == 0) {
-        repeated_accesses++; // Increment if this is a repeated access.
+    trace_records = loadTrace(trace_path, &num_records, 0);
+    windowRecords(trace_records, &num_records);
+    output_details = 0; // Dueling narration from several workers would interleave.
+    sweep_workers = slice_count > 0 ? slice_count : (int)sysconf(_SC_NPROCESSORS_ONLN);
+    if (sweep_workers > sweep_num_jobs) {
+        sweep_workers = sweep_num_jobs;
+    }
+    if (sweep_workers < 1) {
+        sweep_workers = 1;
+    }
+    threads = (pthread_t*)malloc(sizeof(pthread_t) * sweep_workers);
+    for (int w = 0; w < sweep_workers; w++) {
+        if (pthread_create(&threads[w], NULL, sweepWorker, NULL) != 0) {
+            fprintf(stderr, "Cannot start sweep worker: %s\n", strerror(errno));
+            exit(1);
+        }
+    }
+    for (int w = 0; w < sweep_workers; w++) {
+        pthread_join(threads[w], NULL);
     }
-    last_accessed_address = mem_addr;
 
+    for (int j = 0; j < sweep_num_jobs; j++) {
+        cache_ctx_t* done = &sweep_jobs[j].ctx;
+        int accesses = done->hits + done->misses;
+        printf("s:%d E:%d b:%d", done->set_bits, done->lines_per_set, done->block_bits);
+        if (remap_sweep_rule >= 0) {
+            printf(" pad:%lld", done->remaps[remap_sweep_rule].amount);
+        }
+        printf(" hits:%d misses:%d evictions:%d miss_rate:%.4f\n", done->hits, done->misses, done->evictions,
+               accesses ? (double)done->misses / accesses : 0.0);
+    }
+    printf("sweep_configs:%d workers:%d records:%llu\n", sweep_num_jobs, sweep_workers, num_records);
 
+    free(threads);
+    free(sweep_jobs);
+    free(sweep_order);
+    free(trace_records);
 }
 
-// Read and simulate memory access from the trace file.
-void analyzeTrace(char* trace_path) {
-    FILE* trace = fopen(trace_path, "r");
-    if (!trace) {
-        fprintf(stderr, "Error opening trace file: %s\n", trace_path);
+// Counts the accesses of the -e loop nest analytically on the -s/-E/-b cache or every geometry of
+// the -S grid. A single geometry prints the usual summary line; a grid prints one line per geometry.
+void analyzeNest(cache_ctx_t* ctx) {
+    int sets[SWEEP_MAX_AXIS], ways[SWEEP_MAX_AXIS], blocks[SWEEP_MAX_AXIS];
+    int num_set_values, num_way_values, num_block_values, error_line;
+    affine_nest_t* nest = affineLoad(nest_path, &error_line);
+    affine_counts_t counts = {0};
+
+    if (!nest) {
+        if (error_line > 0) {
+            fprintf(stderr, "%s:%d: invalid loop nest line\n", nest_path, error_line);
+        } else {
+            fprintf(stderr, "Cannot open %s: %s\n", nest_path, strerror(errno));
+        }
         exit(1);
     }
+    parseSweepGrid(ctx, sets, ways, blocks, &num_set_values, &num_way_values, &num_block_values);
+    for (int g = 0; g < num_set_values * num_way_values * num_block_values; g++) {
+        int s = sets[g / (num_way_values * num_block_values)];
+        int e = ways[g / num_block_values % num_way_values];
+        int b = blocks[g % num_block_values];
+        if (!affineCount(nest, s, e, b, &counts)) {
+            fprintf(stderr, "Cannot model s=%d E=%d b=%d analytically\n", s, e, b);
+            exit(1);
+        }
+        if (sweep_spec) {
+            printf("s:%d E:%d b:%d hits:%llu misses:%llu evictions:%llu miss_rate:%.4f\n", s, e, b, counts.hits,
+                   counts.misses, counts.evictions, counts.accesses ? (double)counts.misses / counts.accesses : 0.0);
+        } else {
+            printf("hits:%llu misses:%llu evictions:%llu\n", counts.hits, counts.misses, counts.evictions);
+        }
+    }
+    printf("nest_accesses:%llu iterations:%llu simulated_iterations:%llu\n", counts.accesses, counts.iterations,
+           counts.simulated);
+    affineDestroy(nest);
+}
 
-    char operation;
-    address_t address;
-    int size;
+// Prints the traffic and latency of every LLC slice, the load imbalance (busiest slice over the
+// mean) and the average core-to-slice latency.
+void reportSlices(cache_ctx_t* ctx) {
+    unsigned long long accesses = 0, latency = 0, busiest = 0;
+    int slices = ctx->llc_config.slices;
+    for (int i = 0; i < slices; i++) {
+        const slice_stats_t* slice = &ctx->slice_stats[i];
+        accesses += slice->accesses;
+        latency += slice->latency;
+        busiest = slice->accesses > busiest ? slice->accesses : busiest;
+    }
+    for (int i = 0; i < slices; i++) {
+        const slice_stats_t* slice = &ctx->slice_stats[i];
+        printf("llc_slice:%d accesses:%llu (%.2f%%) misses:%llu miss_rate:%.4f avg_latency:%.1f\n", i, slice->accesses,
+               accesses ? 100.0 * slice->accesses / accesses : 0.0, slice->misses,
+               slice->accesses ? (double)slice->misses / slice->accesses : 0.0,
+               slice->accesses ? (double)slice->latency / slice->accesses : 0.0);
+    }
+    printf("llc_slices:%d imbalance:%.3f avg_llc_latency:%.2f\n", slices,
+           accesses ? (double)busiest * slices / accesses : 0.0, accesses ? (double)latency / accesses : 0.0);
+}
 
-    // Loop through all lines in the trace file.
-    while (fscanf(trace, " %c %llx,%d", &operation, &address, &size) == 3) {
-        switch (operation) {
-        case 'L': // Load operation
-            processMemoryLoad(address);
-        case 'S': // Store operation
-            processMemoryAccess(address, 0); // Process the memory access.
-            break;
-        case 'M': // Modify operation, processed as a load followed by a store.
-            processMemoryAccess(address, 0); // First access (load).
-            processMemoryAccess(address, 1); // Second access (store).
-            break;
-        default: // Ignore unrecognized operations.
-            break;
+// Prints where memory traffic went: per region, per node, and overall.
+void reportNuma(cache_ctx_t* ctx) {
+    unsigned long long local = 0, remote = 0;
+    for (int i = 0; i <= ctx->numa_config.num_regions; i++) {
+        const numa_region_t* region = numaRegion(ctx->numa, i);
+        unsigned long long accesses = region->local + region->remote;
+        local += region->local;
+        remote += region->remote;
+        if (i == ctx->numa_config.num_regions) {
+            printf("numa_region:rest");
+        } else {
+            printf("numa_region:%d range:0x%llx-0x%llx", i, region->start, region->end);
+        }
+        if (region->node >= 0) {
+            printf(" home:%d", region->node);
+        }
+        printf(" accesses:%llu remote:%.2f%%\n", accesses, accesses ? 100.0 * region->remote / accesses : 0.0);
+    }
+    for (int node = 0; node < ctx->numa_config.nodes; node++) {
+        printf("numa_node:%d pages:%llu\n", node, numaPages(ctx->numa, node));
+    }
+    printf("numa_remote:%.2f%% avg_memory_latency:%.1f\n", local + remote ? 100.0 * remote / (local + remote) : 0.0,
+           local + remote ? (double)(local * ctx->numa_config.local_latency + remote * ctx->numa_config.remote_latency) /
+                                (local + remote)
+                          : 0.0);
+}
+
+// Replays a trace against the object cache; each record's address is a key and its size the object size.
+void analyzeObjectTrace(cache_ctx_t* ctx, char* trace_path) {
+    trace_stream_t stream;
+    trace_record_t record;
+    ocache_t* cache = ocacheCreate(object_policy, object_capacity);
+    tinylfu_t* filter = NULL;
+
+    if (ctx->admission_mode) {
+        filter = tinylfuCreate(object_capacity / OBJECT_SIZE_HINT);
+        ocacheSetAdmission(cache, filter);
+    }
+
+    unsigned long long replayed = 0;
+
+    openTraceWindow(&stream, trace_path);
+    while ((record_limit == 0 || replayed++ < record_limit) && readRecord(&stream, &record)) {
+        ocacheAccess(cache, record.address, record.size);
+    }
+    fclose(stream.file);
+
+    const ocache_stats_t* stats = ocacheStats(cache);
+    unsigned long long bytes = stats->byte_hits + stats->byte_misses;
+    // Printed directly rather than through printSummary, whose int counters would truncate.
+    printf("hits:%llu misses:%llu evictions:%llu\n", stats->hits, stats->misses, stats->evictions);
+    printf("byte_hits:%llu byte_misses:%llu byte_hit_ratio:%.4f\n", stats->byte_hits, stats->byte_misses,
+           bytes ? (double)stats->byte_hits / bytes : 0.0);
+    if (filter) {
+        printf("admission_rejects:%llu\n", stats->rejections);
+        tinylfuDestroy(filter);
+    }
+    ocacheDestroy(cache);
+}
+
+// Estimates a fully associative LRU miss-ratio curve from the trace's block addresses in one pass.
+void analyzeMissRatioCurve(cache_ctx_t* ctx, char* trace_path) {
+    trace_stream_t stream;
+    trace_record_t record;
+    mrc_point_t points[MRC_MAX_POINTS];
+    shards_t* shards = shardsCreate(mrc_samples);
+    double max_error = 0;
+
+    unsigned long long sampled = 0;
+
+    openTraceWindow(&stream, trace_path);
+    while ((record_limit == 0 || sampled++ < record_limit) && readRecord(&stream, &record)) {
+        shardsAccess(shards, record.address >> ctx->block_bits);
+        if (record.operation == 'M') {
+            shardsAccess(shards, record.address >> ctx->block_bits); // The store half of a modify.
+        }
+    }
+    fclose(stream.file);
+
+    int count = shardsCurve(shards, points, MRC_MAX_POINTS);
+    printf("shards_rate:%.6f sampled_refs:%llu tracked_blocks_max:%u\n", shardsRate(shards),
+           shardsSampled(shards), mrc_samples);
+    for (int i = 0; i < count; i++) {
+        printf("cache_blocks:%llu cache_bytes:%llu miss_ratio:%.4f std_error:%.4f\n", points[i].cache_blocks,
+               points[i].cache_blocks << ctx->block_bits, points[i].miss_ratio, points[i].std_error);
+        if (points[i].std_error > max_error) {
+            max_error = points[i].std_error;
         }
     }
+    printf("max_std_error:%.4f\n", max_error);
+    shardsDestroy(shards);
+}
 
-    fclose(trace); // Close the trace file.
+// Parses a byte count with an optional K, M or G suffix.
+unsigned long long parseBytes(char* text) {
+    char* end;
+    unsigned long long bytes = strtoull(text, &end, 0);
+    switch (*end) {
+    case 'G':
+    case 'g':
+        bytes <<= 10; // Fall through.
+    case 'M':
+    case 'm':
+        bytes <<= 10; // Fall through.
+    case 'K':
+    case 'k':
+        bytes <<= 10;
+        break;
+    default:
+        break;
+    }
+    return bytes;
 }
 
 // Displays command-line usage information.
 void usage(char* prog[]) {
-    printf("Usage: %s [-hv] -s <num> -E <num> -b <num> -t <file>\n", prog[0]);
+    printf("Usage: %s [-hvdUa] [-r <policy>] [-p <predictor>] [-P <rule>]...\n", prog[0]);
+    printf("       [-L <range>]... [-T <range>]... [-A <remap>]...\n");
+    printf("       [-m <sched>] [-w <weights>] [-j <slices> [-W <records>]]\n");
+    printf("       {-s <num> | -C <bytes>} [-H] [-l <llc>] -E <num> -b <num>\n");
+    printf("       -t <file> [-t <file>]...\n");
+    printf("       %s -o <policy> -c <bytes> -t <file>\n", prog[0]);
+    printf("       %s -R <samples> -b <num> -t <file>\n", prog[0]);
+    printf("       %s -S <sets>/<ways>/<blocks> [-j <workers>] [-r <policy>] [-da] -t <file>\n", prog[0]);
+    printf("       %s -X -t <file>\n", prog[0]);
+    printf("       %s {-s <num> -E <num> -b <num> | -S <sets>/<ways>/<blocks>} -e <nest>\n", prog[0]);
+    printf("       [-D <dram settings>] [-B <entries>[:<cycles>]] [-M <entries>[:<latency>]] [-N <numa>]...\n");
+    printf("       add timing models to the first form.\n");
     printf("Options:\n");
     printf("  -h         Print this help message.\n");
     printf("  -v         Optional verbose flag for detailed simulation output.\n");
+    printf("             With dip or drrip, prints the dueling winner of every epoch.\n");
     printf("  -s <num>   Number of set index bits.\n");
+    printf("  -C <size>  Cache capacity instead of -s; K, M and G suffixes are allowed. The\n");
+    printf("             set count need not be a power of two, e.g. -C 2560K -E 20 -b 6;\n");
+    printf("             blocks then map to sets modulo the count.\n");
+    printf("  -H         Hash block numbers before picking their set.\n");
+    printf("  -l <list>  Split the sets over LLC slices picked by an XOR hash of the\n");
+    printf("             address and report per-slice traffic, load imbalance and the\n");
+    printf("             average core-to-slice latency; thread t runs on core t.\n");
+    printf("             Comma-separated key=value settings, or \"default\": slices,\n");
+    printf("             hash=<mask>:<mask>... (one hex mask per slice bit), base and hop\n");
+    printf("             (ring latencies), table=<cycles>/...+<cycles>/... (per core).\n");
     printf("  -E <num>   Number of lines per set, determining cache associativity.\n");
     printf("  -b <num>   Number of block offset bits.\n");
-    printf("  -t <file>  Trace file containing memory accesses to simulate.\n");
+    printf("  -t <file>  Trace file containing memory accesses to simulate. Repeat to\n");
+    printf("             interleave several traces onto one shared cache; trace i then\n");
+    printf("             acts as thread i.\n");
+    printf("  -m <name>  Mixing schedule: rr (default), weighted or proportional.\n");
+    printf("  -w <list>  Comma-separated trace weights for weighted mixing.\n");
+    printf("  -o <name>  Object-cache mode: each record is a key and an object size.\n");
+    printf("             Policies: lru, lfu, arc, 2q, lirs or s3fifo.\n");
+    printf("  -c <num>   Object cache capacity in bytes; K, M and G suffixes are allowed.\n");
+    printf("  -R <num>   Print an approximate LRU miss-ratio curve using fixed-size SHARDS\n");
+    printf("             that tracks at most this many sampled blocks.\n");
+    printf("  -r <name>  Replacement policy: lru (default), ship, hawkeye, bip, dip,\n");
+    printf("             srrip, brrip or drrip.\n");
+    printf("  -p <name>[:<bits>]  Probe a predicted way first: mru (per set), pc or xor\n");
+    printf("             (PC XOR block address, 2^bits entries, default %d). Reports the\n", WAY_PREDICT_BITS);
+    printf("             prediction accuracy, ways read per lookup and the effective hit\n");
+    printf("             latency; wrong predictions delay the timing models.\n");
+    printf("  -d         Predict dead blocks from the access PC and bypass them on a miss.\n");
+    printf("  -P <rule>  Confine allocations to a way mask: t<thread>=<mask> or\n");
+    printf("             <start>-<end>=<mask>. Repeatable; the first matching rule wins.\n");
+    printf("  -L <range> Load <start>-<end>[=<mask>] into the cache before the trace and\n");
+    printf("             lock it into the ways of the mask (default: any way). Locked\n");
+    printf("             lines are never evicted; reports how the unlocked capacity fares.\n");
+    printf("             Repeatable; needs at most 64 ways.\n");
+    printf("  -T <range> Treat stores to <start>-<end> as non-temporal, like 'N' records:\n");
+    printf("             they allocate nothing, invalidate any cached copy and go to\n");
+    printf("             memory through the write buffer. Repeatable.\n");
+    printf("  -A <rule>  Remap the addresses of a region before simulating them, to try\n");
+    printf("             a layout without re-tracing. <start>-<end>:<how>, where <how> is\n");
+    printf("             pad=<bytes> (shift the region), pitch=<old>/<new> (change the\n");
+    printf("             row pitch) or color=<c>/<n> (give every page color c of n).\n");
+    printf("             Repeatable; the first matching rule wins. One rule may sweep its\n");
+    printf("             padding, e.g. pad=0-256:32, over one loaded copy of the trace.\n");
+    printf("  -U         Suggest utility-based (UCP) way masks for the partitions.\n");
+    printf("  -a         Admit a missed block only if TinyLFU finds it more popular\n");
+    printf("             than the victim. Also applies to object-cache mode.\n");
+    printf("  -j <num>   Split the trace into this many slices simulated in parallel\n");
+    printf("             (plain LRU only). Slice boundaries are then replayed until the\n");
+    printf("             warm-started cache agrees with the exact one, so totals are exact;\n");
+    printf("             the warm-start error before that fix-up is reported.\n");
+    printf("  -W <num>   Records each slice replays first to warm its cache; defaults to\n");
+    printf("             twice the number of lines. With -v, prints every boundary.\n");
+    printf("  -S <grid>  Simulate every combination of set bits, ways and block bits on\n");
+    printf("             -j worker threads (default: one per CPU) sharing one loaded trace.\n");
+    printf("             Each axis is a comma list of values or lo-hi ranges; way ranges\n");
+    printf("             double, lo-hi:step ranges step, e.g. -S 0-4/1-16/4,6.\n");
+    printf("  -e <file>  Count the LRU hits, misses and evictions of the affine loop nest in\n");
+    printf("             the file analytically, without a trace (see affine.h for the\n");
+    printf("             format). With -S, prints one line per geometry of the grid.\n");
+    printf("  -n <first>[:<count>]  Simulate only count records (default: the rest)\n");
+    printf("             starting at data record first; every trace of a mix, every\n");
+    printf("             slice (-j) and every sweep geometry (-S) sees the same window.\n");
+    printf("  -D <list>  Send misses and dirty writebacks to a DRAM model and report row\n");
+    printf("             buffer hits, bank conflicts and miss latency. Comma-separated\n");
+    printf("             key=value settings, or \"default\": channels, ranks, banks, row\n");
+    printf("             (bytes), map=page|line, xor=0|1, page=open|closed, queue,\n");
+    printf("             tCL, tRCD, tRP, tBURST (controller cycles) and issue (cycles\n");
+    printf("             between trace accesses).\n");
+    printf("  -B <n>[:<c>]  Put an n-line write buffer between the cache and memory. It\n");
+    printf("             merges writebacks of the same line, retires one line every c\n");
+    printf("             cycles (default %d), stalls the core when full and forwards\n", WB_DRAIN_CYCLES);
+    printf("             buffered lines to misses.\n");
+    printf("  -M <n>[:<l>]  Track misses in flight with n MSHRs: later accesses to a line\n");
+    printf("             being fetched merge into its MSHR, and a miss with every MSHR\n");
+    printf("             busy stalls the core. Misses take l cycles (default %d), or\n", MSHR_MISS_CYCLES);
+    printf("             whatever -D computes. Reports the achieved memory-level parallelism.\n");
+    printf("  -N <spec>  Home every page of memory traffic on a NUMA node and report\n");
+    printf("             remote accesses. Repeatable. Either settings (nodes, page,\n");
+    printf("             local and remote latencies, policy=first-touch|interleave|map)\n");
+    printf("             or a region <start>-<end>[=<node>] to place and report on its\n");
+    printf("             own. Thread t runs on node t %% nodes.\n");
+    printf("  -X         Parse the trace on every CPU and write a sparse record index to\n");
+    printf("             <file>.idx, which lets -n start anywhere without reading the\n");
+    printf("             records before it.\n");
     exit(0);
 }
 
 // Parses command-line arguments and runs the cache simulation.
 int main(int argc, char* argv[]) {
     char opt;
+    cache_ctx_t sim = {0}; // The cache simulated by this run.
+    cache_ctx_t* ctx = &sim;
+    int sets_given = 0; // -s 0 is a valid fully associative cache, so track presence separately.
+
+    dramDefaults(&ctx->dram_config); // Also supplies the core issue rate of the timing extension.
+    ctx->wb_drain_cycles = WB_DRAIN_CYCLES;
+    ctx->mshr_latency = MSHR_MISS_CYCLES;
+    ctx->way_predict_bits = WAY_PREDICT_BITS;
+    llcDefaults(&ctx->llc_config);
+    numaDefaults(&ctx->numa_config);
 
     // Parse command-line options.
-    while ((opt = getopt(argc, argv, "s:E:b:t:vh")) != -1) {
+    while ((opt = getopt(argc, argv, "s:E:b:t:m:w:o:c:R:ar:dP:Uj:W:S:n:XD:B:M:N:T:A:L:p:C:Hl:e:vh")) != -1) {
         switch (opt) {
         case 's': // Number of set index bits.
-            set_bits = atoi(optarg);
+            ctx->set_bits = atoi(optarg);
+            sets_given = 1;
+            break;
+        case 'C': // Capacity, for set counts that are not a power of two.
+            ctx->cache_bytes = parseBytes(optarg);
+            break;
+        case 'l': // Sliced LLC.
+            ctx->llc_enabled = 1;
+            if (strcmp(optarg, "default") != 0 && !llcConfigure(&ctx->llc_config, optarg)) {
+                fprintf(stderr, "Invalid LLC slice setting in -l\n");
+                usage(argv);
+            }
+            break;
+        case 'H': // Hashed set indexing.
+            ctx->hashed_index = 1;
             break;
         case 'E': // Associativity (lines per set).
-            lines_per_set = atoi(optarg);
+            ctx->lines_per_set = atoi(optarg);
             break;
         case 'b': // Block size.
-            block_bits = atoi(optarg);
+            ctx->block_bits = atoi(optarg);
             break;
-        case 't': // Trace file path.
+        case 't': // Trace file path; repeat to mix several traces onto one cache.
+            if (num_traces >= MAX_TRACES) {
+                fprintf(stderr, "At most %d traces can be mixed\n", MAX_TRACES);
+                exit(1);
+            }
             access_trace = optarg;
+            trace_streams[num_traces++].path = optarg;
+            break;
+        case 'm': // Mixing schedule.
+            if (strcmp(optarg, "rr") == 0) {
+                mix_schedule = SCHEDULE_ROUND_ROBIN;
+            } else if (strcmp(optarg, "weighted") == 0) {
+                mix_schedule = SCHEDULE_WEIGHTED;
+            } else if (strcmp(optarg, "proportional") == 0) {
+                mix_schedule = SCHEDULE_PROPORTIONAL;
+            } else {
+                fprintf(stderr, "Unknown mixing schedule: %s\n", optarg);
+                usage(argv);
+            }
+            break;
+        case 'w': // Comma-separated weights for weighted mixing.
+            num_weights = 0;
+            for (char* weight = strtok(optarg, ","); weight && num_weights < MAX_TRACES; weight = strtok(NULL, ",")) {
+                trace_weights[num_weights] = atof(weight);
+                if (trace_weights[num_weights] <= 0) {
+                    fprintf(stderr, "Weights must be positive: %s\n", weight);
+                    exit(1);
+                }
+                num_weights++;
+            }
+            mix_schedule = SCHEDULE_WEIGHTED;
+            break;
+        case 'o': // Object-cache mode and its policy.
+            object_mode = 1;
+            object_policy = OC_NUM_POLICIES;
+            for (int i = 0; i < OC_NUM_POLICIES; i++) {
+                if (strcmp(optarg, ocache_policy_names[i]) == 0) {
+                    object_policy = i;
+                }
+            }
+            if (object_policy == OC_NUM_POLICIES) {
+                fprintf(stderr, "Unknown object cache policy: %s\n", optarg);
+                usage(argv);
+            }
+            break;
+        case 'c': // Object cache capacity.
+            object_capacity = parseBytes(optarg);
+            break;
+        case 'R': // SHARDS miss-ratio curve.
+            mrc_samples = (unsigned int)atoi(optarg);
+            if (mrc_samples == 0) {
+                fprintf(stderr, "SHARDS needs a positive sample count\n");
+                usage(argv);
+            }
+            break;
+        case 'a': // TinyLFU admission filter.
+            ctx->admission_mode = 1;
+            break;
+        case 'r': // Replacement policy.
+            ctx->replacement_policy = -1;
+            for (int i = 0; i < (int)(sizeof(policy_names) / sizeof(policy_names[0])); i++) {
+                if (strcmp(optarg, policy_names[i]) == 0) {
+                    ctx->replacement_policy = i;
+                }
+            }
+            if ((int)ctx->replacement_policy < 0) {
+                fprintf(stderr, "Unknown replacement policy: %s\n", optarg);
+                usage(argv);
+            }
+            break;
+        case 'p': { // Way predictor.
+            char* bits = strchr(optarg, ':');
+            if (bits) {
+                *bits++ = '\0';
+                ctx->way_predict_bits = atoi(bits);
+            }
+            ctx->way_predictor = WAY_PREDICT_NONE;
+            for (int i = 1; i < (int)(sizeof(way_predictor_names) / sizeof(way_predictor_names[0])); i++) {
+                if (strcmp(optarg, way_predictor_names[i]) == 0) {
+                    ctx->way_predictor = i;
+                }
+            }
+            if (ctx->way_predictor == WAY_PREDICT_NONE || ctx->way_predict_bits < 1 || ctx->way_predict_bits > 16) {
+                fprintf(stderr, "Unknown way predictor: %s\n", optarg);
+                usage(argv);
+            }
+            break;
+        }
+        case 'd': // Dead-block bypass.
+            ctx->dead_block_bypass = 1;
+            break;
+        case 'P': // Way partition rule.
+            if (!parsePartition(ctx, optarg)) {
+                fprintf(stderr, "Invalid partition rule: %s\n", optarg);
+                usage(argv);
+            }
+            break;
+        case 'U': // Utility-based partitioning suggestion.
+            ctx->ucp_mode = 1;
+            break;
+        case 'j': // Time-partitioned parallel simulation.
+            slice_count = atoi(optarg);
+            if (slice_count < 1) {
+                fprintf(stderr, "Slice count must be positive: %s\n", optarg);
+                usage(argv);
+            }
+            break;
+        case 'W': // Warmup window of each slice.
+            slice_warmup = strtoull(optarg, NULL, 0);
+            break;
+        case 'S': // Configuration sweep.
+            sweep_spec = optarg;
+            break;
+        case 'e': // Loop nest to count analytically.
+            nest_path = optarg;
+            break;
+        case 'n': // Window of records to simulate.
+            if (sscanf(optarg, "%llu:%llu", &record_first, &record_limit) < 1) {
+                fprintf(stderr, "Invalid record window: %s\n", optarg);
+                usage(argv);
+            }
+            break;
+        case 'X': // Build a sparse trace index.
+            build_index = 1;
+            break;
+        case 'L': // Locked range.
+            if (!parseLock(ctx, optarg)) {
+                fprintf(stderr, "Invalid locked range: %s\n", optarg);
+                usage(argv);
+            }
+            break;
+        case 'A': // Address remapping rule.
+            if (!parseRemap(ctx, optarg)) {
+                fprintf(stderr, "Invalid remapping rule: %s\n", optarg);
+                usage(argv);
+            }
+            break;
+        case 'T': // Streaming store range.
+            if (!parseStreamRange(ctx, optarg)) {
+                fprintf(stderr, "Invalid streaming store range: %s\n", optarg);
+                usage(argv);
+            }
+            break;
+        case 'B': // Write buffer.
+            if (sscanf(optarg, "%d:%d", &ctx->wb_entries, &ctx->wb_drain_cycles) < 1 || ctx->wb_entries < 1 ||
+                ctx->wb_drain_cycles < 0) {
+                fprintf(stderr, "Invalid write buffer: %s\n", optarg);
+                usage(argv);
+            }
+            break;
+        case 'M': // Miss status holding registers.
+            if (sscanf(optarg, "%d:%d", &ctx->mshr_entries, &ctx->mshr_latency) < 1 || ctx->mshr_entries < 1 ||
+                ctx->mshr_latency < 1) {
+                fprintf(stderr, "Invalid MSHR setting: %s\n", optarg);
+                usage(argv);
+            }
+            break;
+        case 'N': // NUMA placement setting or region.
+            ctx->numa_enabled = 1;
+            if (strcmp(optarg, "default") != 0 && !numaConfigure(&ctx->numa_config, optarg)) {
+                fprintf(stderr, "Invalid NUMA setting in -N\n");
+                usage(argv);
+            }
+            break;
+        case 'D': // DRAM model behind the cache.
+            ctx->dram_enabled = 1;
+            if (strcmp(optarg, "default") != 0 && !dramConfigure(&ctx->dram_config, optarg)) {
+                fprintf(stderr, "Invalid DRAM setting in -D\n");
+                usage(argv);
+            }
             break;
         case 'v': // Verbose output flag.
             output_details = 1;
@@ -217,23 +3074,205 @@ int main(int argc, char* argv[]) {
         }
     }
 
+    if (object_mode) {
+        if (object_capacity == 0 || access_trace == NULL) {
+            fprintf(stderr, "Object-cache mode needs -c and -t\n");
+            usage(argv);
+        }
+        analyzeObjectTrace(ctx, access_trace);
+        return 0;
+    }
+
+    if (build_index) {
+        if (access_trace == NULL) {
+            fprintf(stderr, "Missing required command line argument\n");
+            usage(argv);
+        }
+        free(loadTrace(access_trace, &num_records, 1));
+        printf("records:%llu index_entries:%llu\n", num_records,
+               (num_records + TRACE_INDEX_STRIDE - 1) / TRACE_INDEX_STRIDE);
+        return 0;
+    }
+
+    if (nest_path) {
+        if (!sweep_spec && (!sets_given || ctx->lines_per_set == 0)) {
+            fprintf(stderr, "Missing required command line argument\n");
+            usage(argv);
+        }
+        if (access_trace || ctx->replacement_policy != POLICY_LRU || ctx->dead_block_bypass || ctx->admission_mode ||
+            ctx->num_partitions > 0 || ctx->num_locks > 0 || ctx->num_remaps > 0 || ctx->num_stream_ranges > 0 ||
+            ctx->cache_bytes > 0 || ctx->hashed_index || ctx->llc_enabled || ctx->dram_enabled ||
+            ctx->wb_entries > 0 || ctx->mshr_entries > 0 || ctx->numa_enabled ||
+            ctx->way_predictor != WAY_PREDICT_NONE) {
+            fprintf(stderr, "A loop nest (-e) needs plain LRU and no trace, timing models or -C\n");
+            usage(argv);
+        }
+        analyzeNest(ctx);
+        return 0;
+    }
+
+    if (sweep_spec || remap_sweep_rule >= 0) {
+        if (!sweep_spec && (!sets_given || ctx->lines_per_set == 0 || ctx->block_bits == 0)) {
+            fprintf(stderr, "Missing required command line argument\n");
+            usage(argv);
+        }
+        if (access_trace == NULL || num_traces > 1 || ctx->num_partitions > 0 || ctx->ucp_mode || ctx->dram_enabled ||
+            ctx->cache_bytes > 0 || ctx->llc_enabled ||
+            ctx->wb_entries > 0 || ctx->mshr_entries > 0 || ctx->numa_enabled) {
+            fprintf(stderr, "A sweep needs a single trace and no partitions, timing models or -C\n");
+            usage(argv);
+        }
+        analyzeSweep(ctx, access_trace);
+        return 0;
+    }
+
+    if (mrc_samples > 0) {
+        if (access_trace == NULL) {
+            fprintf(stderr, "Missing required command line argument\n");
+            usage(argv);
+        }
+        analyzeMissRatioCurve(ctx, access_trace);
+        return 0;
+    }
+
+    if (ctx->cache_bytes > 0) {
+        unsigned long long set_bytes = (unsigned long long)ctx->lines_per_set << ctx->block_bits;
+        if (sets_given || ctx->lines_per_set < 1 || ctx->cache_bytes % set_bytes != 0 ||
+            ctx->cache_bytes / set_bytes > INT_MAX) {
+            fprintf(stderr, "-C needs -E and -b, no -s, and a whole number of sets\n");
+            exit(1);
+        }
+        sets_given = 1;
+    }
+
     // Validate that all required arguments have been supplied.
-    if (set_bits == 0 || lines_per_set == 0 || block_bits == 0 || access_trace == NULL) {
+    if (!sets_given || ctx->lines_per_set == 0 || ctx->block_bits == 0 || access_trace == NULL) {
         fprintf(stderr, "Missing required command line argument\n");
         usage(argv); // Print usage info and exit if missing arguments.
         exit(1);
     }
 
-    // Compute the number of sets and block size based on provided bits.
-    num_sets = (int)pow(2, set_bits);
-    block_size = (int)pow(2, block_bits);
+    for (int p = 0; p < ctx->num_partitions; p++) {
+        if (ctx->lines_per_set < 64 && (ctx->partitions[p].way_mask >> ctx->lines_per_set) != 0) {
+            fprintf(stderr, "Partition %d mask 0x%llx exceeds %d ways\n", p, ctx->partitions[p].way_mask, ctx->lines_per_set);
+            exit(1);
+        }
+    }
+    if (ctx->num_locks > 0 && ctx->lines_per_set > 64) {
+        fprintf(stderr, "Locking (-L) needs at most 64 ways\n");
+        exit(1);
+    }
+    if (ctx->ucp_mode && ctx->num_partitions == 0) {
+        fprintf(stderr, "UCP needs at least one partition rule (-P)\n");
+        exit(1);
+    }
+
+    if (slice_count > 1 && (ctx->replacement_policy != POLICY_LRU || ctx->dead_block_bypass || ctx->admission_mode ||
+                            ctx->num_partitions > 0 || num_traces > 1 || ctx->dram_enabled ||
+                            ctx->wb_entries > 0 || ctx->mshr_entries > 0 || ctx->numa_enabled ||
+                            ctx->way_predictor != WAY_PREDICT_NONE || ctx->llc_enabled)) {
+        fprintf(stderr, "Time slices (-j) need a single trace and plain LRU\n");
+        exit(1);
+    }
+
+    if (num_traces > 1) {
+        ctx->numa_config.region_mask = TRACE_ADDRESS_MASK; // -N regions match every trace of the mix.
+    }
 
-    // Initialize the cache, process the access trace, then clean up.
-    initializeCache();
-    analyzeTrace(access_trace);
-    clearCache();
+    // Initialize the cache and process the access trace.
+    initializeCache(ctx);
+    if (num_traces > 1) {
+        mixTraces(ctx);
+    } else if (slice_count > 1) {
+        analyzeTimeSlices(ctx, access_trace);
+    } else {
+        analyzeTrace(ctx, access_trace);
+    }
 
     // Output the simulation summary with performance metrics.
-    printSummary(hits, misses, evictions, evicted_dirty_bytes, active_dirty_bytes, repeated_accesses);
+    printSummary(ctx->hits, ctx->misses, ctx->evictions, ctx->evicted_dirty_bytes, ctx->active_dirty_bytes, ctx->repeated_accesses);
+
+    // Report replacement engine statistics when a non-default engine was used.
+    if (ctx->replacement_policy == POLICY_HAWKEYE) {
+        printf("optgen_hits:%d optgen_misses:%d\n", ctx->opt_hits, ctx->opt_misses);
+    }
+    if (ctx->dead_block_bypass) {
+        printf("bypasses:%d\n", ctx->bypasses);
+    }
+    if (ctx->admission_mode) {
+        printf("admission_rejects:%d\n", ctx->admission_rejects);
+    }
+    if (num_traces > 1) {
+        reportMix();
+    }
+    if (ctx->slice_stats) {
+        reportSlices(ctx);
+    }
+    if (ctx->way_predictor != WAY_PREDICT_NONE) {
+        unsigned long long predicted = ctx->wp_correct + ctx->wp_wrong;
+        printf("way_prediction:%s correct:%llu wrong:%llu accuracy:%.2f%% effective_hit_latency:%.3f ways_read:%.2f/%d\n",
+               way_predictor_names[ctx->way_predictor], ctx->wp_correct, ctx->wp_wrong,
+               predicted ? 100.0 * ctx->wp_correct / predicted : 0.0,
+               predicted ? WAY_PREDICT_HIT_CYCLES + (double)WAY_PREDICT_MISS_CYCLES * ctx->wp_wrong / predicted : 0.0,
+               predicted + ctx->misses ? (double)ctx->wp_ways_read / (predicted + ctx->misses) : 0.0, ctx->lines_per_set);
+    }
+    if (ctx->num_locks > 0) {
+        int capacity = ctx->num_sets * ctx->lines_per_set;
+        unsigned long long other_hits = ctx->hits - ctx->lock_hits;
+        unsigned long long other_accesses = other_hits + ctx->misses;
+        printf("locked_lines:%d (%.2f%% of %d) locked_hits:%llu lock_bypasses:%llu\n", ctx->locked_lines,
+               100.0 * ctx->locked_lines / capacity, capacity, ctx->lock_hits, ctx->lock_bypasses);
+        printf("unlocked_lines:%d other_hits:%llu other_misses:%d other_miss_rate:%.4f\n", capacity - ctx->locked_lines,
+               other_hits, ctx->misses, other_accesses ? (double)ctx->misses / other_accesses : 0.0);
+    }
+    if (ctx->nt_stores > 0) {
+        printf("streaming_stores:%llu invalidated:%llu fills_avoided:%llu evictions_avoided:%llu\n", ctx->nt_stores,
+               ctx->nt_invalidated, ctx->nt_fills_avoided, ctx->nt_evictions_avoided);
+    }
+    if (ctx->wb_entries > 0) {
+        while (ctx->wb_count > 0) {
+            wbRetire(ctx); // Whatever is still buffered reaches memory at the end of the run.
+        }
+        printf("write_buffer_inserts:%llu coalesced:%llu (%.2f%%) forwards:%llu full_stalls:%llu stall_cycles:%llu\n",
+               ctx->wb_inserts, ctx->wb_coalesced, ctx->wb_inserts ? 100.0 * ctx->wb_coalesced / ctx->wb_inserts : 0.0,
+               ctx->wb_forwards, ctx->wb_full_stalls, ctx->wb_stall_cycles);
+    }
+    if (ctx->mshr_entries > 0) {
+        if (ctx->dram) {
+            dramFinish(ctx->dram);
+        }
+        mshrRetire(ctx, ULLONG_MAX);
+        printf("mshr_primary:%llu merged:%llu full_stalls:%llu stall_cycles:%llu mlp:%.2f\n", ctx->mshr_primary,
+               ctx->mshr_merged, ctx->mshr_full_stalls, ctx->mshr_stall_cycles,
+               ctx->mshr_busy_cycles ? (double)ctx->mshr_miss_cycles / ctx->mshr_busy_cycles : 0.0);
+    }
+    if (ctx->numa) {
+        reportNuma(ctx);
+    }
+    if (ctx->dram) {
+        dramFinish(ctx->dram);
+        const dram_stats_t* dram = dramStats(ctx->dram);
+        unsigned long long accesses = dram->row_hits + dram->row_empty + dram->row_conflicts;
+        printf("dram_reads:%llu dram_writes:%llu row_hit_rate:%.2f%% bank_conflicts:%llu avg_miss_latency:%.1f\n",
+               dram->reads, dram->writes, accesses ? 100.0 * dram->row_hits / accesses : 0.0, dram->row_conflicts,
+               dram->reads ? (double)dram->read_latency / dram->reads : 0.0);
+        printf("dram_queue_stall_cycles:%llu cycles:%llu\n", dram->stall_cycles,
+               dram->last_cycle > ctx->core_cycle ? dram->last_cycle : ctx->core_cycle);
+    }
+    for (int p = 0; p < ctx->num_partitions + (ctx->num_partitions > 0); p++) {
+        int accesses = ctx->partitions[p].hits + ctx->partitions[p].misses;
+        printf("partition:%d hits:%d misses:%d hit_rate:%.2f%%\n", p, ctx->partitions[p].hits,
+               ctx->partitions[p].misses, accesses ? 100.0 * ctx->partitions[p].hits / accesses : 0.0);
+    }
+    if (ctx->ucp_mode) {
+        reportUcpAllocation(ctx);
+    }
+    if (ctx->replacement_policy == POLICY_DIP || ctx->replacement_policy == POLICY_DRRIP) {
+        printf("psel:%u final_winner:%s epochs_%s:%d epochs_%s:%d\n", ctx->psel,
+               policy_names[duelCandidate(ctx, ctx->psel > PSEL_MAX / 2)], policy_names[duelCandidate(ctx, 0)],
+               ctx->duel_epochs_won[0], policy_names[duelCandidate(ctx, 1)], ctx->duel_epochs_won[1]);
+    }
+
+    clearCache(ctx); // Clean up once every report has read the cache state.
     return 0;
 }
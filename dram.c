@@ -0,0 +1,341 @@
+/*
+ * dram.c - DRAM back end with an FR-FCFS memory controller
+ *
+ * A line address is split into channel, rank, bank, row and column by the
+ * configured mapping. Each bank remembers its open row and when it can take
+ * the next command, and each channel when its data bus is free. An access
+ * to the open row costs tCL; one to a precharged bank tRCD + tCL; one that
+ * must first close another row tRP + tRCD + tCL. With the closed-page
+ * policy every bank is precharged right after its access, so row hits
+ * never happen but conflicts never cost tRP either.
+ *
+ * Requests wait in a single controller queue. The controller issues at
+ * most one command per cycle and only to a bank that is ready, so while
+ * one bank is busy, requests to the others keep issuing. Among the
+ * arrived requests whose bank is ready it picks, first-ready
+ * first-come-first-served, the oldest that hits the open row, or else the
+ * oldest. The trace is open loop: the core issues an access every
+ * issue_cycles and only stalls when the queue is full.
+ */
+#include <stddef.h>
+#include <stdlib.h>
+#include <string.h>
+#include "dram.h"
+
+#define NO_ROW (~0ULL) /* open_row of a precharged bank */
+
+typedef struct dram_request {
+    unsigned long long arrival; /* cycle the request entered the queue */
+    unsigned long long row;     /* row within its bank */
+    int bank;                   /* flat bank index over channels and ranks */
+    int channel;                /* channel of the bank */
+    int is_write;               /* writeback rather than a fill */
+    unsigned long long* completion; /* where to store the completion cycle, or NULL */
+} dram_request_t;
+
+typedef struct dram_bank {
+    unsigned long long open_row; /* row held in the row buffer, or NO_ROW */
+    unsigned long long ready;    /* cycle the bank can take its next access */
+} dram_bank_t;
+
+struct dram {
+    dram_config_t config;
+    int line_bytes;               /* bytes per request */
+    unsigned long long columns;   /* lines per row */
+    dram_bank_t* banks;           /* channels * ranks * banks */
+    unsigned long long* bus_free; /* per channel: cycle the data bus frees up */
+    dram_request_t* queue;        /* pending requests in arrival order */
+    int queued;                   /* requests in the queue */
+    unsigned long long now;       /* controller time: the next free command slot */
+    dram_stats_t stats;
+};
+
+/*
+ * dramDefaults - One channel, one rank, 16 banks of 8 KiB rows, open page
+ */
+void dramDefaults(dram_config_t* config)
+{
+    config->channels = 1;
+    config->ranks = 1;
+    config->banks = 16;
+    config->row_bytes = 8192;
+    config->mapping = DRAM_MAP_PAGE;
+    config->xor_banks = 0;
+    config->open_page = 1;
+    config->queue_depth = 32;
+    config->tCL = 16;
+    config->tRCD = 16;
+    config->tRP = 16;
+    config->tBURST = 4;
+    config->issue_cycles = 2;
+}
+
+/*
+ * dramConfigure - Parse key=value settings on top of the current ones
+ */
+int dramConfigure(dram_config_t* config, char* spec)
+{
+    static const struct {
+        const char* key;
+        size_t offset;
+        int min; /* sizes must be positive, timings may be zero */
+    } numbers[] = {
+        {"channels", offsetof(dram_config_t, channels), 1}, {"ranks", offsetof(dram_config_t, ranks), 1},
+        {"banks", offsetof(dram_config_t, banks), 1},       {"row", offsetof(dram_config_t, row_bytes), 1},
+        {"queue", offsetof(dram_config_t, queue_depth), 1}, {"tCL", offsetof(dram_config_t, tCL), 0},
+        {"tRCD", offsetof(dram_config_t, tRCD), 0},         {"tRP", offsetof(dram_config_t, tRP), 0},
+        {"tBURST", offsetof(dram_config_t, tBURST), 0},     {"issue", offsetof(dram_config_t, issue_cycles), 0},
+    };
+
+    for (char* item = strtok(spec, ","); item; item = strtok(NULL, ",")) {
+        char* value = strchr(item, '=');
+        int known = 0;
+        if (!value)
+            return 0;
+        *value++ = '\0';
+        for (size_t i = 0; i < sizeof(numbers) / sizeof(numbers[0]); i++) {
+            if (strcmp(item, numbers[i].key) == 0) {
+                int number = atoi(value);
+                if (number < numbers[i].min)
+                    return 0;
+                *(int*)((char*)config + numbers[i].offset) = number;
+                known = 1;
+            }
+        }
+        if (strcmp(item, "page") == 0) {
+            if (strcmp(value, "open") != 0 && strcmp(value, "closed") != 0)
+                return 0;
+            config->open_page = strcmp(value, "open") == 0;
+            known = 1;
+        } else if (strcmp(item, "map") == 0) {
+            if (strcmp(value, "page") != 0 && strcmp(value, "line") != 0)
+                return 0;
+            config->mapping = strcmp(value, "page") == 0 ? DRAM_MAP_PAGE : DRAM_MAP_LINE;
+            known = 1;
+        } else if (strcmp(item, "xor") == 0) {
+            config->xor_banks = atoi(value) != 0;
+            known = 1;
+        }
+        if (!known)
+            return 0;
+    }
+    return 1;
+}
+
+/*
+ * dramCreate - Allocate the banks, buses and queue, all idle
+ */
+dram_t* dramCreate(const dram_config_t* config, int line_bytes)
+{
+    dram_t* dram = calloc(1, sizeof(dram_t));
+    int num_banks = config->channels * config->ranks * config->banks;
+
+    dram->config = *config;
+    dram->line_bytes = line_bytes;
+    dram->columns = config->row_bytes > line_bytes ? config->row_bytes / line_bytes : 1;
+    dram->banks = malloc(sizeof(dram_bank_t) * num_banks);
+    for (int i = 0; i < num_banks; i++) {
+        dram->banks[i].open_row = NO_ROW;
+        dram->banks[i].ready = 0;
+    }
+    dram->bus_free = calloc(config->channels, sizeof(unsigned long long));
+    dram->queue = malloc(sizeof(dram_request_t) * config->queue_depth);
+    return dram;
+}
+
+/*
+ * dramDestroy - Free a DRAM model
+ */
+void dramDestroy(dram_t* dram)
+{
+    free(dram->banks);
+    free(dram->bus_free);
+    free(dram->queue);
+    free(dram);
+}
+
+/*
+ * decode - Split an address into the coordinates of a request
+ */
+static void decode(const dram_t* dram, unsigned long long address, dram_request_t* request)
+{
+    const dram_config_t* c = &dram->config;
+    unsigned long long line = address / dram->line_bytes;
+    int channel, rank, bank;
+
+    if (c->mapping == DRAM_MAP_PAGE) {
+        line /= dram->columns;
+        channel = line % c->channels;
+        line /= c->channels;
+        bank = line % c->banks;
+        line /= c->banks;
+        rank = line % c->ranks;
+        line /= c->ranks;
+    } else {
+        channel = line % c->channels;
+        line /= c->channels;
+        bank = line % c->banks;
+        line /= c->banks;
+        rank = line % c->ranks;
+        line /= c->ranks;
+        line /= dram->columns;
+    }
+    if (c->xor_banks)
+        bank = (bank ^ (int)(line % c->banks)) % c->banks; /* spreads rows that collide on one bank */
+    request->row = line;
+    request->channel = channel;
+    request->bank = (channel * c->ranks + rank) * c->banks + bank;
+}
+
+/*
+ * issue - Serve one queued request and remove it from the queue
+ */
+static void issue(dram_t* dram, int slot)
+{
+    const dram_config_t* c = &dram->config;
+    dram_request_t request = dram->queue[slot];
+    dram_bank_t* bank = &dram->banks[request.bank];
+    unsigned long long start = dram->now > bank->ready ? dram->now : bank->ready;
+    unsigned long long data;
+
+    if (bank->open_row == request.row) {
+        dram->stats.row_hits++;
+        data = start + c->tCL;
+    } else if (bank->open_row == NO_ROW) {
+        dram->stats.row_empty++;
+        data = start + c->tRCD + c->tCL;
+    } else {
+        dram->stats.row_conflicts++;
+        data = start + c->tRP + c->tRCD + c->tCL;
+    }
+    if (data < dram->bus_free[request.channel])
+        data = dram->bus_free[request.channel]; /* wait for the data bus */
+    dram->bus_free[request.channel] = data + c->tBURST;
+
+    if (c->open_page) {
+        bank->open_row = request.row;
+        bank->ready = data;
+    } else {
+        bank->open_row = NO_ROW;
+        bank->ready = data + c->tBURST + c->tRP; /* auto-precharge after the burst */
+    }
+    if (request.is_write) {
+        dram->stats.writes++;
+    } else {
+        dram->stats.reads++;
+        dram->stats.read_latency += data + c->tBURST - request.arrival;
+    }
+    if (request.completion)
+        *request.completion = data + c->tBURST;
+    if (data + c->tBURST > dram->stats.last_cycle)
+        dram->stats.last_cycle = data + c->tBURST;
+
+    /* The command bus takes the next command one cycle later, for any bank */
+    dram->now = start + 1;
+    memmove(&dram->queue[slot], &dram->queue[slot + 1], sizeof(dram_request_t) * (dram->queued - slot - 1));
+    dram->queued--;
+}
+
+/*
+ * nextIssue - Earliest cycle, not before the controller's time, at which
+ *     some queued request has arrived and its bank is ready
+ */
+static unsigned long long nextIssue(const dram_t* dram)
+{
+    unsigned long long next = ~0ULL;
+
+    for (int i = 0; i < dram->queued; i++) {
+        unsigned long long ready = dram->banks[dram->queue[i].bank].ready;
+        unsigned long long at = dram->queue[i].arrival > ready ? dram->queue[i].arrival : ready;
+        if (at < next)
+            next = at;
+    }
+    return next > dram->now ? next : dram->now;
+}
+
+/*
+ * pick - FR-FCFS among the arrived requests whose bank is ready: the
+ *     oldest row hit, else the oldest; -1 if none can issue now
+ */
+static int pick(const dram_t* dram)
+{
+    int oldest = -1;
+
+    for (int i = 0; i < dram->queued; i++) {
+        const dram_bank_t* bank = &dram->banks[dram->queue[i].bank];
+        if (dram->queue[i].arrival > dram->now || bank->ready > dram->now)
+            continue;
+        if (bank->open_row == dram->queue[i].row)
+            return i;
+        if (oldest < 0)
+            oldest = i;
+    }
+    return oldest;
+}
+
+/*
+ * dramAdvance - Issue every request the controller can start before cycle
+ */
+void dramAdvance(dram_t* dram, unsigned long long cycle)
+{
+    while (dram->queued > 0) {
+        unsigned long long next = nextIssue(dram);
+        if (next >= cycle)
+            return; /* a request arriving by then may still go first */
+        dram->now = next;
+        issue(dram, pick(dram));
+    }
+}
+
+/*
+ * dramStep - Issue the next request even if its turn is in the future
+ */
+int dramStep(dram_t* dram)
+{
+    if (dram->queued == 0)
+        return 0;
+    dram->now = nextIssue(dram);
+    issue(dram, pick(dram));
+    return 1;
+}
+
+/*
+ * dramAccess - Queue a request, stalling the core while the queue is full
+ */
+unsigned long long dramAccess(dram_t* dram, unsigned long long address, int is_write,
+                              unsigned long long cycle, unsigned long long* completion)
+{
+    dram_request_t* request;
+
+    dramAdvance(dram, cycle);
+    if (dram->queued == dram->config.queue_depth) {
+        /* Back-pressure: the request enters once the next one has been issued */
+        dramStep(dram);
+        if (dram->now > cycle) {
+            dram->stats.stall_cycles += dram->now - cycle;
+            cycle = dram->now;
+        }
+    }
+    request = &dram->queue[dram->queued++];
+    decode(dram, address, request);
+    request->arrival = cycle;
+    request->is_write = is_write;
+    request->completion = completion;
+    return cycle;
+}
+
+/*
+ * dramFinish - Drain the queue
+ */
+void dramFinish(dram_t* dram)
+{
+    dramAdvance(dram, ~0ULL);
+}
+
+/*
+ * dramStats - Totals so far
+ */
+const dram_stats_t* dramStats(const dram_t* dram)
+{
+    return &dram->stats;
+}
@@ -0,0 +1,82 @@
+/*
+ * dram.h - DRAM back end: channel/rank/bank address mapping, row buffers
+ *     and an FR-FCFS memory controller with configurable timings
+ */
+
+#ifndef DRAM_H
+#define DRAM_H
+
+/* How a line address is split into DRAM coordinates, lowest bits first */
+typedef enum {
+    DRAM_MAP_PAGE, /* column, channel, bank, rank, row: a row's lines stay in one bank */
+    DRAM_MAP_LINE  /* channel, bank, rank, column, row: consecutive lines spread out */
+} dram_mapping_t;
+
+/* Organization, policies and timings; every time is in controller cycles */
+typedef struct dram_config {
+    int channels;           /* independent channels, each with its own data bus */
+    int ranks;              /* ranks per channel */
+    int banks;              /* banks per rank */
+    int row_bytes;          /* bytes in one row buffer */
+    dram_mapping_t mapping; /* address mapping scheme */
+    int xor_banks;          /* XOR the low row bits into the bank index */
+    int open_page;          /* keep rows open after an access (0: close them) */
+    int queue_depth;        /* requests the controller can hold */
+    int tCL;                /* column access to first data */
+    int tRCD;               /* activate to column access */
+    int tRP;                /* precharge to activate */
+    int tBURST;             /* data bus cycles per line */
+    int issue_cycles;       /* core cycles between two accesses of the trace */
+} dram_config_t;
+
+/* Running totals of a DRAM model */
+typedef struct dram_stats {
+    unsigned long long reads;          /* line fills */
+    unsigned long long writes;         /* writebacks */
+    unsigned long long row_hits;       /* accesses that found their row open */
+    unsigned long long row_empty;      /* accesses to a precharged bank */
+    unsigned long long row_conflicts;  /* accesses that had to close another row */
+    unsigned long long read_latency;   /* summed arrival-to-data cycles of the reads */
+    unsigned long long stall_cycles;   /* cycles requests waited for a queue slot */
+    unsigned long long last_cycle;     /* completion time of the last request */
+} dram_stats_t;
+
+typedef struct dram dram_t;
+
+/* Fill config with a single-channel DDR4-like default */
+void dramDefaults(dram_config_t* config);
+
+/*
+ * Apply a comma-separated list of key=value settings, e.g.
+ * "channels=2,page=closed,map=line,tCL=22". Returns 0 if one is invalid.
+ */
+int dramConfigure(dram_config_t* config, char* spec);
+
+/* Create an idle DRAM serving lines of line_bytes */
+dram_t* dramCreate(const dram_config_t* config, int line_bytes);
+
+/* Free a DRAM model */
+void dramDestroy(dram_t* dram);
+
+/*
+ * Send a request for the line holding address, arriving at cycle. Returns
+ * the cycle at which the controller queue accepted it, later than cycle
+ * when the queue was full. Unless completion is NULL, the cycle of the
+ * request's last data beat is stored there once the request is issued.
+ */
+unsigned long long dramAccess(dram_t* dram, unsigned long long address, int is_write,
+                              unsigned long long cycle, unsigned long long* completion);
+
+/* Issue every queued request the controller can start before cycle */
+void dramAdvance(dram_t* dram, unsigned long long cycle);
+
+/* Issue the next queued request whatever its time. Returns 0 if none is queued. */
+int dramStep(dram_t* dram);
+
+/* Serve every queued request */
+void dramFinish(dram_t* dram);
+
+/* Read the totals accumulated so far */
+const dram_stats_t* dramStats(const dram_t* dram);
+
+#endif /* DRAM_H */
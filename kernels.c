@@ -0,0 +1,337 @@
+/*
+ * kernels.c - GEMM, stencil and convolution kernels evaluated by
+ *     test-kernels alongside the transposes in trans.c
+ *
+ * Each function must have the prototype of its family (see cachelab.h):
+ * void gemm(int M, int N, int K, double A[M][K], double B[K][N], double C[M][N]);
+ * void stencil(int M, int N, float in[N][M], float out[N][M]);
+ * void conv(int M, int N, int K, float img[N][M], float filt[K][K],
+ *           float out[N-K+1][M-K+1], float work[(N-K+1)*(M-K+1)][K*K]);
+ *
+ * The layout families store their int matrices in a layout from layout.h:
+ * void f(int M, int N, int* A, int* B);
+ * where A holds N x M elements and B either the same matrix in another
+ * layout ("to-<layout>") or its M x N transpose ("transpose-<layout>").
+ */
+#include <stdio.h>
+#include <stdlib.h>
+#include "cachelab.h"
+#include "layout.h"
+
+#define GEMM_BLOCK 8
+
+/*
+ * gemm_naive - C = A * B with the textbook i-j-k loop order; B is
+ *     walked down its columns.
+ */
+char gemm_naive_desc[] = "GEMM, i-j-k loops";
+void gemm_naive(int M, int N, int K, double A[M][K], double B[K][N], double C[M][N])
+{
+    int i, j, k;
+
+    for (i = 0; i < M; i++) {
+        for (j = 0; j < N; j++) {
+            double sum = 0;
+            for (k = 0; k < K; k++)
+                sum += A[i][k] * B[k][j];
+            C[i][j] = sum;
+        }
+    }
+}
+
+/*
+ * gemm_blocked - C = A * B over GEMM_BLOCK x GEMM_BLOCK tiles of C and
+ *     A, with the i-k-j order inside a tile so B and C stream by rows.
+ */
+char gemm_blocked_desc[] = "GEMM, blocked i-k-j loops";
+void gemm_blocked(int M, int N, int K, double A[M][K], double B[K][N], double C[M][N])
+{
+    int ii, jj, kk, i, j, k;
+
+    for (i = 0; i < M; i++)
+        for (j = 0; j < N; j++)
+            C[i][j] = 0;
+
+    for (ii = 0; ii < M; ii += GEMM_BLOCK) {
+        for (kk = 0; kk < K; kk += GEMM_BLOCK) {
+            for (jj = 0; jj < N; jj += GEMM_BLOCK) {
+                for (i = ii; i < ii + GEMM_BLOCK && i < M; i++) {
+                    for (k = kk; k < kk + GEMM_BLOCK && k < K; k++) {
+                        double a = A[i][k];
+                        for (j = jj; j < jj + GEMM_BLOCK && j < N; j++)
+                            C[i][j] += a * B[k][j];
+                    }
+                }
+            }
+        }
+    }
+}
+
+/*
+ * stencil_rows - 5-point average sweeping the grid row by row
+ */
+char stencil_rows_desc[] = "5-point stencil, row-wise sweep";
+void stencil_rows(int M, int N, float in[N][M], float out[N][M])
+{
+    int i, j;
+
+    for (i = 0; i < N; i++) {
+        for (j = 0; j < M; j++) {
+            if (i == 0 || j == 0 || i == N - 1 || j == M - 1)
+                out[i][j] = in[i][j];
+            else
+                out[i][j] = 0.2f * (in[i][j] + in[i - 1][j] + in[i + 1][j] +
+                                    in[i][j - 1] + in[i][j + 1]);
+        }
+    }
+}
+
+/*
+ * stencil_cols - The same stencil sweeping column by column, which
+ *     touches a new line of each of three rows on every point.
+ */
+char stencil_cols_desc[] = "5-point stencil, column-wise sweep";
+void stencil_cols(int M, int N, float in[N][M], float out[N][M])
+{
+    int i, j;
+
+    for (j = 0; j < M; j++) {
+        for (i = 0; i < N; i++) {
+            if (i == 0 || j == 0 || i == N - 1 || j == M - 1)
+                out[i][j] = in[i][j];
+            else
+                out[i][j] = 0.2f * (in[i][j] + in[i - 1][j] + in[i + 1][j] +
+                                    in[i][j - 1] + in[i][j + 1]);
+        }
+    }
+}
+
+/*
+ * conv_direct - Direct convolution, the filter slides over the image
+ */
+char conv_direct_desc[] = "Convolution, direct";
+void conv_direct(int M, int N, int K, float img[N][M], float filt[K][K],
+                 float out[N - K + 1][M - K + 1], float work[][K * K])
+{
+    int i, j, u, v;
+
+    for (i = 0; i < N - K + 1; i++) {
+        for (j = 0; j < M - K + 1; j++) {
+            float sum = 0;
+            for (u = 0; u < K; u++)
+                for (v = 0; v < K; v++)
+                    sum += img[i + u][j + v] * filt[u][v];
+            out[i][j] = sum;
+        }
+    }
+}
+
+/*
+ * conv_im2col - Unfold every K x K patch of the image into a row of
+ *     work, then multiply the patch matrix by the flattened filter.
+ */
+char conv_im2col_desc[] = "Convolution, im2col + matrix-vector product";
+void conv_im2col(int M, int N, int K, float img[N][M], float filt[K][K],
+                 float out[N - K + 1][M - K + 1], float work[][K * K])
+{
+    int rows = N - K + 1, cols = M - K + 1;
+    int i, j, u, v, p;
+
+    for (i = 0; i < rows; i++)
+        for (j = 0; j < cols; j++)
+            for (u = 0; u < K; u++)
+                for (v = 0; v < K; v++)
+                    work[i * cols + j][u * K + v] = img[i + u][j + v];
+
+    for (p = 0; p < rows * cols; p++) {
+        float sum = 0;
+        for (u = 0; u < K; u++)
+            for (v = 0; v < K; v++)
+                sum += work[p][u * K + v] * filt[u][v];
+        out[p / cols][p % cols] = sum;
+    }
+}
+
+/*
+ * Layout families. Their oracles place every element with layoutOffset,
+ * and their dimensions must fill the layout without padding.
+ */
+
+/*
+ * Offsets worked out apart from layout.c. The oracles use layoutOffset and
+ * mortonEncode too, so without these a broken encoding would pass its
+ * own check.
+ */
+static const struct {
+    layout_t layout;
+    int rows, cols, row, col;
+    size_t offset;
+} known_offsets[] = {
+    {LAYOUT_TILED, 16, 16, 9, 3, 139},    /* tile (1, 0), row 1, column 3 */
+    {LAYOUT_TILED, 16, 24, 9, 19, 331},   /* tile (1, 2) of three per tile row */
+    {LAYOUT_MORTON, 32, 32, 1, 0, 2},     /* row bits are the odd bits */
+    {LAYOUT_MORTON, 32, 32, 3, 5, 27},    /* 0b011011 */
+    {LAYOUT_MORTON, 32, 32, 21, 10, 614}, /* 0b1001100110 */
+    {LAYOUT_MORTON, 32, 32, 31, 0, 682},  /* 0b1010101010 */
+    {LAYOUT_HILBERT, 4, 4, 0, 1, 1},      /* the curve starts along row 0 */
+    {LAYOUT_HILBERT, 4, 4, 3, 0, 5},
+    {LAYOUT_HILBERT, 4, 4, 2, 2, 8},
+    {LAYOUT_HILBERT, 4, 4, 0, 3, 15},     /* and ends in the other corner of row 0 */
+    {LAYOUT_HILBERT, 8, 8, 5, 2, 29},
+    {LAYOUT_HILBERT, 8, 8, 7, 7, 42},
+};
+
+static void checkKnownOffsets(void)
+{
+    for (size_t k = 0; k < sizeof(known_offsets) / sizeof(known_offsets[0]); k++) {
+        size_t offset = layoutOffset(known_offsets[k].layout, known_offsets[k].rows, known_offsets[k].cols,
+                                     known_offsets[k].row, known_offsets[k].col);
+        if (offset != known_offsets[k].offset) {
+            printf("Error: %s offset of (%d, %d) in a %dx%d matrix is %zu, not %zu\n",
+                   layout_names[known_offsets[k].layout], known_offsets[k].row, known_offsets[k].col,
+                   known_offsets[k].rows, known_offsets[k].cols, offset, known_offsets[k].offset);
+            exit(1);
+        }
+    }
+}
+
+static void invokeLayout(kernel_impl_t impl, const kernel_dims_t* dims, void* operands[])
+{
+    ((void (*)(int, int, int*, int*))impl)(dims->M, dims->N, operands[0], operands[1]);
+}
+
+static void layoutTransposeOracle(layout_t layout, int M, int N, int* A, int* B)
+{
+    int i, j;
+    checkKnownOffsets();
+    for (i = 0; i < N; i++)
+        for (j = 0; j < M; j++)
+            B[layoutOffset(layout, M, N, j, i)] = A[layoutOffset(layout, N, M, i, j)];
+}
+
+static void layoutConvertOracle(layout_t layout, int M, int N, int* A, int* B)
+{
+    int i, j;
+    checkKnownOffsets();
+    for (i = 0; i < N; i++)
+        for (j = 0; j < M; j++)
+            B[layoutOffset(layout, N, M, i, j)] = A[i * M + j];
+}
+
+static void correctTiledTranspose(int M, int N, int* A, int* B)
+{
+    layoutTransposeOracle(LAYOUT_TILED, M, N, A, B);
+}
+
+static void correctMortonTranspose(int M, int N, int* A, int* B)
+{
+    layoutTransposeOracle(LAYOUT_MORTON, M, N, A, B);
+}
+
+static void correctHilbertTranspose(int M, int N, int* A, int* B)
+{
+    layoutTransposeOracle(LAYOUT_HILBERT, M, N, A, B);
+}
+
+static void correctToTiled(int M, int N, int* A, int* B)
+{
+    layoutConvertOracle(LAYOUT_TILED, M, N, A, B);
+}
+
+static void correctToMorton(int M, int N, int* A, int* B)
+{
+    layoutConvertOracle(LAYOUT_MORTON, M, N, A, B);
+}
+
+static void correctToHilbert(int M, int N, int* A, int* B)
+{
+    layoutConvertOracle(LAYOUT_HILBERT, M, N, A, B);
+}
+
+static int validTiled(const kernel_dims_t* dims)
+{
+    return dims->M % LAYOUT_TILE == 0 && dims->N % LAYOUT_TILE == 0;
+}
+
+/* Morton and Hilbert matrices without padding are power-of-two squares */
+static int validCurve(const kernel_dims_t* dims)
+{
+    return dims->M == dims->N && (dims->M & (dims->M - 1)) == 0;
+}
+
+#define LAYOUT_FAMILY(name, oracle, valid, rows, cols)                                    \
+    {name, 2,                                                                             \
+     {{"A", KERNEL_INT, KERNEL_IN, "N", "M"}, {"B", KERNEL_INT, KERNEL_OUT, rows, cols}}, \
+     invokeLayout, (kernel_impl_t)oracle, valid}
+
+static const kernel_desc_t layout_kernels[] = {
+    LAYOUT_FAMILY("transpose-tiled", correctTiledTranspose, validTiled, "M", "N"),
+    LAYOUT_FAMILY("transpose-morton", correctMortonTranspose, validCurve, "M", "N"),
+    LAYOUT_FAMILY("transpose-hilbert", correctHilbertTranspose, validCurve, "M", "N"),
+    LAYOUT_FAMILY("to-tiled", correctToTiled, validTiled, "N", "M"),
+    LAYOUT_FAMILY("to-morton", correctToMorton, validCurve, "N", "M"),
+    LAYOUT_FAMILY("to-hilbert", correctToHilbert, validCurve, "N", "M"),
+};
+
+/*
+ * tiled_transpose, morton_transpose, hilbert_transpose - Transposes
+ *     that read and write their matrices in the layout itself
+ */
+char tiled_transpose_desc[] = "Tile-major transpose, tile by tile";
+void tiled_transpose(int M, int N, int* A, int* B)
+{
+    layoutTranspose(LAYOUT_TILED, N, M, A, B);
+}
+
+char morton_transpose_desc[] = "Morton transpose, 4x4 blocks";
+void morton_transpose(int M, int N, int* A, int* B)
+{
+    layoutTranspose(LAYOUT_MORTON, N, M, A, B);
+}
+
+char hilbert_transpose_desc[] = "Hilbert transpose, along the curve";
+void hilbert_transpose(int M, int N, int* A, int* B)
+{
+    layoutTranspose(LAYOUT_HILBERT, N, M, A, B);
+}
+
+/*
+ * to_tiled, to_morton, to_hilbert - Conversions from row-major
+ */
+char to_tiled_desc[] = "Row-major to tile-major, row chunks";
+void to_tiled(int M, int N, int* A, int* B)
+{
+    layoutConvert(LAYOUT_ROW_MAJOR, LAYOUT_TILED, N, M, A, B);
+}
+
+char to_morton_desc[] = "Row-major to Morton, 4x4 blocks";
+void to_morton(int M, int N, int* A, int* B)
+{
+    layoutConvert(LAYOUT_ROW_MAJOR, LAYOUT_MORTON, N, M, A, B);
+}
+
+char to_hilbert_desc[] = "Row-major to Hilbert, along the curve";
+void to_hilbert(int M, int N, int* A, int* B)
+{
+    layoutConvert(LAYOUT_ROW_MAJOR, LAYOUT_HILBERT, N, M, A, B);
+}
+
+/*
+ * registerKernels - Register the kernels with the driver, next to the
+ *     transposes registered by registerFunctions() in trans.c
+ */
+void registerKernels()
+{
+    registerKernelFunction(&gemm_kernel, (kernel_impl_t)gemm_naive, gemm_naive_desc);
+    registerKernelFunction(&gemm_kernel, (kernel_impl_t)gemm_blocked, gemm_blocked_desc);
+    registerKernelFunction(&stencil_kernel, (kernel_impl_t)stencil_rows, stencil_rows_desc);
+    registerKernelFunction(&stencil_kernel, (kernel_impl_t)stencil_cols, stencil_cols_desc);
+    registerKernelFunction(&conv_kernel, (kernel_impl_t)conv_direct, conv_direct_desc);
+    registerKernelFunction(&conv_kernel, (kernel_impl_t)conv_im2col, conv_im2col_desc);
+    registerKernelFunction(&layout_kernels[0], (kernel_impl_t)tiled_transpose, tiled_transpose_desc);
+    registerKernelFunction(&layout_kernels[1], (kernel_impl_t)morton_transpose, morton_transpose_desc);
+    registerKernelFunction(&layout_kernels[2], (kernel_impl_t)hilbert_transpose, hilbert_transpose_desc);
+    registerKernelFunction(&layout_kernels[3], (kernel_impl_t)to_tiled, to_tiled_desc);
+    registerKernelFunction(&layout_kernels[4], (kernel_impl_t)to_morton, to_morton_desc);
+    registerKernelFunction(&layout_kernels[5], (kernel_impl_t)to_hilbert, to_hilbert_desc);
+}
@@ -0,0 +1,439 @@
+/*
+ * layout.c - Tile-major, Morton and Hilbert matrix layouts
+ *
+ * In all three, neighbours in both dimensions stay close in memory, so a
+ * transpose reads and writes short contiguous runs instead of walking one
+ * of its matrices with a stride of a whole row. A tile-major transpose
+ * maps each tile onto one tile of the result; a Morton one maps every
+ * aligned 4 x 4 block, 16 consecutive elements, onto another such block
+ * found by swapping the even and odd bits of its code.
+ *
+ * Whole tile rows and whole 4 x 4 Morton blocks move as vectors, Morton
+ * codes use pdep/pext on CPUs that have BMI2, and Hilbert conversions
+ * walk the curve recursively instead of encoding every element.
+ */
+#include <string.h>
+#include "layout.h"
+#ifdef __x86_64__
+#include <immintrin.h>
+#endif
+
+#define EVEN_BITS 0x55555555u /* column bits of a Morton code */
+#define ODD_BITS 0xaaaaaaaau  /* row bits of a Morton code */
+
+const char* layout_names[] = {"row-major", "tiled", "morton", "hilbert"};
+
+/* One row of a tile, and four consecutive ints: a row of a 4 x 4 block or a quarter of its Morton code range */
+typedef int tile_row_t __attribute__((vector_size(LAYOUT_TILE * sizeof(int))));
+typedef int quad_t __attribute__((vector_size(4 * sizeof(int))));
+
+/*
+ * tiles - Tiles needed to cover n elements
+ */
+static int tiles(int n)
+{
+    return (n + LAYOUT_TILE - 1) / LAYOUT_TILE;
+}
+
+/*
+ * side - Power-of-two side of the square a Morton or Hilbert matrix fills
+ */
+static unsigned int side(int rows, int cols)
+{
+    unsigned int n = 1;
+
+    while (n < (unsigned int)rows || n < (unsigned int)cols)
+        n <<= 1;
+    return n;
+}
+
+/*
+ * spread - Move the low 16 bits of x to the even bit positions
+ */
+static unsigned int spread(unsigned int x)
+{
+    x &= 0xffff;
+    x = (x | x << 8) & 0x00ff00ff;
+    x = (x | x << 4) & 0x0f0f0f0f;
+    x = (x | x << 2) & 0x33333333;
+    x = (x | x << 1) & 0x55555555;
+    return x;
+}
+
+/*
+ * compact - Gather the even bits of x into the low 16 bits
+ */
+static unsigned int compact(unsigned int x)
+{
+    x &= 0x55555555;
+    x = (x | x >> 1) & 0x33333333;
+    x = (x | x >> 2) & 0x0f0f0f0f;
+    x = (x | x >> 4) & 0x00ff00ff;
+    x = (x | x >> 8) & 0x0000ffff;
+    return x;
+}
+
+#ifdef __x86_64__
+/*
+ * hasBmi2 - Whether the CPU has pdep and pext; asked once
+ */
+static int hasBmi2(void)
+{
+#ifdef __BMI2__
+    return 1;
+#else
+    static int has = -1;
+
+    if (has < 0) {
+        __builtin_cpu_init();
+        has = __builtin_cpu_supports("bmi2") != 0;
+    }
+    return has;
+#endif
+}
+
+/*
+ * mortonEncodeBmi2, mortonDecodeBmi2 - One pdep or pext per coordinate;
+ *     compiled for BMI2 whatever the build flags, and called only if hasBmi2()
+ */
+__attribute__((target("bmi2"))) static unsigned int mortonEncodeBmi2(unsigned int row, unsigned int col)
+{
+    return _pdep_u32(col, EVEN_BITS) | _pdep_u32(row, ODD_BITS);
+}
+
+__attribute__((target("bmi2"))) static void mortonDecodeBmi2(unsigned int code, unsigned int* row,
+                                                              unsigned int* col)
+{
+    *col = _pext_u32(code, EVEN_BITS);
+    *row = _pext_u32(code, ODD_BITS);
+}
+#endif
+
+/*
+ * swapBits - Morton code of the transposed element
+ */
+static unsigned int swapBits(unsigned int code)
+{
+    return (code & EVEN_BITS) << 1 | (code >> 1 & EVEN_BITS);
+}
+
+/*
+ * mortonEncode - Interleave row and column bits
+ */
+unsigned int mortonEncode(unsigned int row, unsigned int col)
+{
+#ifdef __x86_64__
+    if (hasBmi2())
+        return mortonEncodeBmi2(row, col);
+#endif
+    return spread(col) | spread(row) << 1;
+}
+
+/*
+ * mortonDecode - Split a Morton code into row and column
+ */
+void mortonDecode(unsigned int code, unsigned int* row, unsigned int* col)
+{
+#ifdef __x86_64__
+    if (hasBmi2()) {
+        mortonDecodeBmi2(code, row, col);
+        return;
+    }
+#endif
+    *col = compact(code);
+    *row = compact(code >> 1);
+}
+
+/*
+ * rotate - Reflect and swap a quadrant of the Hilbert curve
+ */
+static void rotate(unsigned int n, unsigned int* x, unsigned int* y, unsigned int rx, unsigned int ry)
+{
+    if (ry == 0) {
+        unsigned int t;
+        if (rx == 1) {
+            *x = n - 1 - *x;
+            *y = n - 1 - *y;
+        }
+        t = *x;
+        *x = *y;
+        *y = t;
+    }
+}
+
+/*
+ * hilbertEncode - Distance of (x, y) along the curve filling an n x n square
+ */
+static size_t hilbertEncode(unsigned int n, unsigned int x, unsigned int y)
+{
+    size_t d = 0;
+
+    for (unsigned int s = n / 2; s > 0; s /= 2) {
+        unsigned int rx = (x & s) > 0, ry = (y & s) > 0;
+        d += (size_t)s * s * ((3 * rx) ^ ry);
+        rotate(n, &x, &y, rx, ry);
+    }
+    return d;
+}
+
+/*
+ * hilbertDecode - Point at distance d along the curve
+ */
+static void hilbertDecode(unsigned int n, size_t d, unsigned int* x, unsigned int* y)
+{
+    *x = *y = 0;
+    for (unsigned int s = 1; s < n; s *= 2, d /= 4) {
+        unsigned int rx = 1 & (d / 2), ry = 1 & (d ^ rx);
+        rotate(s, x, y, rx, ry);
+        *x += s * rx;
+        *y += s * ry;
+    }
+}
+
+/* A row-major matrix and its Hilbert copy, visited in curve order */
+typedef struct hilbert_walk {
+    const int* src;
+    int* dst;
+    int rows, cols;
+    int to_curve; /* copy row-major to Hilbert, or back */
+    size_t d;     /* curve position of the next cell */
+} hilbert_walk_t;
+
+/*
+ * hilbertVisit - Copy the element in cell (x, y) and step along the curve
+ */
+static inline void hilbertVisit(hilbert_walk_t* w, int x, int y)
+{
+    if (y < w->rows && x < w->cols) {
+        if (w->to_curve)
+            w->dst[w->d] = w->src[(size_t)y * w->cols + x];
+        else
+            w->dst[(size_t)y * w->cols + x] = w->src[w->d];
+    }
+    w->d++;
+}
+
+/*
+ * hilbertWalk - Visit an s x s square along its piece of the curve. Cell
+ *     (u, v) of the curve's own frame is (x + u * ax + v * bx, y + u * ay +
+ *     v * by); the quadrants are entered in the order hilbertEncode gives
+ *     them, with the frames its rotations imply. Squares that hold only
+ *     padding are skipped whole.
+ */
+static void hilbertWalk(hilbert_walk_t* w, int x, int y, int ax, int ay, int bx, int by, unsigned int s)
+{
+    int h = s / 2;
+    int min_x = x + (ax < 0 || bx < 0 ? 1 - (int)s : 0), min_y = y + (ay < 0 || by < 0 ? 1 - (int)s : 0);
+
+    if (min_x >= w->cols || min_y >= w->rows) {
+        w->d += (size_t)s * s;
+        return;
+    }
+    if (s == 2) {
+        hilbertVisit(w, x, y);
+        hilbertVisit(w, x + bx, y + by);
+        hilbertVisit(w, x + ax + bx, y + ay + by);
+        hilbertVisit(w, x + ax, y + ay);
+        return;
+    }
+    hilbertWalk(w, x, y, bx, by, ax, ay, h);
+    hilbertWalk(w, x + h * bx, y + h * by, ax, ay, bx, by, h);
+    hilbertWalk(w, x + h * (ax + bx), y + h * (ay + by), ax, ay, bx, by, h);
+    hilbertWalk(w, x + (s - 1) * ax + (h - 1) * bx, y + (s - 1) * ay + (h - 1) * by, -bx, -by, -ax, -ay, h);
+}
+
+/*
+ * layoutSize - Elements of a matrix, padding included
+ */
+size_t layoutSize(layout_t layout, int rows, int cols)
+{
+    size_t n = side(rows, cols);
+
+    switch (layout) {
+    case LAYOUT_TILED: return (size_t)tiles(rows) * tiles(cols) * LAYOUT_TILE * LAYOUT_TILE;
+    case LAYOUT_MORTON:
+    case LAYOUT_HILBERT: return n * n;
+    default: return (size_t)rows * cols;
+    }
+}
+
+/*
+ * layoutOffset - Position of one element
+ */
+size_t layoutOffset(layout_t layout, int rows, int cols, int row, int col)
+{
+    switch (layout) {
+    case LAYOUT_TILED:
+        return ((size_t)(row / LAYOUT_TILE) * tiles(cols) + col / LAYOUT_TILE) * LAYOUT_TILE * LAYOUT_TILE +
+               row % LAYOUT_TILE * LAYOUT_TILE + col % LAYOUT_TILE;
+    case LAYOUT_MORTON: return mortonEncode(row, col);
+    case LAYOUT_HILBERT: return hilbertEncode(side(rows, cols), col, row);
+    default: return (size_t)row * cols + col;
+    }
+}
+
+/*
+ * convertTiled - Between row-major and tiled, one tile row at a time: a
+ *     vector for a whole one, memcpy for the ragged last column of tiles
+ */
+static void convertTiled(int rows, int cols, const int* src, int* dst, int to_tiled)
+{
+    for (int r = 0; r < rows; r++) {
+        size_t tiled = (size_t)(r / LAYOUT_TILE) * tiles(cols) * LAYOUT_TILE * LAYOUT_TILE + r % LAYOUT_TILE * LAYOUT_TILE;
+        size_t linear = (size_t)r * cols;
+        const int* from = to_tiled ? &src[linear] : &src[tiled];
+        int* to = to_tiled ? &dst[tiled] : &dst[linear];
+        int c;
+
+        for (c = 0; c + LAYOUT_TILE <= cols; c += LAYOUT_TILE) {
+            tile_row_t v;
+            memcpy(&v, &from[to_tiled ? c : c * LAYOUT_TILE], sizeof(v));
+            memcpy(&to[to_tiled ? c * LAYOUT_TILE : c], &v, sizeof(v));
+        }
+        if (c < cols)
+            memcpy(&to[to_tiled ? c * LAYOUT_TILE : c], &from[to_tiled ? c : c * LAYOUT_TILE],
+                   sizeof(int) * (cols - c));
+    }
+}
+
+/*
+ * moveBlock - Move a 4 x 4 block between its four rows and its 16 Morton
+ *     elements. Both ways, the four output vectors are the low and high
+ *     halves of input vectors 0 and 1, then of 2 and 3.
+ */
+static void moveBlock(const int* src, size_t src_stride, int* dst, size_t dst_stride)
+{
+    const quad_t low = {0, 1, 4, 5}, high = {2, 3, 6, 7};
+    quad_t in[4], out[4];
+
+    for (int k = 0; k < 4; k++)
+        memcpy(&in[k], &src[k * src_stride], sizeof(quad_t));
+    out[0] = __builtin_shuffle(in[0], in[1], low);
+    out[1] = __builtin_shuffle(in[0], in[1], high);
+    out[2] = __builtin_shuffle(in[2], in[3], low);
+    out[3] = __builtin_shuffle(in[2], in[3], high);
+    for (int k = 0; k < 4; k++)
+        memcpy(&dst[k * dst_stride], &out[k], sizeof(quad_t));
+}
+
+/*
+ * convertMorton - Between row-major and Morton. Every aligned 4 x 4 block
+ *     is 16 consecutive Morton elements, so full blocks move as four
+ *     vectors; the ragged edge moves one element at a time.
+ */
+static void convertMorton(int rows, int cols, const int* src, int* dst, int to_morton)
+{
+    for (int r = 0; r < rows; r += 4) {
+        for (int c = 0; c < cols; c += 4) {
+            unsigned int base = mortonEncode(r, c);
+            if (r + 4 <= rows && c + 4 <= cols) {
+                size_t linear = (size_t)r * cols + c;
+                if (to_morton)
+                    moveBlock(&src[linear], cols, &dst[base], 4);
+                else
+                    moveBlock(&src[base], 4, &dst[linear], cols);
+                continue;
+            }
+            for (int row = r; row < r + 4 && row < rows; row++) {
+                for (int col = c; col < c + 4 && col < cols; col++) {
+                    size_t linear = (size_t)row * cols + col;
+                    size_t morton = mortonEncode(row, col);
+                    if (to_morton)
+                        dst[morton] = src[linear];
+                    else
+                        dst[linear] = src[morton];
+                }
+            }
+        }
+    }
+}
+
+/*
+ * layoutConvert - Copy a matrix into another layout
+ */
+void layoutConvert(layout_t from, layout_t to, int rows, int cols, const int* src, int* dst)
+{
+    if (from == to) {
+        memcpy(dst, src, sizeof(int) * layoutSize(from, rows, cols));
+    } else if (from == LAYOUT_ROW_MAJOR && (to == LAYOUT_TILED || to == LAYOUT_MORTON)) {
+        (to == LAYOUT_TILED ? convertTiled : convertMorton)(rows, cols, src, dst, 1);
+    } else if (to == LAYOUT_ROW_MAJOR && (from == LAYOUT_TILED || from == LAYOUT_MORTON)) {
+        (from == LAYOUT_TILED ? convertTiled : convertMorton)(rows, cols, src, dst, 0);
+    } else if ((from == LAYOUT_ROW_MAJOR && to == LAYOUT_HILBERT) || (from == LAYOUT_HILBERT && to == LAYOUT_ROW_MAJOR)) {
+        hilbert_walk_t walk = {src, dst, rows, cols, to == LAYOUT_HILBERT, 0};
+        unsigned int n = side(rows, cols);
+        if (n == 1)
+            hilbertVisit(&walk, 0, 0);
+        else
+            hilbertWalk(&walk, 0, 0, 1, 0, 0, 1, n);
+    } else if (from == LAYOUT_HILBERT) {
+        /* Read the source sequentially, decoding the curve */
+        unsigned int n = side(rows, cols), x, y;
+        for (size_t d = 0; d < (size_t)n * n; d++) {
+            hilbertDecode(n, d, &x, &y);
+            if ((int)y < rows && (int)x < cols)
+                dst[layoutOffset(to, rows, cols, y, x)] = src[d];
+        }
+    } else {
+        for (int r = 0; r < rows; r++)
+            for (int c = 0; c < cols; c++)
+                dst[layoutOffset(to, rows, cols, r, c)] = src[layoutOffset(from, rows, cols, r, c)];
+    }
+}
+
+/*
+ * layoutTranspose - Transpose within a layout
+ */
+void layoutTranspose(layout_t layout, int rows, int cols, const int* src, int* dst)
+{
+    unsigned int n = side(rows, cols), x, y;
+
+    switch (layout) {
+    case LAYOUT_TILED:
+        /* Tile (tr, tc) becomes tile (tc, tr) of the result, itself transposed */
+        for (int tr = 0; tr < tiles(rows); tr++) {
+            for (int tc = 0; tc < tiles(cols); tc++) {
+                const int* from = &src[((size_t)tr * tiles(cols) + tc) * LAYOUT_TILE * LAYOUT_TILE];
+                int* to = &dst[((size_t)tc * tiles(rows) + tr) * LAYOUT_TILE * LAYOUT_TILE];
+                for (int i = 0; i < LAYOUT_TILE; i++)
+                    for (int j = 0; j < LAYOUT_TILE; j++)
+                        to[j * LAYOUT_TILE + i] = from[i * LAYOUT_TILE + j];
+            }
+        }
+        break;
+    case LAYOUT_MORTON:
+        if (n < 4) {
+            for (unsigned int code = 0; code < n * n; code++)
+                dst[swapBits(code)] = src[code];
+            break;
+        }
+        /* Block codes keep their low four bits clear when swapped */
+        for (unsigned int block = 0; block < n * n; block += 16) {
+            unsigned int target = swapBits(block);
+            mortonDecode(block, &y, &x);
+            if ((int)y >= rows || (int)x >= cols)
+                continue; /* all padding */
+            /* Each 2 x 2 quarter is transposed in place, and the off-diagonal quarters trade places */
+            for (int k = 0; k < 4; k++) {
+                const quad_t swap = {0, 2, 1, 3};
+                quad_t q;
+                memcpy(&q, &src[block + 4 * k], sizeof(q));
+                q = __builtin_shuffle(q, swap);
+                memcpy(&dst[target + 4 * (k == 1 ? 2 : k == 2 ? 1 : k)], &q, sizeof(q));
+            }
+        }
+        break;
+    case LAYOUT_HILBERT:
+        for (size_t d = 0; d < (size_t)n * n; d++) {
+            hilbertDecode(n, d, &x, &y);
+            if ((int)y < rows && (int)x < cols)
+                dst[hilbertEncode(n, y, x)] = src[d];
+        }
+        break;
+    default:
+        for (int r = 0; r < rows; r++)
+            for (int c = 0; c < cols; c++)
+                dst[(size_t)c * rows + r] = src[(size_t)r * cols + c];
+        break;
+    }
+}
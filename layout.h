@@ -0,0 +1,47 @@
+/*
+ * layout.h - Matrix storage layouts other than row-major: tile-major,
+ *     Morton (Z-order) and Hilbert order, with conversions between them
+ *     and transposes that work in the layout itself
+ */
+
+#ifndef LAYOUT_H
+#define LAYOUT_H
+
+#include <stddef.h>
+
+/* How element (row, col) of a rows x cols int matrix is placed */
+typedef enum {
+    LAYOUT_ROW_MAJOR, /* row * cols + col */
+    LAYOUT_TILED,     /* LAYOUT_TILE x LAYOUT_TILE row-major tiles, stored row-major */
+    LAYOUT_MORTON,    /* column and row bits interleaved, column in the even bits */
+    LAYOUT_HILBERT    /* distance along the Hilbert curve */
+} layout_t;
+
+#define LAYOUT_TILE 8 /* tile side; 8 ints fill one 32-byte line */
+
+extern const char* layout_names[];
+
+/*
+ * Elements a rows x cols matrix takes in a layout. Tiled matrices are
+ * padded to whole tiles and Morton and Hilbert ones to a power-of-two
+ * square; the padding is left alone by the conversions.
+ */
+size_t layoutSize(layout_t layout, int rows, int cols);
+
+/* Position of element (row, col) */
+size_t layoutOffset(layout_t layout, int rows, int cols, int row, int col);
+
+/* Morton code of (row, col), and back; pdep/pext where the CPU has BMI2 */
+unsigned int mortonEncode(unsigned int row, unsigned int col);
+void mortonDecode(unsigned int code, unsigned int* row, unsigned int* col);
+
+/* Copy a rows x cols matrix from one layout into another */
+void layoutConvert(layout_t from, layout_t to, int rows, int cols, const int* src, int* dst);
+
+/*
+ * Write the transpose of the rows x cols matrix src, in the given layout,
+ * into dst, a cols x rows matrix in the same layout
+ */
+void layoutTranspose(layout_t layout, int rows, int cols, const int* src, int* dst);
+
+#endif /* LAYOUT_H */
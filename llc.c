@@ -0,0 +1,167 @@
+/*
+ * llc.c - Slice hashing and slice-distance latencies of a sliced LLC
+ *
+ * With a power-of-two slice count every slice bit is the parity of the
+ * address ANDed with one mask, the complex addressing of Intel's LLCs.
+ * Without masks, two to eight slices use the masks reverse-engineered for
+ * those parts; other counts hash the line number and take it modulo the
+ * slice count. Cores sit on a ring with one slice per stop, so a slice
+ * costs the base latency plus one hop per stop between it and the core,
+ * unless an explicit core-by-slice table is given.
+ */
+#include <stdlib.h>
+#include <string.h>
+#include "llc.h"
+
+/* Maurice et al., "Reverse Engineering Intel Last-Level Cache Complex Addressing" */
+static const unsigned long long default_masks[3] = {0x1b5f575440ULL, 0x2eb5faa880ULL, 0x3cccc93100ULL};
+
+/*
+ * llcDefaults - Four slices, default hash, 30 cycles plus 4 per ring hop
+ */
+void llcDefaults(llc_config_t* config)
+{
+    memset(config, 0, sizeof(*config));
+    config->slices = 4;
+    config->base_latency = 30;
+    config->hop_latency = 4;
+}
+
+/*
+ * parseTable - Read rows of '/'-separated cycles, rows separated by '+'.
+ *     Every row needs the same number of entries, which becomes the slice
+ *     count.
+ */
+static int parseTable(llc_config_t* config, const char* text)
+{
+    int row = 0, column = 0, columns = 0;
+    char* end;
+
+    memset(config->latency, 0, sizeof(config->latency));
+    for (;;) {
+        long cycles = strtol(text, &end, 10);
+        if (end == text || cycles < 0 || column == LLC_MAX_SLICES)
+            return 0;
+        config->latency[row][column++] = (int)cycles;
+        if (*end == '/') {
+            text = end + 1;
+            continue;
+        }
+        if (row > 0 && column != columns)
+            return 0;
+        columns = column;
+        if (*end == '\0')
+            break;
+        if (*end != '+' || ++row == LLC_MAX_CORES)
+            return 0;
+        column = 0;
+        text = end + 1;
+    }
+    config->cores = row + 1;
+    config->slices = columns;
+    config->num_masks = 0;
+    return 1;
+}
+
+/*
+ * parseMasks - Read hexadecimal hash masks separated by ':'
+ */
+static int parseMasks(llc_config_t* config, char* text)
+{
+    char* end;
+
+    config->num_masks = 0;
+    for (;;) {
+        if (config->num_masks == LLC_MAX_MASKS)
+            return 0;
+        config->masks[config->num_masks++] = strtoull(text, &end, 16);
+        if (end == text)
+            return 0;
+        if (*end == '\0')
+            break;
+        if (*end != ':')
+            return 0;
+        text = end + 1;
+    }
+    return 1;
+}
+
+/*
+ * llcConfigure - Parse key=value settings on top of the current ones
+ */
+int llcConfigure(llc_config_t* config, char* spec)
+{
+    for (char* item = strtok(spec, ","); item; item = strtok(NULL, ",")) {
+        char* value = strchr(item, '=');
+        if (!value)
+            return 0;
+        *value++ = '\0';
+        if (strcmp(item, "hash") == 0) {
+            if (!parseMasks(config, value))
+                return 0;
+            if (config->cores > 0 && (1 << config->num_masks) != config->slices)
+                return 0; /* the table fixed the slice count */
+            config->slices = 1 << config->num_masks;
+        } else if (strcmp(item, "table") == 0) {
+            int masks = config->num_masks;
+            if (!parseTable(config, value) || (masks > 0 && (1 << masks) != config->slices))
+                return 0;
+            config->num_masks = masks;
+        } else {
+            int number = atoi(value);
+            if (strcmp(item, "slices") == 0 && number >= 1 && number <= LLC_MAX_SLICES &&
+                (config->cores == 0 || number == config->slices)) {
+                if (number != config->slices)
+                    config->num_masks = 0; /* masks only fit the slice count they were given for */
+                config->slices = number;
+            } else if (strcmp(item, "base") == 0 && number >= 0) {
+                config->base_latency = number;
+            } else if (strcmp(item, "hop") == 0 && number >= 0) {
+                config->hop_latency = number;
+            } else {
+                return 0;
+            }
+        }
+    }
+    return 1;
+}
+
+/*
+ * llcSlice - XOR-hash the address onto a slice
+ */
+int llcSlice(const llc_config_t* config, unsigned long long address)
+{
+    const unsigned long long* masks = config->masks;
+    int num_masks = config->num_masks;
+    int slice = 0;
+
+    if (num_masks == 0) {
+        if ((config->slices & (config->slices - 1)) != 0 || config->slices > 8) {
+            unsigned long long h = (address >> 6) * 0x9e3779b97f4a7c15ULL;
+            return (int)((h ^ (h >> 29)) % config->slices);
+        }
+        masks = default_masks;
+        while ((1 << num_masks) < config->slices)
+            num_masks++;
+    }
+    for (int i = 0; i < num_masks; i++)
+        slice |= __builtin_parityll(address & masks[i]) << i;
+    return slice;
+}
+
+/*
+ * llcLatency - Table entry, or ring distance between core and slice stops
+ */
+int llcLatency(const llc_config_t* config, int core, int slice)
+{
+    int distance;
+
+    if (core < 0)
+        core = -core; /* thread IDs may be negative; numaAccess folds them the same way */
+    if (config->cores > 0)
+        return config->latency[core % config->cores][slice];
+    distance = abs(core % config->slices - slice);
+    if (config->slices - distance < distance)
+        distance = config->slices - distance;
+    return config->base_latency + config->hop_latency * distance;
+}
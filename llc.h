@@ -0,0 +1,45 @@
+/*
+ * llc.h - Sliced last-level cache: an XOR hash of the physical address
+ *     picks the slice of a line, and the latency of an access depends on
+ *     how far that slice is from the requesting core
+ */
+
+#ifndef LLC_H
+#define LLC_H
+
+#define LLC_MAX_SLICES 64 /* slices a model can have */
+#define LLC_MAX_MASKS 6   /* hash bits, for up to 64 power-of-two slices */
+#define LLC_MAX_CORES 16  /* rows of an explicit latency table */
+
+/* Slice selection and NUCA latencies; thread t runs on core |t| */
+typedef struct llc_config {
+    int slices;                        /* slices the sets are split into */
+    int num_masks;                     /* hash masks given, 0 for the default hash */
+    unsigned long long masks[LLC_MAX_MASKS]; /* bit i of the slice is the parity of address & masks[i] */
+    int base_latency;                  /* cycles to the slice next to the core */
+    int hop_latency;                   /* cycles per ring stop further away */
+    int cores;                         /* rows of the latency table, 0 for the ring */
+    int latency[LLC_MAX_CORES][LLC_MAX_SLICES]; /* cycles from core to slice */
+} llc_config_t;
+
+/*
+ * Fill config with four slices on a ring, hashed with the masks reported
+ * for Intel's 4-slice LLCs
+ */
+void llcDefaults(llc_config_t* config);
+
+/*
+ * Apply a comma-separated list of key=value settings: slices, hash (masks
+ * separated by ':'), base and hop (ring latencies), or table (rows of
+ * per-slice cycles separated by '+', entries by '/'). Returns 0 if one is
+ * invalid or the result is inconsistent.
+ */
+int llcConfigure(llc_config_t* config, char* spec);
+
+/* Slice of the line holding address */
+int llcSlice(const llc_config_t* config, unsigned long long address);
+
+/* Cycles for core to reach slice */
+int llcLatency(const llc_config_t* config, int core, int slice);
+
+#endif /* LLC_H */
@@ -0,0 +1,223 @@
+/*
+ * numa.c - NUMA placement model
+ *
+ * Every page that memory traffic touches is looked up in an open-addressing
+ * table of page numbers to home nodes. The first access places the page: on
+ * the node of the region that covers it, or else by the configured policy.
+ * First touch homes it with the accessing thread, so a page stays where the
+ * thread that initialized it runs, as Linux does by default.
+ */
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include "numa.h"
+
+#define EMPTY (~0ULL)    /* page slot with no page */
+#define INITIAL_SLOTS 1024
+
+struct numa {
+    numa_config_t config;
+    numa_region_t rest;                  /* accesses no region matched */
+    unsigned long long* pages;           /* page number per slot, or EMPTY */
+    signed char* homes;                  /* home node per slot */
+    unsigned long long slot_mask;        /* slots minus one */
+    unsigned long long used;             /* pages placed */
+    unsigned long long node_pages[NUMA_MAX_NODES];
+};
+
+/*
+ * numaDefaults - Two nodes, first touch, 4 KiB pages, 100/160 cycles
+ */
+void numaDefaults(numa_config_t* config)
+{
+    memset(config, 0, sizeof(*config));
+    config->nodes = 2;
+    config->policy = NUMA_FIRST_TOUCH;
+    config->page_bytes = 4096;
+    config->local_latency = 100;
+    config->remote_latency = 160;
+    config->region_mask = ~0ULL;
+}
+
+/*
+ * numaConfigure - Parse a key=value list or a region
+ */
+int numaConfigure(numa_config_t* config, char* spec)
+{
+    char* dash;
+    unsigned long long start = strtoull(spec, &dash, 0);
+
+    /* Addresses are read like the other range options: decimal, or hex with 0x */
+    if (dash != spec && *dash == '-') {
+        char *rest, *node_end;
+        unsigned long long end = strtoull(dash + 1, &rest, 0);
+        long node = -1;
+        if (rest == dash + 1 || (*rest != '\0' && *rest != '='))
+            return 0;
+        if (*rest == '=') {
+            node = strtol(rest + 1, &node_end, 10);
+            if (node_end == rest + 1 || *node_end != '\0')
+                return 0;
+        }
+        if (end <= start || config->num_regions == NUMA_MAX_REGIONS || node < -1 || node >= NUMA_MAX_NODES)
+            return 0;
+        numa_region_t* region = &config->regions[config->num_regions++];
+        memset(region, 0, sizeof(*region));
+        region->start = start;
+        region->end = end;
+        region->node = (int)node;
+        return 1;
+    }
+
+    for (char* item = strtok(spec, ","); item; item = strtok(NULL, ",")) {
+        char* value = strchr(item, '=');
+        if (!value)
+            return 0;
+        *value++ = '\0';
+        if (strcmp(item, "policy") == 0) {
+            if (strcmp(value, "first-touch") == 0)
+                config->policy = NUMA_FIRST_TOUCH;
+            else if (strcmp(value, "interleave") == 0)
+                config->policy = NUMA_INTERLEAVE;
+            else if (strcmp(value, "map") == 0)
+                config->policy = NUMA_NODE0;
+            else
+                return 0;
+        } else {
+            int number = atoi(value);
+            if (number < 1)
+                return 0;
+            if (strcmp(item, "nodes") == 0 && number <= NUMA_MAX_NODES)
+                config->nodes = number;
+            else if (strcmp(item, "page") == 0)
+                config->page_bytes = number;
+            else if (strcmp(item, "local") == 0)
+                config->local_latency = number;
+            else if (strcmp(item, "remote") == 0)
+                config->remote_latency = number;
+            else
+                return 0;
+        }
+    }
+    return 1;
+}
+
+/*
+ * numaCreate - Allocate an empty page table
+ */
+numa_t* numaCreate(const numa_config_t* config)
+{
+    numa_t* numa = calloc(1, sizeof(numa_t));
+    numa->config = *config;
+    numa->rest.node = -1;
+    numa->rest.end = ~0ULL;
+    numa->slot_mask = INITIAL_SLOTS - 1;
+    numa->pages = malloc(sizeof(unsigned long long) * INITIAL_SLOTS);
+    memset(numa->pages, 0xff, sizeof(unsigned long long) * INITIAL_SLOTS);
+    numa->homes = malloc(INITIAL_SLOTS);
+    return numa;
+}
+
+/*
+ * numaDestroy - Free a model
+ */
+void numaDestroy(numa_t* numa)
+{
+    free(numa->pages);
+    free(numa->homes);
+    free(numa);
+}
+
+static unsigned long long slotOf(const numa_t* numa, unsigned long long page)
+{
+    unsigned long long slot = (page * 0x9e3779b97f4a7c15ULL) >> 20 & numa->slot_mask;
+    while (numa->pages[slot] != EMPTY && numa->pages[slot] != page)
+        slot = (slot + 1) & numa->slot_mask;
+    return slot;
+}
+
+/*
+ * grow - Double the page table once it is half full
+ */
+static void grow(numa_t* numa)
+{
+    unsigned long long* old_pages = numa->pages;
+    signed char* old_homes = numa->homes;
+    unsigned long long old_slots = numa->slot_mask + 1;
+
+    numa->slot_mask = old_slots * 2 - 1;
+    numa->pages = malloc(sizeof(unsigned long long) * old_slots * 2);
+    memset(numa->pages, 0xff, sizeof(unsigned long long) * old_slots * 2);
+    numa->homes = malloc(old_slots * 2);
+    for (unsigned long long i = 0; i < old_slots; i++) {
+        if (old_pages[i] != EMPTY) {
+            unsigned long long slot = slotOf(numa, old_pages[i]);
+            numa->pages[slot] = old_pages[i];
+            numa->homes[slot] = old_homes[i];
+        }
+    }
+    free(old_pages);
+    free(old_homes);
+}
+
+/*
+ * numaAccess - Count an access and return its latency
+ */
+int numaAccess(numa_t* numa, unsigned long long address, int thread)
+{
+    const numa_config_t* c = &numa->config;
+    unsigned long long page = address / c->page_bytes;
+    unsigned long long slot = slotOf(numa, page);
+    numa_region_t* region = &numa->rest;
+    int thread_node = (thread < 0 ? -thread : thread) % c->nodes;
+    unsigned long long matched = address & c->region_mask;
+    int home;
+
+    for (int i = 0; i < c->num_regions; i++) {
+        if (matched >= c->regions[i].start && matched < c->regions[i].end) {
+            region = &numa->config.regions[i];
+            break;
+        }
+    }
+
+    if (numa->pages[slot] == EMPTY) {
+        if (region->node >= 0)
+            home = region->node % c->nodes;
+        else if (c->policy == NUMA_FIRST_TOUCH)
+            home = thread_node;
+        else if (c->policy == NUMA_INTERLEAVE)
+            home = page % c->nodes;
+        else
+            home = 0;
+        numa->pages[slot] = page;
+        numa->homes[slot] = (signed char)home;
+        numa->node_pages[home]++;
+        if (++numa->used * 2 > numa->slot_mask + 1)
+            grow(numa);
+    } else {
+        home = numa->homes[slot];
+    }
+
+    if (home == thread_node) {
+        region->local++;
+        return c->local_latency;
+    }
+    region->remote++;
+    return c->remote_latency;
+}
+
+/*
+ * numaRegion - Per-region counts; index num_regions is everything else
+ */
+const numa_region_t* numaRegion(const numa_t* numa, int i)
+{
+    return i < numa->config.num_regions ? &numa->config.regions[i] : &numa->rest;
+}
+
+/*
+ * numaPages - Pages homed on node
+ */
+unsigned long long numaPages(const numa_t* numa, int node)
+{
+    return numa->node_pages[node];
+}
@@ -0,0 +1,70 @@
+/*
+ * numa.h - NUMA placement model: pages of memory are homed on nodes by
+ *     first touch, interleaving or an explicit map, and every memory access
+ *     is local or remote to the node of the thread that makes it
+ */
+
+#ifndef NUMA_H
+#define NUMA_H
+
+#define NUMA_MAX_NODES 64   /* nodes a model can have */
+#define NUMA_MAX_REGIONS 16 /* address ranges that can be placed or reported */
+
+/* Where a page that no region places is homed */
+typedef enum {
+    NUMA_FIRST_TOUCH, /* on the node of the first thread to touch it */
+    NUMA_INTERLEAVE,  /* round-robin over the nodes, page by page */
+    NUMA_NODE0        /* on node 0, for explicit maps */
+} numa_policy_t;
+
+/* An address range: placed on a node, or only reported if node is -1 */
+typedef struct numa_region {
+    unsigned long long start;  /* first address */
+    unsigned long long end;    /* one past the last address */
+    int node;                  /* home node of the range, or -1 */
+    unsigned long long local;  /* accesses from a thread on the home node */
+    unsigned long long remote; /* accesses from a thread on another node */
+} numa_region_t;
+
+/* Organization, placement and latencies; threads run on node thread % nodes */
+typedef struct numa_config {
+    int nodes;                              /* sockets */
+    numa_policy_t policy;                   /* placement of pages no region places */
+    int page_bytes;                         /* placement granularity */
+    int local_latency;                      /* cycles of a local memory access */
+    int remote_latency;                     /* cycles of a remote memory access */
+    numa_region_t regions[NUMA_MAX_REGIONS]; /* the first matching region wins */
+    int num_regions;                        /* regions given */
+    unsigned long long region_mask;         /* address bits regions are matched on; the rest
+                                               only keep address spaces apart */
+} numa_config_t;
+
+typedef struct numa numa_t;
+
+/* Fill config with two nodes, first touch, 4 KiB pages */
+void numaDefaults(numa_config_t* config);
+
+/*
+ * Apply one setting: a comma-separated key=value list (nodes, policy,
+ * page, local, remote), or a region <start>-<end>[=<node>] whose bounds,
+ * as in csim's other range options, are decimal or 0x hex. Returns 0 if
+ * the setting is invalid.
+ */
+int numaConfigure(numa_config_t* config, char* spec);
+
+/* Create a model with no pages placed yet */
+numa_t* numaCreate(const numa_config_t* config);
+
+/* Free a model */
+void numaDestroy(numa_t* numa);
+
+/* Place the page of address if needed and count an access by thread. Returns its latency. */
+int numaAccess(numa_t* numa, unsigned long long address, int thread);
+
+/* Region i of the model, or the catch-all region of everything else when i is num_regions */
+const numa_region_t* numaRegion(const numa_t* numa, int i);
+
+/* Pages homed on a node so far */
+unsigned long long numaPages(const numa_t* numa, int node);
+
+#endif /* NUMA_H */
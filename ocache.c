@@ -0,0 +1,865 @@
+/*
+ * ocache.c - Software object cache with variable-size items and a byte capacity
+ *
+ * Objects live in a pool of entries found through an open-addressing hash
+ * table keyed by the object key. Every policy keeps its queues as
+ * intrusive doubly linked lists of pool indices, so a request costs O(1)
+ * apart from the occasional growth of the pool or the table. Ghost
+ * entries remember recently evicted keys without holding their bytes.
+ */
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include "ocache.h"
+
+#define NIL 0 /* pool index 0 is never used, so it serves as the null link */
+#define LFU_MAX_FREQ 64 /* LFU frequencies saturate here */
+#define NUM_LISTS (LFU_MAX_FREQ + 1)
+
+/* List roles shared by the policies; LFU uses list f for frequency f */
+#define L_NONE 0
+#define L_RECENT 1   /* LRU list, ARC T1, 2Q A1in, LIRS resident HIR queue, S3-FIFO small */
+#define L_FREQUENT 2 /* ARC T2, 2Q Am, LIRS LIR blocks, S3-FIFO main */
+#define L_GHOST 3    /* ARC B1, 2Q A1out, LIRS non-resident HIR, S3-FIFO ghost */
+#define L_GHOST2 4   /* ARC B2 */
+
+#define LIRS_STATUS_LIR 1 /* LIRS: block with a low inter-reference recency */
+#define LIRS_STATUS_HIR 0 /* LIRS: block with a high inter-reference recency */
+
+const char* ocache_policy_names[OC_NUM_POLICIES] = {"lru", "lfu", "arc", "2q", "lirs", "s3fifo"};
+
+typedef struct oc_entry {
+    unsigned long long key;
+    unsigned int size;   /* object size in bytes */
+    unsigned int prev;   /* link towards the head of the entry's list */
+    unsigned int next;   /* link towards the tail of the entry's list */
+    unsigned int sprev;  /* LIRS stack link towards the top */
+    unsigned int snext;  /* LIRS stack link towards the bottom */
+    unsigned char list;  /* list the entry is on, or L_NONE */
+    unsigned char freq;  /* LFU and S3-FIFO access frequency */
+    unsigned char status;   /* LIRS LIR or HIR status */
+    unsigned char in_stack; /* whether the entry is on the LIRS stack */
+} oc_entry_t;
+
+typedef struct oc_list {
+    unsigned int head;        /* most recently inserted */
+    unsigned int tail;        /* next to leave */
+    unsigned long long bytes; /* total size of the entries */
+    unsigned long long count; /* number of entries */
+} oc_list_t;
+
+/* An object an S3-FIFO eviction would move to the head of the main queue */
+typedef struct oc_lap {
+    unsigned int idx;
+    unsigned char freq; /* its frequency once moved */
+} oc_lap_t;
+
+struct ocache {
+    ocache_policy_t policy;
+    unsigned long long capacity; /* byte budget for resident objects */
+    unsigned long long used;     /* bytes of resident objects */
+    oc_entry_t* entries;         /* entry pool; entries[0] is the null entry */
+    unsigned int num_entries;    /* pool slots handed out so far */
+    unsigned int max_entries;    /* allocated pool slots */
+    unsigned int free_head;      /* recycled pool slots, linked through next */
+    unsigned int* table;         /* hash slots holding pool indices, NIL if empty */
+    unsigned long long table_mask; /* table size minus one */
+    unsigned long long table_used; /* occupied hash slots */
+    oc_list_t lists[NUM_LISTS];
+    oc_list_t stack;             /* LIRS recency stack, linked through sprev/snext */
+    unsigned long long arc_p;    /* ARC target size of T1 in bytes */
+    unsigned int lfu_min;        /* LFU lowest frequency that may be non-empty */
+    tinylfu_t* admission;        /* optional admission filter */
+    struct oc_lap* laps;         /* S3-FIFO objects given another lap during an admission walk */
+    size_t max_laps;             /* allocated laps */
+    ocache_stats_t stats;
+};
+
+/*
+ * hashKey - Finalizer of MurmurHash3, spreads keys over the table
+ */
+static unsigned long long hashKey(unsigned long long key)
+{
+    key ^= key >> 33;
+    key *= 0xff51afd7ed558ccdULL;
+    key ^= key >> 33;
+    key *= 0xc4ceb9fe1a85ec53ULL;
+    key ^= key >> 33;
+    return key;
+}
+
+static unsigned int hashFind(const ocache_t* c, unsigned long long key)
+{
+    unsigned long long slot = hashKey(key) & c->table_mask;
+    while (c->table[slot] != NIL) {
+        if (c->entries[c->table[slot]].key == key)
+            return c->table[slot];
+        slot = (slot + 1) & c->table_mask;
+    }
+    return NIL;
+}
+
+static void hashPlace(ocache_t* c, unsigned int idx)
+{
+    unsigned long long slot = hashKey(c->entries[idx].key) & c->table_mask;
+    while (c->table[slot] != NIL)
+        slot = (slot + 1) & c->table_mask;
+    c->table[slot] = idx;
+}
+
+static void hashInsert(ocache_t* c, unsigned int idx)
+{
+    if ((c->table_used + 1) * 2 > c->table_mask + 1) {
+        /* Keep the load factor under one half so probe runs stay short */
+        unsigned int* old = c->table;
+        unsigned long long old_size = c->table_mask + 1;
+        c->table_mask = old_size * 2 - 1;
+        c->table = calloc(old_size * 2, sizeof(unsigned int));
+        for (unsigned long long i = 0; i < old_size; i++)
+            if (old[i] != NIL)
+                hashPlace(c, old[i]);
+        free(old);
+    }
+    hashPlace(c, idx);
+    c->table_used++;
+}
+
+/*
+ * hashErase - Remove a key with backward-shift deletion, so lookups never
+ *     need tombstones
+ */
+static void hashErase(ocache_t* c, unsigned long long key)
+{
+    unsigned long long i = hashKey(key) & c->table_mask, j;
+    while (c->entries[c->table[i]].key != key)
+        i = (i + 1) & c->table_mask;
+    j = i;
+    for (;;) {
+        j = (j + 1) & c->table_mask;
+        if (c->table[j] == NIL)
+            break;
+        unsigned long long home = hashKey(c->entries[c->table[j]].key) & c->table_mask;
+        /* Entries whose home lies cyclically in (i, j] must stay put */
+        if (i <= j ? (i < home && home <= j) : (i < home || home <= j))
+            continue;
+        c->table[i] = c->table[j];
+        i = j;
+    }
+    c->table[i] = NIL;
+    c->table_used--;
+}
+
+static unsigned int allocEntry(ocache_t* c, unsigned long long key, unsigned int size)
+{
+    unsigned int idx;
+    if (c->free_head != NIL) {
+        idx = c->free_head;
+        c->free_head = c->entries[idx].next;
+    } else {
+        if (c->num_entries == c->max_entries) {
+            c->max_entries *= 2;
+            c->entries = realloc(c->entries, sizeof(oc_entry_t) * c->max_entries);
+        }
+        idx = c->num_entries++;
+    }
+    memset(&c->entries[idx], 0, sizeof(oc_entry_t));
+    c->entries[idx].key = key;
+    c->entries[idx].size = size;
+    hashInsert(c, idx);
+    return idx;
+}
+
+static void freeEntry(ocache_t* c, unsigned int idx)
+{
+    hashErase(c, c->entries[idx].key);
+    c->entries[idx].list = L_NONE;
+    c->entries[idx].next = c->free_head;
+    c->free_head = idx;
+}
+
+static void listPushHead(ocache_t* c, int list, unsigned int idx)
+{
+    oc_list_t* l = &c->lists[list];
+    oc_entry_t* e = &c->entries[idx];
+    e->list = list;
+    e->prev = NIL;
+    e->next = l->head;
+    if (l->head != NIL)
+        c->entries[l->head].prev = idx;
+    else
+        l->tail = idx;
+    l->head = idx;
+    l->bytes += e->size;
+    l->count++;
+}
+
+static void listRemove(ocache_t* c, unsigned int idx)
+{
+    oc_entry_t* e = &c->entries[idx];
+    oc_list_t* l = &c->lists[e->list];
+    if (e->prev != NIL)
+        c->entries[e->prev].next = e->next;
+    else
+        l->head = e->next;
+    if (e->next != NIL)
+        c->entries[e->next].prev = e->prev;
+    else
+        l->tail = e->prev;
+    l->bytes -= e->size;
+    l->count--;
+    e->list = L_NONE;
+}
+
+static void listMoveHead(ocache_t* c, int list, unsigned int idx)
+{
+    listRemove(c, idx);
+    listPushHead(c, list, idx);
+}
+
+static void stackPushTop(ocache_t* c, unsigned int idx)
+{
+    oc_entry_t* e = &c->entries[idx];
+    e->in_stack = 1;
+    e->sprev = NIL;
+    e->snext = c->stack.head;
+    if (c->stack.head != NIL)
+        c->entries[c->stack.head].sprev = idx;
+    else
+        c->stack.tail = idx;
+    c->stack.head = idx;
+}
+
+static void stackRemove(ocache_t* c, unsigned int idx)
+{
+    oc_entry_t* e = &c->entries[idx];
+    if (e->sprev != NIL)
+        c->entries[e->sprev].snext = e->snext;
+    else
+        c->stack.head = e->snext;
+    if (e->snext != NIL)
+        c->entries[e->snext].sprev = e->sprev;
+    else
+        c->stack.tail = e->sprev;
+    e->in_stack = 0;
+}
+
+static int isResident(const ocache_t* c, unsigned int idx)
+{
+    int list = c->entries[idx].list;
+    if (c->policy == OC_LFU)
+        return list != L_NONE;
+    return list == L_RECENT || list == L_FREQUENT;
+}
+
+/* Resident object leaves the cache; the caller decides where it goes next */
+static void evictResident(ocache_t* c, unsigned int idx)
+{
+    c->used -= c->entries[idx].size;
+    c->stats.evictions++;
+    listRemove(c, idx);
+}
+
+/* Drop the oldest ghosts of a list until it fits the given budget */
+static void trimGhosts(ocache_t* c, int list, unsigned long long max_bytes)
+{
+    while (c->lists[list].bytes > max_bytes) {
+        unsigned int victim = c->lists[list].tail;
+        listRemove(c, victim);
+        freeEntry(c, victim);
+    }
+}
+
+/*
+ * LRU
+ */
+static void lruMiss(ocache_t* c, unsigned int idx)
+{
+    while (c->used + c->entries[idx].size > c->capacity) {
+        unsigned int victim = c->lists[L_RECENT].tail;
+        evictResident(c, victim);
+        freeEntry(c, victim);
+    }
+    listPushHead(c, L_RECENT, idx);
+}
+
+/*
+ * LFU - frequencies saturate at LFU_MAX_FREQ, ties go to the least recent
+ */
+static void lfuHit(ocache_t* c, unsigned int idx)
+{
+    oc_entry_t* e = &c->entries[idx];
+    if (e->freq < LFU_MAX_FREQ)
+        e->freq++;
+    listMoveHead(c, e->freq, idx);
+}
+
+static void lfuMiss(ocache_t* c, unsigned int idx)
+{
+    while (c->used + c->entries[idx].size > c->capacity) {
+        while (c->lists[c->lfu_min].count == 0)
+            c->lfu_min++;
+        unsigned int victim = c->lists[c->lfu_min].tail;
+        evictResident(c, victim);
+        freeEntry(c, victim);
+    }
+    c->entries[idx].freq = 1;
+    c->lfu_min = 1;
+    listPushHead(c, 1, idx);
+}
+
+/*
+ * ARC - byte-weighted adaptive replacement, p is the T1 target in bytes
+ */
+static void arcReplace(ocache_t* c, unsigned int size, int in_b2)
+{
+    while (c->used + size > c->capacity) {
+        oc_list_t* t1 = &c->lists[L_RECENT];
+        unsigned int victim;
+        if (t1->count > 0 && (t1->bytes > c->arc_p || (in_b2 && t1->bytes == c->arc_p) ||
+                              c->lists[L_FREQUENT].count == 0)) {
+            victim = t1->tail;
+            evictResident(c, victim);
+            listPushHead(c, L_GHOST, victim);
+        } else {
+            victim = c->lists[L_FREQUENT].tail;
+            evictResident(c, victim);
+            listPushHead(c, L_GHOST2, victim);
+        }
+    }
+}
+
+/* T1 target after a hit on the ghost idx */
+static unsigned long long arcTarget(const ocache_t* c, unsigned int idx)
+{
+    unsigned long long b1 = c->lists[L_GHOST].bytes, b2 = c->lists[L_GHOST2].bytes;
+    unsigned int size = c->entries[idx].size;
+
+    if (c->entries[idx].list == L_GHOST) {
+        /* A recency ghost hit: T1 was too small */
+        unsigned long long delta = (b1 >= b2 || b1 == 0 ? 1 : b2 / b1) * size;
+        return c->arc_p + delta < c->capacity ? c->arc_p + delta : c->capacity;
+    }
+    /* A frequency ghost hit: T2 was too small */
+    unsigned long long delta = (b2 >= b1 || b2 == 0 ? 1 : b1 / b2) * size;
+    return c->arc_p > delta ? c->arc_p - delta : 0;
+}
+
+static void arcMiss(ocache_t* c, unsigned int idx, int ghost)
+{
+    oc_entry_t* e = &c->entries[idx];
+    unsigned long long b1 = c->lists[L_GHOST].bytes;
+    unsigned int size = e->size;
+
+    if (ghost) {
+        int in_b2 = e->list == L_GHOST2;
+        c->arc_p = arcTarget(c, idx);
+        listRemove(c, idx);
+        arcReplace(c, size, in_b2);
+        listPushHead(c, L_FREQUENT, idx);
+    } else {
+        /* Keep T1 + B1 within the capacity and the whole directory within twice it */
+        if (c->lists[L_RECENT].bytes + b1 + size > c->capacity)
+            trimGhosts(c, L_GHOST, c->capacity > c->lists[L_RECENT].bytes + size
+                                       ? c->capacity - c->lists[L_RECENT].bytes - size : 0);
+        arcReplace(c, size, 0);
+        unsigned long long directory = c->used + c->lists[L_GHOST].bytes + c->lists[L_GHOST2].bytes;
+        if (directory + size > 2 * c->capacity) {
+            unsigned long long others = c->used + c->lists[L_GHOST].bytes + size;
+            trimGhosts(c, L_GHOST2, others < 2 * c->capacity ? 2 * c->capacity - others : 0);
+        }
+        listPushHead(c, L_RECENT, idx);
+    }
+}
+
+/*
+ * 2Q - A1in holds a quarter of the bytes, A1out remembers half a cache of keys
+ */
+static void twoQReclaim(ocache_t* c, unsigned int size)
+{
+    while (c->used + size > c->capacity) {
+        unsigned int victim;
+        if (c->lists[L_RECENT].bytes > c->capacity / 4 || c->lists[L_FREQUENT].count == 0) {
+            victim = c->lists[L_RECENT].tail;
+            evictResident(c, victim);
+            listPushHead(c, L_GHOST, victim);
+            trimGhosts(c, L_GHOST, c->capacity / 2);
+        } else {
+            victim = c->lists[L_FREQUENT].tail;
+            evictResident(c, victim);
+            freeEntry(c, victim);
+        }
+    }
+}
+
+static void twoQMiss(ocache_t* c, unsigned int idx, int ghost)
+{
+    if (ghost) {
+        /* Seen again after leaving A1in: it is hot, promote to Am */
+        listRemove(c, idx);
+        twoQReclaim(c, c->entries[idx].size);
+        listPushHead(c, L_FREQUENT, idx);
+    } else {
+        twoQReclaim(c, c->entries[idx].size);
+        listPushHead(c, L_RECENT, idx);
+    }
+}
+
+/*
+ * LIRS - LIR blocks get 99% of the bytes, resident HIR blocks the rest
+ */
+static void lirsPrune(ocache_t* c)
+{
+    while (c->stack.tail != NIL && c->entries[c->stack.tail].status != LIRS_STATUS_LIR) {
+        unsigned int bottom = c->stack.tail;
+        stackRemove(c, bottom);
+        if (c->entries[bottom].list == L_GHOST) {
+            listRemove(c, bottom);
+            freeEntry(c, bottom);
+        }
+    }
+}
+
+static void lirsDemoteBottom(ocache_t* c)
+{
+    unsigned int bottom = c->stack.tail;
+    c->entries[bottom].status = LIRS_STATUS_HIR;
+    listMoveHead(c, L_RECENT, bottom);
+    stackRemove(c, bottom);
+    lirsPrune(c);
+}
+
+static void lirsBalance(ocache_t* c)
+{
+    while (c->lists[L_FREQUENT].bytes > c->capacity / 100 * 99 && c->lists[L_FREQUENT].count > 1)
+        lirsDemoteBottom(c);
+}
+
+static void lirsHit(ocache_t* c, unsigned int idx)
+{
+    oc_entry_t* e = &c->entries[idx];
+    if (e->status == LIRS_STATUS_LIR) {
+        int was_bottom = c->stack.tail == idx;
+        stackRemove(c, idx);
+        stackPushTop(c, idx);
+        if (was_bottom)
+            lirsPrune(c);
+    } else if (e->in_stack) {
+        /* Reused within the LIR recency: promote */
+        stackRemove(c, idx);
+        stackPushTop(c, idx);
+        c->entries[idx].status = LIRS_STATUS_LIR;
+        listMoveHead(c, L_FREQUENT, idx);
+        lirsBalance(c);
+    } else {
+        stackPushTop(c, idx);
+        listMoveHead(c, L_RECENT, idx);
+    }
+}
+
+static void lirsMiss(ocache_t* c, unsigned int idx, int ghost)
+{
+    unsigned int size = c->entries[idx].size;
+
+    if (ghost) {
+        /* Take the block off the stack first so pruning below cannot free it */
+        listRemove(c, idx);
+        stackRemove(c, idx);
+    }
+
+    while (c->used + size > c->capacity) {
+        if (c->lists[L_RECENT].count == 0) {
+            lirsDemoteBottom(c);
+            continue;
+        }
+        unsigned int victim = c->lists[L_RECENT].tail;
+        evictResident(c, victim);
+        if (c->entries[victim].in_stack) {
+            listPushHead(c, L_GHOST, victim); /* becomes a non-resident HIR block */
+        } else {
+            freeEntry(c, victim);
+        }
+    }
+
+    if (ghost) {
+        /* Its reuse distance was within the stack, so it becomes LIR */
+        stackPushTop(c, idx);
+        c->entries[idx].status = LIRS_STATUS_LIR;
+        listPushHead(c, L_FREQUENT, idx);
+        lirsBalance(c);
+    } else if (c->lists[L_FREQUENT].bytes + size <= c->capacity / 100 * 99) {
+        /* Cold cache: fill the LIR set first */
+        c->entries[idx].status = LIRS_STATUS_LIR;
+        stackPushTop(c, idx);
+        listPushHead(c, L_FREQUENT, idx);
+    } else {
+        c->entries[idx].status = LIRS_STATUS_HIR;
+        stackPushTop(c, idx);
+        listPushHead(c, L_RECENT, idx);
+    }
+
+    /* Bound the non-resident blocks kept on the stack */
+    while (c->lists[L_GHOST].count > c->lists[L_RECENT].count + c->lists[L_FREQUENT].count) {
+        unsigned int oldest = c->lists[L_GHOST].tail;
+        listRemove(c, oldest);
+        stackRemove(c, oldest);
+        freeEntry(c, oldest);
+    }
+    lirsPrune(c);
+}
+
+/*
+ * S3-FIFO - a small FIFO with 10% of the bytes filters one-hit wonders
+ */
+static void s3fifoEvictMain(ocache_t* c)
+{
+    for (;;) {
+        unsigned int victim = c->lists[L_FREQUENT].tail;
+        if (c->entries[victim].freq > 0) {
+            c->entries[victim].freq--;
+            listMoveHead(c, L_FREQUENT, victim);
+        } else {
+            evictResident(c, victim);
+            freeEntry(c, victim);
+            return;
+        }
+    }
+}
+
+static void s3fifoEvictSmall(ocache_t* c)
+{
+    while (c->lists[L_RECENT].count > 0) {
+        unsigned int victim = c->lists[L_RECENT].tail;
+        if (c->entries[victim].freq > 1) {
+            c->entries[victim].freq = 0;
+            listMoveHead(c, L_FREQUENT, victim);
+            continue;
+        }
+        evictResident(c, victim);
+        listPushHead(c, L_GHOST, victim);
+        trimGhosts(c, L_GHOST, c->capacity - c->capacity / 10);
+        return;
+    }
+}
+
+static void s3fifoMiss(ocache_t* c, unsigned int idx, int ghost)
+{
+    unsigned int size = c->entries[idx].size;
+    if (ghost)
+        listRemove(c, idx);
+    while (c->used + size > c->capacity) {
+        if (c->lists[L_RECENT].bytes >= c->capacity / 10 || c->lists[L_FREQUENT].count == 0)
+            s3fifoEvictSmall(c);
+        else
+            s3fifoEvictMain(c);
+    }
+    c->entries[idx].freq = 0;
+    listPushHead(c, ghost ? L_FREQUENT : L_RECENT, idx);
+}
+
+/*
+ * pushLap - Queue an object an S3-FIFO walk sends round the main queue again
+ */
+static void pushLap(ocache_t* c, size_t* count, unsigned int idx, unsigned char freq)
+{
+    if (*count == c->max_laps) {
+        c->max_laps = c->max_laps ? 2 * c->max_laps : 64;
+        c->laps = realloc(c->laps, sizeof(oc_lap_t) * c->max_laps);
+    }
+    c->laps[*count].idx = idx;
+    c->laps[(*count)++].freq = freq;
+}
+
+/* Position of a read-only walk over the victims of a miss */
+typedef struct oc_walk {
+    unsigned int recent, frequent;    /* next candidates from the tails */
+    unsigned long long recent_bytes;  /* bytes left on the recent list */
+    unsigned long long recent_count;  /* objects left on the recent list */
+    unsigned long long frequent_count; /* objects left on the frequent list */
+    unsigned long long arc_p;         /* ARC T1 target for this miss */
+    int in_b2;                        /* ARC: the missed key is a B2 ghost */
+    int list;                         /* LFU: frequency list being walked */
+    size_t laps, next_lap;            /* S3-FIFO: queued and consumed laps */
+    int in_small;                     /* S3-FIFO: draining the small queue until it evicts */
+} oc_walk_t;
+
+/* Take the next object from the tail of the recent list */
+static unsigned int takeRecent(ocache_t* c, oc_walk_t* w)
+{
+    unsigned int v = w->recent;
+    w->recent = c->entries[v].prev;
+    w->recent_bytes -= c->entries[v].size;
+    w->recent_count--;
+    return v;
+}
+
+/*
+ * nextVictim - The next object the miss handler would evict, or NIL. The
+ *     policy's choices are replayed on the walk's copies of the list
+ *     cursors and counters, never on the lists themselves.
+ */
+static unsigned int nextVictim(ocache_t* c, oc_walk_t* w)
+{
+    unsigned int v;
+
+    switch (c->policy) {
+    case OC_LFU:
+        while (w->frequent == NIL && w->list < LFU_MAX_FREQ)
+            w->frequent = c->lists[++w->list].tail;
+        v = w->frequent;
+        if (v != NIL)
+            w->frequent = c->entries[v].prev;
+        return v;
+    case OC_ARC:
+        if (w->recent_count > 0 && (w->recent_bytes > w->arc_p || (w->in_b2 && w->recent_bytes == w->arc_p) ||
+                                    w->frequent_count == 0))
+            return takeRecent(c, w);
+        break;
+    case OC_2Q:
+        if (w->recent_bytes > c->capacity / 4 || w->frequent_count == 0)
+            return w->recent_count > 0 ? takeRecent(c, w) : NIL;
+        break;
+    case OC_LIRS:
+        /* Resident HIR blocks first, then LIR blocks demoted from the stack bottom up */
+        if (w->recent_count > 0)
+            return takeRecent(c, w);
+        while (w->frequent != NIL && c->entries[w->frequent].status != LIRS_STATUS_LIR)
+            w->frequent = c->entries[w->frequent].sprev;
+        v = w->frequent;
+        if (v != NIL)
+            w->frequent = c->entries[v].sprev;
+        return v;
+    case OC_S3FIFO:
+        for (;;) {
+            unsigned char freq;
+            if (w->recent_count == 0 && w->frequent_count == 0)
+                return NIL;
+            if (w->recent_count > 0 &&
+                (w->in_small || w->recent_bytes >= c->capacity / 10 || w->frequent_count == 0)) {
+                /* Small queue: objects seen more than once move to main until one is evicted */
+                v = takeRecent(c, w);
+                w->in_small = c->entries[v].freq > 1;
+                if (!w->in_small)
+                    return v;
+                pushLap(c, &w->laps, v, 0);
+                w->frequent_count++;
+                continue;
+            }
+            w->in_small = 0;
+            /* Main queue: the original objects from the tail, then those sent round again */
+            if (w->frequent != NIL) {
+                v = w->frequent;
+                freq = c->entries[v].freq;
+                w->frequent = c->entries[v].prev;
+            } else {
+                v = c->laps[w->next_lap].idx;
+                freq = c->laps[w->next_lap++].freq;
+            }
+            if (freq == 0) {
+                w->frequent_count--;
+                return v;
+            }
+            pushLap(c, &w->laps, v, freq - 1);
+        }
+    default:
+        return takeRecent(c, w);
+    }
+
+    /* ARC and 2Q fall back to the frequent list */
+    v = w->frequent;
+    if (v != NIL) {
+        w->frequent = c->entries[v].prev;
+        w->frequent_count--;
+    }
+    return v;
+}
+
+/*
+ * admitOverVictims - Whether TinyLFU rates the missed key above every
+ *     object the miss would evict to make room for size bytes. idx is the
+ *     key's ghost entry or NIL. Nothing in the cache is changed.
+ */
+static int admitOverVictims(ocache_t* c, unsigned long long key, unsigned int idx, unsigned int size)
+{
+    unsigned long long freed = 0, needed = c->used + size - c->capacity;
+    oc_walk_t w;
+
+    memset(&w, 0, sizeof(w));
+    w.recent = c->lists[L_RECENT].tail;
+    w.recent_bytes = c->lists[L_RECENT].bytes;
+    w.recent_count = c->lists[L_RECENT].count;
+    w.frequent = c->policy == OC_LIRS ? c->stack.tail : c->lists[L_FREQUENT].tail;
+    w.frequent_count = c->lists[L_FREQUENT].count;
+    w.arc_p = c->arc_p;
+    if (c->policy == OC_LFU) {
+        w.list = c->lfu_min;
+        w.frequent = c->lists[w.list].tail;
+    } else if (c->policy == OC_ARC && idx != NIL) {
+        w.arc_p = arcTarget(c, idx);
+        w.in_b2 = c->entries[idx].list == L_GHOST2;
+    }
+
+    while (freed < needed) {
+        unsigned int victim = nextVictim(c, &w);
+        if (victim == NIL)
+            break;
+        if (!tinylfuAdmit(c->admission, key, c->entries[victim].key))
+            return 0;
+        freed += c->entries[victim].size;
+    }
+    return 1;
+}
+
+/*
+ * ocacheSetAdmission - Filter misses through TinyLFU before they may
+ *     displace a victim
+ */
+void ocacheSetAdmission(ocache_t* c, tinylfu_t* filter)
+{
+    c->admission = filter;
+}
+
+/*
+ * ocacheCreate - Create an empty object cache holding at most capacity bytes
+ */
+ocache_t* ocacheCreate(ocache_policy_t policy, unsigned long long capacity)
+{
+    ocache_t* c = calloc(1, sizeof(ocache_t));
+    c->policy = policy;
+    c->capacity = capacity;
+    c->max_entries = 1024;
+    c->num_entries = 1; /* skip the null entry */
+    c->entries = calloc(c->max_entries, sizeof(oc_entry_t));
+    c->table_mask = 2047;
+    c->table = calloc(c->table_mask + 1, sizeof(unsigned int));
+    c->lfu_min = 1;
+    return c;
+}
+
+/*
+ * ocacheDestroy - Free an object cache
+ */
+void ocacheDestroy(ocache_t* c)
+{
+    free(c->entries);
+    free(c->table);
+    free(c->laps);
+    free(c);
+}
+
+/*
+ * ocacheAccess - Request an object, admitting it on a miss. Returns 1 on
+ *     a hit. A resident object requested with a new size is replaced,
+ *     which counts as a miss.
+ */
+int ocacheAccess(ocache_t* c, unsigned long long key, unsigned int size)
+{
+    unsigned int idx = hashFind(c, key);
+    int hit = idx != NIL && isResident(c, idx);
+
+    if (c->admission)
+        tinylfuRecord(c->admission, key);
+
+    if (idx != NIL && c->entries[idx].size != size) {
+        /* The object changed size: forget the old copy and treat it as new */
+        if (isResident(c, idx))
+            c->used -= c->entries[idx].size;
+        if (c->entries[idx].in_stack)
+            stackRemove(c, idx);
+        listRemove(c, idx);
+        freeEntry(c, idx);
+        if (c->policy == OC_LIRS)
+            lirsPrune(c);
+        idx = NIL;
+        hit = 0;
+    }
+
+    /* Counted only now, so a resized object is a miss in the stats as well */
+    if (hit) {
+        c->stats.hits++;
+        c->stats.byte_hits += size;
+    } else {
+        c->stats.misses++;
+        c->stats.byte_misses += size;
+    }
+
+    if (hit) {
+        switch (c->policy) {
+        case OC_LRU:
+            listMoveHead(c, L_RECENT, idx);
+            break;
+        case OC_LFU:
+            lfuHit(c, idx);
+            break;
+        case OC_ARC:
+            listMoveHead(c, L_FREQUENT, idx);
+            break;
+        case OC_2Q:
+            if (c->entries[idx].list == L_FREQUENT)
+                listMoveHead(c, L_FREQUENT, idx);
+            break;
+        case OC_LIRS:
+            lirsHit(c, idx);
+            break;
+        case OC_S3FIFO:
+            if (c->entries[idx].freq < 3)
+                c->entries[idx].freq++;
+            break;
+        default:
+            break;
+        }
+        return 1;
+    }
+
+    if (size > c->capacity) {
+        /* Never fits; drop any ghost so it cannot skew the policy */
+        if (idx != NIL) {
+            if (c->entries[idx].in_stack)
+                stackRemove(c, idx);
+            listRemove(c, idx);
+            freeEntry(c, idx);
+        }
+        return 0;
+    }
+
+    if (c->admission && c->used + size > c->capacity && !admitOverVictims(c, key, idx, size)) {
+        c->stats.rejections++;
+        return 0;
+    }
+
+    int ghost = idx != NIL;
+    if (!ghost)
+        idx = allocEntry(c, key, size);
+
+    switch (c->policy) {
+    case OC_LRU:
+        lruMiss(c, idx);
+        break;
+    case OC_LFU:
+        lfuMiss(c, idx);
+        break;
+    case OC_ARC:
+        arcMiss(c, idx, ghost);
+        break;
+    case OC_2Q:
+        twoQMiss(c, idx, ghost);
+        break;
+    case OC_LIRS:
+        lirsMiss(c, idx, ghost);
+        break;
+    case OC_S3FIFO:
+        s3fifoMiss(c, idx, ghost);
+        break;
+    default:
+        break;
+    }
+    c->used += size;
+    return 0;
+}
+
+/*
+ * ocacheStats - Read the totals accumulated so far
+ */
+const ocache_stats_t* ocacheStats(const ocache_t* c)
+{
+    return &c->stats;
+}
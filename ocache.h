@@ -0,0 +1,51 @@
+/*
+ * ocache.h - Software object cache with variable-size items and a byte capacity
+ */
+
+#ifndef OCACHE_H
+#define OCACHE_H
+
+#include "tinylfu.h"
+
+/* Replacement policies of the object cache */
+typedef enum {
+    OC_LRU,    /* least recently used */
+    OC_LFU,    /* least frequently used, ties broken by recency */
+    OC_ARC,    /* adaptive replacement cache */
+    OC_2Q,     /* full 2Q with A1in, A1out and Am queues */
+    OC_LIRS,   /* low inter-reference recency set */
+    OC_S3FIFO, /* small, main and ghost FIFO queues */
+    OC_NUM_POLICIES
+} ocache_policy_t;
+
+/* Names of the policies, indexed by ocache_policy_t */
+extern const char* ocache_policy_names[OC_NUM_POLICIES];
+
+/* Running totals of an object cache */
+typedef struct ocache_stats {
+    unsigned long long hits;        /* requests found resident */
+    unsigned long long misses;      /* requests not found resident */
+    unsigned long long evictions;   /* resident objects removed to make room */
+    unsigned long long byte_hits;   /* bytes of the requests that hit */
+    unsigned long long byte_misses; /* bytes of the requests that missed */
+    unsigned long long rejections;  /* misses the admission filter kept out */
+} ocache_stats_t;
+
+typedef struct ocache ocache_t;
+
+/* Create an empty object cache holding at most capacity bytes */
+ocache_t* ocacheCreate(ocache_policy_t policy, unsigned long long capacity);
+
+/* Free an object cache */
+void ocacheDestroy(ocache_t* cache);
+
+/* Filter misses through TinyLFU before they may displace a victim */
+void ocacheSetAdmission(ocache_t* cache, tinylfu_t* filter);
+
+/* Request an object, admitting it on a miss. Returns 1 on a hit. */
+int ocacheAccess(ocache_t* cache, unsigned long long key, unsigned int size);
+
+/* Read the totals accumulated so far */
+const ocache_stats_t* ocacheStats(const ocache_t* cache);
+
+#endif /* OCACHE_H */
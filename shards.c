@@ -0,0 +1,400 @@
+/*
+ * shards.c - Fixed-size SHARDS miss-ratio curve estimator
+ *
+ * A block is sampled when its hash, modulo SHARDS_MODULUS, falls below a
+ * threshold T; the sampling rate is R = T / SHARDS_MODULUS. Sampled blocks
+ * are kept in a treap ordered by their last access time, so the reuse
+ * distance of a sampled reference is the number of blocks touched after
+ * it, scaled up by 1/R. At most max_samples blocks are tracked: when one
+ * more arrives, the blocks with the largest hash are dropped and T is
+ * lowered to that hash, and the histogram gathered so far is rescaled to
+ * the new rate. Memory therefore stays fixed however large the footprint.
+ *
+ * The final curve applies the SHARDS-adj correction: the difference
+ * between the references expected at rate R and those actually sampled is
+ * credited to the smallest distance bin.
+ */
+#include <math.h>
+#include <stdlib.h>
+#include "shards.h"
+
+#define SHARDS_MODULUS (1ULL << 24) /* hash space the threshold is drawn from */
+#define NIL 0                      /* node 0 is never used and links to nothing */
+#define LINEAR_BINS 16             /* distances below this get a bin each */
+#define SUB_BINS 4                 /* bins per power of two above that */
+#define NUM_BINS (LINEAR_BINS + 64 * SUB_BINS)
+
+typedef struct shards_node {
+    unsigned long long block;     /* sampled block address */
+    unsigned long long last_time; /* treap key: time of the last access */
+    unsigned int hash;            /* sampling hash of the block */
+    unsigned int priority;        /* treap heap priority */
+    unsigned int left, right;     /* treap children */
+    unsigned int size;            /* nodes in this subtree */
+    unsigned int heap_pos;        /* position in the max-hash heap */
+} shards_node_t;
+
+struct shards {
+    shards_node_t* nodes;         /* node pool, nodes[0] unused */
+    unsigned int max_samples;     /* tracked blocks before the rate drops */
+    unsigned int num_tracked;     /* blocks currently tracked */
+    unsigned int free_head;       /* recycled nodes, linked through left */
+    unsigned int next_node;       /* first never-used node */
+    unsigned int root;            /* treap root */
+    unsigned int* heap;           /* tracked nodes, largest hash first */
+    unsigned int* table;          /* block to node hash table, NIL if empty */
+    unsigned long long table_mask;
+    unsigned long long threshold; /* T: blocks with hash below it are sampled */
+    unsigned long long now;       /* sampled references so far */
+    unsigned long long references; /* every reference seen */
+    unsigned int rng;             /* xorshift state for treap priorities */
+    double histogram[NUM_BINS];   /* reuse distances in blocks, at the current rate */
+    double cold;                  /* first references to sampled blocks */
+};
+
+static unsigned long long mix(unsigned long long key)
+{
+    key ^= key >> 33;
+    key *= 0xff51afd7ed558ccdULL;
+    key ^= key >> 33;
+    key *= 0xc4ceb9fe1a85ec53ULL;
+    key ^= key >> 33;
+    return key;
+}
+
+/*
+ * binOf - Map a distance to its histogram bin: exact below LINEAR_BINS,
+ *     then SUB_BINS bins per power of two
+ */
+static int binOf(unsigned long long distance)
+{
+    if (distance < LINEAR_BINS)
+        return (int)distance;
+    int msb = 63 - __builtin_clzll(distance);
+    int sub = (int)((distance >> (msb - 2)) & (SUB_BINS - 1));
+    return LINEAR_BINS + (msb - 4) * SUB_BINS + sub;
+}
+
+/* Smallest distance that falls into a bin */
+static unsigned long long binStart(int bin)
+{
+    if (bin < LINEAR_BINS)
+        return bin;
+    int msb = (bin - LINEAR_BINS) / SUB_BINS + 4;
+    int sub = (bin - LINEAR_BINS) % SUB_BINS;
+    return (1ULL << msb) | ((unsigned long long)sub << (msb - 2));
+}
+
+/*
+ * Treap keyed by last access time
+ */
+static unsigned int treeSize(const shards_t* s, unsigned int n)
+{
+    return n == NIL ? 0 : s->nodes[n].size;
+}
+
+static void treeUpdate(shards_t* s, unsigned int n)
+{
+    s->nodes[n].size = 1 + treeSize(s, s->nodes[n].left) + treeSize(s, s->nodes[n].right);
+}
+
+/* Split a subtree into keys below key and keys at or above it */
+static void treeSplit(shards_t* s, unsigned int n, unsigned long long key, unsigned int* lo, unsigned int* hi)
+{
+    if (n == NIL) {
+        *lo = *hi = NIL;
+    } else if (s->nodes[n].last_time < key) {
+        treeSplit(s, s->nodes[n].right, key, &s->nodes[n].right, hi);
+        treeUpdate(s, n);
+        *lo = n;
+    } else {
+        treeSplit(s, s->nodes[n].left, key, lo, &s->nodes[n].left);
+        treeUpdate(s, n);
+        *hi = n;
+    }
+}
+
+static unsigned int treeMerge(shards_t* s, unsigned int lo, unsigned int hi)
+{
+    if (lo == NIL)
+        return hi;
+    if (hi == NIL)
+        return lo;
+    if (s->nodes[lo].priority > s->nodes[hi].priority) {
+        s->nodes[lo].right = treeMerge(s, s->nodes[lo].right, hi);
+        treeUpdate(s, lo);
+        return lo;
+    }
+    s->nodes[hi].left = treeMerge(s, lo, s->nodes[hi].left);
+    treeUpdate(s, hi);
+    return hi;
+}
+
+static void treeInsert(shards_t* s, unsigned int n)
+{
+    unsigned int lo, hi;
+    s->nodes[n].left = s->nodes[n].right = NIL;
+    s->nodes[n].size = 1;
+    treeSplit(s, s->root, s->nodes[n].last_time, &lo, &hi);
+    s->root = treeMerge(s, treeMerge(s, lo, n), hi);
+}
+
+static void treeErase(shards_t* s, unsigned long long key)
+{
+    unsigned int lo, mid, hi;
+    treeSplit(s, s->root, key, &lo, &hi);
+    treeSplit(s, hi, key + 1, &mid, &hi);
+    s->root = treeMerge(s, lo, hi);
+}
+
+/* Number of tracked blocks accessed after time key */
+static unsigned int treeCountAfter(const shards_t* s, unsigned long long key)
+{
+    unsigned int n = s->root, count = 0;
+    while (n != NIL) {
+        if (s->nodes[n].last_time > key) {
+            count += 1 + treeSize(s, s->nodes[n].right);
+            n = s->nodes[n].left;
+        } else {
+            n = s->nodes[n].right;
+        }
+    }
+    return count;
+}
+
+/*
+ * Max-heap of tracked nodes by sampling hash
+ */
+static void heapSwap(shards_t* s, unsigned int a, unsigned int b)
+{
+    unsigned int t = s->heap[a];
+    s->heap[a] = s->heap[b];
+    s->heap[b] = t;
+    s->nodes[s->heap[a]].heap_pos = a;
+    s->nodes[s->heap[b]].heap_pos = b;
+}
+
+static void heapUp(shards_t* s, unsigned int pos)
+{
+    while (pos > 0 && s->nodes[s->heap[(pos - 1) / 2]].hash < s->nodes[s->heap[pos]].hash) {
+        heapSwap(s, pos, (pos - 1) / 2);
+        pos = (pos - 1) / 2;
+    }
+}
+
+static void heapDown(shards_t* s, unsigned int pos)
+{
+    for (;;) {
+        unsigned int largest = pos, l = 2 * pos + 1, r = 2 * pos + 2;
+        if (l < s->num_tracked && s->nodes[s->heap[l]].hash > s->nodes[s->heap[largest]].hash)
+            largest = l;
+        if (r < s->num_tracked && s->nodes[s->heap[r]].hash > s->nodes[s->heap[largest]].hash)
+            largest = r;
+        if (largest == pos)
+            return;
+        heapSwap(s, pos, largest);
+        pos = largest;
+    }
+}
+
+/*
+ * Block to node table, open addressing with backward-shift deletion
+ */
+static unsigned long long tableHome(const shards_t* s, unsigned long long block)
+{
+    return (mix(block) >> 24) & s->table_mask;
+}
+
+static unsigned int tableFind(const shards_t* s, unsigned long long block)
+{
+    unsigned long long slot = tableHome(s, block);
+    while (s->table[slot] != NIL) {
+        if (s->nodes[s->table[slot]].block == block)
+            return s->table[slot];
+        slot = (slot + 1) & s->table_mask;
+    }
+    return NIL;
+}
+
+static void tableInsert(shards_t* s, unsigned int n)
+{
+    unsigned long long slot = tableHome(s, s->nodes[n].block);
+    while (s->table[slot] != NIL)
+        slot = (slot + 1) & s->table_mask;
+    s->table[slot] = n;
+}
+
+static void tableErase(shards_t* s, unsigned long long block)
+{
+    unsigned long long i = tableHome(s, block), j;
+    while (s->nodes[s->table[i]].block != block)
+        i = (i + 1) & s->table_mask;
+    j = i;
+    for (;;) {
+        j = (j + 1) & s->table_mask;
+        if (s->table[j] == NIL)
+            break;
+        unsigned long long home = tableHome(s, s->nodes[s->table[j]].block);
+        if (i <= j ? (i < home && home <= j) : (i < home || home <= j))
+            continue;
+        s->table[i] = s->table[j];
+        i = j;
+    }
+    s->table[i] = NIL;
+}
+
+/* Stop tracking the block with the largest hash */
+static void dropLargest(shards_t* s)
+{
+    unsigned int n = s->heap[0];
+    s->num_tracked--;
+    if (s->num_tracked > 0) {
+        heapSwap(s, 0, s->num_tracked);
+        heapDown(s, 0);
+    }
+    treeErase(s, s->nodes[n].last_time);
+    tableErase(s, s->nodes[n].block);
+    s->nodes[n].left = s->free_head;
+    s->free_head = n;
+}
+
+/*
+ * shardsCreate - Create an estimator that tracks at most max_samples blocks
+ */
+shards_t* shardsCreate(unsigned int max_samples)
+{
+    shards_t* s = calloc(1, sizeof(shards_t));
+    unsigned long long table_size = 16;
+    while (table_size < 2ULL * (max_samples + 1))
+        table_size <<= 1;
+    s->max_samples = max_samples;
+    s->nodes = calloc(max_samples + 2, sizeof(shards_node_t));
+    s->heap = calloc(max_samples + 1, sizeof(unsigned int));
+    s->table = calloc(table_size, sizeof(unsigned int));
+    s->table_mask = table_size - 1;
+    s->next_node = 1;
+    s->threshold = SHARDS_MODULUS; /* start by sampling everything */
+    s->rng = 2463534242u;
+    return s;
+}
+
+/*
+ * shardsDestroy - Free an estimator
+ */
+void shardsDestroy(shards_t* s)
+{
+    free(s->nodes);
+    free(s->heap);
+    free(s->table);
+    free(s);
+}
+
+/*
+ * shardsAccess - Feed one reference to a block address
+ */
+void shardsAccess(shards_t* s, unsigned long long block)
+{
+    unsigned long long hash = mix(block) & (SHARDS_MODULUS - 1);
+    s->references++;
+    if (hash >= s->threshold)
+        return;
+
+    double rate = (double)s->threshold / SHARDS_MODULUS;
+    unsigned long long now = ++s->now;
+    unsigned int n = tableFind(s, block);
+
+    if (n != NIL) {
+        unsigned long long distance = treeCountAfter(s, s->nodes[n].last_time);
+        s->histogram[binOf((unsigned long long)(distance / rate))] += 1;
+        treeErase(s, s->nodes[n].last_time);
+        s->nodes[n].last_time = now;
+        treeInsert(s, n);
+        return;
+    }
+
+    s->cold += 1;
+    if (s->free_head != NIL) {
+        n = s->free_head;
+        s->free_head = s->nodes[n].left;
+    } else {
+        n = s->next_node++;
+    }
+    s->rng ^= s->rng << 13;
+    s->rng ^= s->rng >> 17;
+    s->rng ^= s->rng << 5;
+    s->nodes[n].block = block;
+    s->nodes[n].hash = (unsigned int)hash;
+    s->nodes[n].last_time = now;
+    s->nodes[n].priority = s->rng;
+    treeInsert(s, n);
+    tableInsert(s, n);
+    s->nodes[n].heap_pos = s->num_tracked;
+    s->heap[s->num_tracked++] = n;
+    heapUp(s, s->num_tracked - 1);
+
+    if (s->num_tracked > s->max_samples) {
+        /* Lower the threshold to the largest tracked hash and forget those blocks */
+        unsigned long long new_threshold = s->nodes[s->heap[0]].hash;
+        while (s->num_tracked > 0 && s->nodes[s->heap[0]].hash >= new_threshold)
+            dropLargest(s);
+        double scale = (double)new_threshold / s->threshold;
+        for (int i = 0; i < NUM_BINS; i++)
+            s->histogram[i] *= scale;
+        s->cold *= scale;
+        s->threshold = new_threshold;
+    }
+}
+
+/*
+ * shardsRate - Current sampling rate
+ */
+double shardsRate(const shards_t* s)
+{
+    return (double)s->threshold / SHARDS_MODULUS;
+}
+
+/*
+ * shardsSampled - References that passed the sampling filter
+ */
+unsigned long long shardsSampled(const shards_t* s)
+{
+    return s->now;
+}
+
+/*
+ * shardsCurve - Fill points with the adjusted curve; the standard error
+ *     treats the expected number of sampled references as independent
+ *     trials, which is optimistic when few distinct blocks are sampled
+ */
+int shardsCurve(const shards_t* s, mrc_point_t* points, int max_points)
+{
+    double expected = s->references * shardsRate(s);
+    double sampled = s->cold;
+    int last_bin = 0, count = 0;
+
+    for (int i = 0; i < NUM_BINS; i++) {
+        sampled += s->histogram[i];
+        if (s->histogram[i] > 0)
+            last_bin = i;
+    }
+    if (expected <= 0)
+        return 0;
+
+    /* SHARDS-adj: credit the sampling shortfall or excess to the smallest distance */
+    double first_bin = s->histogram[0] + (expected - sampled);
+    double hits = 0;
+    for (int i = 0; i <= last_bin + 1 && count < max_points; i++) {
+        /* Cache of binStart(i + 1) blocks hits every reuse distance below it */
+        hits += i == 0 ? first_bin : s->histogram[i];
+        double miss_ratio = 1 - hits / expected;
+        if (miss_ratio < 0)
+            miss_ratio = 0;
+        if (miss_ratio > 1)
+            miss_ratio = 1;
+        points[count].cache_blocks = binStart(i + 1);
+        points[count].miss_ratio = miss_ratio;
+        points[count].std_error = sqrt(miss_ratio * (1 - miss_ratio) / expected);
+        count++;
+    }
+    return count;
+}
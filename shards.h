@@ -0,0 +1,39 @@
+/*
+ * shards.h - Approximate miss-ratio curves in constant memory with
+ *     fixed-size SHARDS (spatially hashed sampling of reuse distances)
+ */
+
+#ifndef SHARDS_H
+#define SHARDS_H
+
+typedef struct shards shards_t;
+
+/* One point of a miss-ratio curve */
+typedef struct mrc_point {
+    unsigned long long cache_blocks; /* fully associative LRU cache size in blocks */
+    double miss_ratio;               /* estimated miss ratio at that size */
+    double std_error;                /* standard error of the estimate */
+} mrc_point_t;
+
+/* Create an estimator that tracks at most max_samples distinct blocks */
+shards_t* shardsCreate(unsigned int max_samples);
+
+/* Free an estimator */
+void shardsDestroy(shards_t* shards);
+
+/* Feed one reference to a block address */
+void shardsAccess(shards_t* shards, unsigned long long block);
+
+/* Current sampling rate, between 0 and 1 */
+double shardsRate(const shards_t* shards);
+
+/* References that passed the sampling filter */
+unsigned long long shardsSampled(const shards_t* shards);
+
+/*
+ * Fill points with the curve, one point per histogram bin up to the
+ * largest distance seen. Returns the number of points written.
+ */
+int shardsCurve(const shards_t* shards, mrc_point_t* points, int max_points);
+
+#endif /* SHARDS_H */
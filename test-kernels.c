@@ -0,0 +1,559 @@
+/*
+ * test-kernels.c - Checks the correctness and performance of every
+ *     registered kernel: the transposes in trans.c and the GEMM, stencil
+ *     and convolution kernels in kernels.c.
+ *
+ * Each function runs natively on the same random inputs as its family's
+ * oracle; the outputs are compared and the best wall-clock time of a few
+ * runs is recorded. Then, unless -n is given, the function is run again
+ * under valgrind (./test-kernels -F <i>) to trace its memory accesses,
+ * which the reference simulator turns into hits, misses and evictions.
+ */
+#define _POSIX_C_SOURCE 200809L // For clock_gettime()
+#include <stdio.h>
+#include <stdlib.h>
+#include <assert.h>
+#include <unistd.h>
+#include <string.h>
+#include <signal.h>
+#include <getopt.h>
+#include <math.h>
+#include <time.h>
+#include <sys/types.h>
+#include <sys/wait.h>
+#include "cachelab.h"
+#include "batch.h"
+
+/* Maximum array dimension */
+#define MAXN 256
+
+/* Bytes available for the operands of one function and its oracle */
+#define ARENA_BYTES (32 << 20)
+
+/* External functions defined in trans.c, kernels.c and the generated trans-gen.c */
+extern void registerFunctions();
+extern void registerKernels();
+extern void registerGeneratedFunctions();
+
+/* External variables defined in cachelab.c */
+extern kernel_func_t kernel_list[MAX_KERNEL_FUNCS];
+extern int kernel_counter;
+
+/* Globals set on the command line */
+static kernel_dims_t dims = {0, 0, 3};
+static char* family = NULL;
+static int runs = 5;
+static int simulate = 1;
+static size_t batch = 0;
+static int threads = 0;
+
+/*
+ * The operands live in a static arena rather than on the heap so their
+ * addresses stay in the low 32 bits that the trace filter keeps.
+ */
+static double arena[ARENA_BYTES / sizeof(double)];
+static size_t arena_used;
+
+/* Accessed right before and after the traced function */
+volatile char marker_start, marker_end;
+
+/*
+ * arenaAlloc - Carve a cache-line aligned block out of the arena
+ */
+static void* arenaAlloc(size_t bytes)
+{
+    void* block = (char*)arena + arena_used;
+    arena_used += (bytes + 63) / 64 * 64;
+    return arena_used <= ARENA_BYTES ? block : NULL;
+}
+
+/*
+ * operandBytes - Size of an operand for the current dimensions, or 0 if
+ *     its shape is empty or malformed
+ */
+static size_t operandBytes(const kernel_operand_t* operand)
+{
+    int rows = kernelExtent(operand->rows, &dims);
+    int cols = kernelExtent(operand->cols, &dims);
+
+    if (rows <= 0 || cols <= 0)
+        return 0;
+    return (size_t)rows * cols * kernelElemSize(operand->type);
+}
+
+/*
+ * fillOperand - Small random integers for inputs, a sentinel for
+ *     outputs so unwritten elements show up, zeros for scratch space
+ */
+static void fillOperand(const kernel_operand_t* operand, void* data, size_t bytes)
+{
+    size_t i, count = bytes / kernelElemSize(operand->type);
+
+    for (i = 0; i < count; i++) {
+        int value = operand->role == KERNEL_IN ? rand() % 10 : operand->role == KERNEL_OUT ? -1 : 0;
+        switch (operand->type) {
+        case KERNEL_INT: ((int*)data)[i] = value; break;
+        case KERNEL_FLOAT: ((float*)data)[i] = value; break;
+        case KERNEL_DOUBLE: ((double*)data)[i] = value; break;
+        }
+    }
+}
+
+/*
+ * sameOperand - Compare an output with the oracle's, exactly for
+ *     integers and up to rounding for floating point
+ */
+static int sameOperand(const kernel_operand_t* operand, const void* got, const void* want, size_t bytes)
+{
+    size_t i, count = bytes / kernelElemSize(operand->type);
+
+    for (i = 0; i < count; i++) {
+        double a, b, tolerance;
+        switch (operand->type) {
+        case KERNEL_INT:
+            if (((int*)got)[i] != ((int*)want)[i])
+                return 0;
+            continue;
+        case KERNEL_FLOAT:
+            a = ((float*)got)[i], b = ((float*)want)[i], tolerance = 1e-4;
+            break;
+        default:
+            a = ((double*)got)[i], b = ((double*)want)[i], tolerance = 1e-9;
+            break;
+        }
+        if (fabs(a - b) > tolerance * (fabs(b) > 1 ? fabs(b) : 1))
+            return 0;
+    }
+    return 1;
+}
+
+/*
+ * setupOperands - Allocate and fill the operands of function i and a
+ *     copy of its outputs for the oracle, then run the oracle. Returns 0
+ *     if the dimensions do not fit the kernel or the arena.
+ */
+static int setupOperands(int i, void* operands[], void* expected[], size_t bytes[])
+{
+    const kernel_desc_t* kernel = kernel_list[i].kernel;
+    void* oracle_operands[MAX_KERNEL_OPERANDS];
+    int j;
+
+    if (kernel->valid && !kernel->valid(&dims))
+        return 0;
+    arena_used = 0;
+    srand(1); /* every function and the traced rerun see the same inputs */
+    for (j = 0; j < kernel->num_operands; j++) {
+        const kernel_operand_t* operand = &kernel->operands[j];
+        bytes[j] = operandBytes(operand);
+        if (bytes[j] == 0 || !(operands[j] = arenaAlloc(bytes[j])))
+            return 0;
+        fillOperand(operand, operands[j], bytes[j]);
+        oracle_operands[j] = operands[j];
+        expected[j] = NULL;
+        if (operand->role != KERNEL_IN) {
+            if (!(expected[j] = arenaAlloc(bytes[j])))
+                return 0;
+            memcpy(expected[j], operands[j], bytes[j]);
+            oracle_operands[j] = expected[j];
+        }
+    }
+    kernel->invoke(kernel->oracle, &dims, oracle_operands);
+    return 1;
+}
+
+/*
+ * checkOperands - Whether every output of function i matches the oracle
+ */
+static int checkOperands(int i, void* operands[], void* expected[], size_t bytes[])
+{
+    const kernel_desc_t* kernel = kernel_list[i].kernel;
+    int j;
+
+    for (j = 0; j < kernel->num_operands; j++) {
+        const kernel_operand_t* operand = &kernel->operands[j];
+        if (operand->role == KERNEL_OUT && !sameOperand(operand, operands[j], expected[j], bytes[j]))
+            return 0;
+    }
+    return 1;
+}
+
+/*
+ * now - Monotonic wall-clock time in seconds
+ */
+static double now()
+{
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec + ts.tv_nsec * 1e-9;
+}
+
+/*
+ * trace_func - Run function i once between the two markers so valgrind
+ *     can cut its accesses out of the whole program's trace. Exits with
+ *     i + 1 if the result is wrong.
+ */
+void trace_func(int i)
+{
+    void* operands[MAX_KERNEL_OPERANDS];
+    void* expected[MAX_KERNEL_OPERANDS];
+    size_t bytes[MAX_KERNEL_OPERANDS];
+
+    if (!setupOperands(i, operands, expected, bytes))
+        exit(i + 1);
+
+    FILE* marker_fp = fopen(".marker", "w");
+    assert(marker_fp);
+    fprintf(marker_fp, "%llx %llx",
+            (unsigned long long)&marker_start, (unsigned long long)&marker_end);
+    fclose(marker_fp);
+
+    marker_start = 33;
+    kernel_list[i].kernel->invoke(kernel_list[i].func_ptr, &dims, operands);
+    marker_end = 34;
+
+    exit(checkOperands(i, operands, expected, bytes) ? 0 : i + 1);
+}
+
+/*
+ * eval_native - Check function i against its oracle and time it
+ */
+void eval_native(int i)
+{
+    const kernel_desc_t* kernel = kernel_list[i].kernel;
+    void* operands[MAX_KERNEL_OPERANDS];
+    void* expected[MAX_KERNEL_OPERANDS];
+    size_t bytes[MAX_KERNEL_OPERANDS];
+    double best = 0;
+    int r;
+
+    printf("Step 1: Validating against the %s oracle and timing %d runs\n", kernel->name, runs);
+    if (!setupOperands(i, operands, expected, bytes)) {
+        printf("Dimensions M=%d N=%d K=%d do not fit this kernel, skipping it.\n",
+               dims.M, dims.N, dims.K);
+        kernel_list[i].skipped = 1;
+        return;
+    }
+    for (r = 0; r < runs; r++) {
+        double start = now(), elapsed;
+        kernel->invoke(kernel_list[i].func_ptr, &dims, operands);
+        elapsed = now() - start;
+        if (r == 0 || elapsed < best)
+            best = elapsed;
+    }
+    kernel_list[i].correct = checkOperands(i, operands, expected, bytes);
+    kernel_list[i].seconds = best;
+    printf("func %d (%s): correct:%d, best time:%.3f us\n",
+           i, kernel_list[i].description, kernel_list[i].correct, best * 1e6);
+}
+
+/*
+ * eval_sim - Trace function i under valgrind and count its simulated
+ *     hits, misses and evictions on an (s, E, b) cache
+ */
+void eval_sim(int i, unsigned int s, unsigned int E, unsigned int b)
+{
+    unsigned long long marker_start_addr, marker_end_addr, addr;
+    unsigned int len, hits, misses, evictions;
+    char buf[1000], cmd[255], filename[128];
+    int flag;
+
+    printf("Step 2: Generating the memory trace and evaluating performance (s=%d, E=%d, b=%d)\n",
+           s, E, b);
+    sprintf(cmd, "valgrind --tool=lackey --trace-mem=yes --log-fd=1 ./test-kernels -M %d -N %d -K %d -F %d > trace.tmp",
+            dims.M, dims.N, dims.K, i);
+    flag = WEXITSTATUS(system(cmd));
+    if (flag != 0) {
+        printf("Validation error at function %d under valgrind, skipping its simulation.\n", flag - 1);
+        return;
+    }
+
+    FILE* marker_fp = fopen(".marker", "r");
+    assert(marker_fp);
+    fscanf(marker_fp, "%llx %llx", &marker_start_addr, &marker_end_addr);
+    fclose(marker_fp);
+
+    FILE* full_trace_fp = fopen("trace.tmp", "r");
+    assert(full_trace_fp);
+    sprintf(filename, "trace.k%d", i);
+    FILE* part_trace_fp = fopen(filename, "w");
+    assert(part_trace_fp);
+
+    /*
+     * Keep the accesses strictly between the markers, and like test-trans
+     * only those in the low 32 bits, which drops valgrind's own stack.
+     */
+    flag = 0;
+    while (fgets(buf, sizeof(buf), full_trace_fp) != NULL) {
+        if (buf[0] != ' ' || buf[2] != ' ' || (buf[1] != 'S' && buf[1] != 'M' && buf[1] != 'L'))
+            continue;
+        sscanf(buf + 3, "%llx,%u", &addr, &len);
+        if (addr == marker_end_addr && flag)
+            break;
+        if (flag && addr < 0xffffffff)
+            fputs(buf, part_trace_fp);
+        if (addr == marker_start_addr)
+            flag = 1;
+    }
+    fclose(full_trace_fp);
+    fclose(part_trace_fp);
+
+    sprintf(cmd, "./csim-ref -s %u -E %u -b %u -t %s > /dev/null", s, E, b, filename);
+    system(cmd);
+
+    FILE* in_fp = fopen(".csim_results", "r");
+    assert(in_fp);
+    fscanf(in_fp, "%u %u %u", &hits, &misses, &evictions);
+    fclose(in_fp);
+
+    kernel_list[i].num_hits = hits;
+    kernel_list[i].num_misses = misses;
+    kernel_list[i].num_evictions = evictions;
+    printf("func %d (%s): hits:%u, misses:%u, evictions:%u\n",
+           i, kernel_list[i].description, hits, misses, evictions);
+}
+
+/*
+ * timeBatch - Best time of a few runs of one way to transpose the batch;
+ *     way 0 calls correctTrans once per matrix
+ */
+static double timeBatch(int way, const int* src, int* dst)
+{
+    size_t m, size = (size_t)dims.M * dims.N;
+    double best = 0;
+    int r;
+
+    for (r = 0; r < runs; r++) {
+        double start = now(), elapsed;
+        switch (way) {
+        case 0:
+            for (m = 0; m < batch; m++)
+                correctTrans(dims.M, dims.N, (int(*)[dims.M])(src + m * size),
+                             (int(*)[dims.N])(dst + m * size));
+            break;
+        case 1: batchTranspose(dims.N, dims.M, batch, src, dst, 1); break;
+        case 2: batchTranspose(dims.N, dims.M, batch, src, dst, threads); break;
+        case 3: batchTransposeInterleaved(dims.N, dims.M, batch, src, dst, 1); break;
+        case 4: batchTransposeInterleaved(dims.N, dims.M, batch, src, dst, threads); break;
+        }
+        elapsed = now() - start;
+        if (r == 0 || elapsed < best)
+            best = elapsed;
+    }
+    return best;
+}
+
+/*
+ * eval_batch - Check the batched transposes of batch.c against
+ *     correctTrans and report their throughput in matrices per second
+ */
+void eval_batch()
+{
+    static const char* ways[] = {
+        "one correctTrans call per matrix", "batchTranspose, 1 thread", "batchTranspose, all threads",
+        "batchTransposeInterleaved, 1 thread", "batchTransposeInterleaved, all threads"};
+    size_t i, size = (size_t)dims.M * dims.N, total = size * batch;
+    size_t padded = batchInterleavedSize(dims.N, dims.M, batch);
+    int* src = malloc(sizeof(int) * padded);
+    int* lanes = malloc(sizeof(int) * padded);
+    int* dst = malloc(sizeof(int) * padded);
+    int* expected = malloc(sizeof(int) * total);
+    int way, correct;
+
+    if (!src || !lanes || !dst || !expected) {
+        printf("Error: Not enough memory for %zu %dx%d matrices\n", batch, dims.N, dims.M);
+        exit(1);
+    }
+    srand(1);
+    for (i = 0; i < total; i++)
+        src[i] = rand() % 10;
+    for (i = 0; i < batch; i++)
+        correctTrans(dims.M, dims.N, (int(*)[dims.M])(src + i * size), (int(*)[dims.N])(expected + i * size));
+
+    printf("Batch of %zu %dx%d matrices, best of %d runs:\n", batch, dims.N, dims.M, runs);
+    for (way = 0; way < 5; way++) {
+        double best;
+        memset(dst, -1, sizeof(int) * padded);
+        if (way < 3) {
+            best = timeBatch(way, src, dst);
+            correct = memcmp(dst, expected, sizeof(int) * total) == 0;
+        } else {
+            /* The conversions are not timed: callers keep their batches interleaved */
+            batchInterleave(dims.N, dims.M, batch, src, lanes);
+            best = timeBatch(way, lanes, dst);
+            batchDeinterleave(dims.M, dims.N, batch, dst, lanes);
+            correct = memcmp(lanes, expected, sizeof(int) * total) == 0;
+        }
+        printf("batch %d: correct:%d time_us:%.3f matrices/s:%.0f (%s)\n", way, correct, best * 1e6,
+               best > 0 ? batch / best : 0, ways[way]);
+    }
+    free(src);
+    free(lanes);
+    free(dst);
+    free(expected);
+}
+
+/*
+ * usage - Print usage info
+ */
+void usage(char *argv[]){
+    printf("Usage: %s [-hn] -M <cols> -N <rows> [-K <k>] [-k <kernel>] [-r <runs>] [-s <s> -E <E> -b <b>] [-x <count> [-j <threads>]]\n", argv[0]);
+    printf("Options:\n");
+    printf("  -h          Print this help message.\n");
+    printf("  -M <cols>   First matrix dimension (max %d)\n", MAXN);
+    printf("  -N <rows>   Second matrix dimension (max %d)\n", MAXN);
+    printf("  -K <k>      GEMM inner dimension or filter size (max %d, default 3)\n", MAXN);
+    printf("  -k <kernel> Only evaluate one family: transpose, gemm, stencil or conv\n");
+    printf("  -r <runs>   Timed runs per function, the best counts (default 5)\n");
+    printf("  -n          Skip the simulated evaluation under valgrind\n");
+    printf("  -s <s> -E <E> -b <b>  Simulated cache (default s=5, E=1, b=5)\n");
+    printf("  -x <count>  Instead, time batched transposes of count N x M matrices\n");
+    printf("  -j <threads> Threads for the batched transposes (default one per CPU)\n");
+    printf("Example: %s -M 64 -N 64 -K 64 -k gemm\n", argv[0]);
+}
+
+/*
+ * sigsegv_handler - SIGSEGV handler
+ */
+void sigsegv_handler(int signum){
+    printf("Error: Segmentation Fault.\n");
+    fflush(stdout);
+    exit(1);
+}
+
+/*
+ * sigalrm_handler - SIGALRM handler
+ */
+void sigalrm_handler(int signum){
+    printf("Error: Program timed out.\n");
+    fflush(stdout);
+    exit(1);
+}
+
+/*
+ * main - Main routine
+ */
+int main(int argc, char* argv[])
+{
+    unsigned int s = 5, E = 1, b = 5;
+    int trace = -1;
+    int i, c;
+
+    while ((c = getopt(argc, argv, "M:N:K:k:r:s:E:b:nF:x:j:h")) != -1) {
+        switch(c) {
+        case 'M':
+            dims.M = atoi(optarg);
+            break;
+        case 'N':
+            dims.N = atoi(optarg);
+            break;
+        case 'K':
+            dims.K = atoi(optarg);
+            break;
+        case 'k':
+            family = optarg;
+            break;
+        case 'r':
+            runs = atoi(optarg);
+            break;
+        case 's':
+            s = atoi(optarg);
+            break;
+        case 'E':
+            E = atoi(optarg);
+            break;
+        case 'b':
+            b = atoi(optarg);
+            break;
+        case 'n':
+            simulate = 0;
+            break;
+        case 'F':
+            trace = atoi(optarg);
+            break;
+        case 'x':
+            batch = strtoul(optarg, NULL, 0);
+            break;
+        case 'j':
+            threads = atoi(optarg);
+            break;
+        case 'h':
+            usage(argv);
+            exit(0);
+        default:
+            usage(argv);
+            exit(1);
+        }
+    }
+
+    if (dims.M <= 0 || dims.N <= 0) {
+        printf("Error: Missing required argument\n");
+        usage(argv);
+        exit(1);
+    }
+
+    if (dims.M > MAXN || dims.N > MAXN || dims.K <= 0 || dims.K > MAXN || runs <= 0) {
+        printf("Error: M, N or K exceeds %d, or an argument is not positive\n", MAXN);
+        usage(argv);
+        exit(1);
+    }
+
+    if (batch > 0) {
+        eval_batch();
+        return 0;
+    }
+
+    registerFunctions();
+    registerKernels();
+    registerGeneratedFunctions();
+
+    if (trace >= 0) {
+        if (trace >= kernel_counter)
+            exit(1);
+        trace_func(trace);
+    }
+
+    /* Install SIGSEGV and SIGALRM handlers */
+    if (signal(SIGSEGV, sigsegv_handler) == SIG_ERR) {
+        fprintf(stderr, "Unable to install SIGSEGV handler\n");
+        exit(1);
+    }
+
+    if (signal(SIGALRM, sigalrm_handler) == SIG_ERR) {
+        fprintf(stderr, "Unable to install SIGALRM handler\n");
+        exit(1);
+    }
+
+    /* Time out and give up after a while */
+    alarm(600);
+
+    if (simulate && WEXITSTATUS(system("valgrind --version > /dev/null 2>&1")) != 0) {
+        printf("valgrind not found, only checking and timing the kernels.\n");
+        simulate = 0;
+    }
+
+    for (i = 0; i < kernel_counter; i++) {
+        if (family && strcmp(family, kernel_list[i].kernel->name) != 0)
+            continue;
+        printf("\nFunction %d (%d total): %s [%s]\n", i, kernel_counter,
+               kernel_list[i].description, kernel_list[i].kernel->name);
+        eval_native(i);
+        if (simulate && kernel_list[i].correct)
+            eval_sim(i, s, E, b);
+    }
+
+    printf("\nSummary (M=%d N=%d K=%d):\n", dims.M, dims.N, dims.K);
+    for (i = 0; i < kernel_counter; i++) {
+        if (family && strcmp(family, kernel_list[i].kernel->name) != 0)
+            continue;
+        if (kernel_list[i].skipped) {
+            printf("func %d %-9s skipped (%s)\n", i, kernel_list[i].kernel->name, kernel_list[i].description);
+            continue;
+        }
+        printf("func %d %-9s correct:%d time_us:%.3f", i, kernel_list[i].kernel->name,
+               kernel_list[i].correct, kernel_list[i].seconds * 1e6);
+        if (simulate && kernel_list[i].correct)
+            printf(" misses:%u", kernel_list[i].num_misses);
+        printf(" (%s)\n", kernel_list[i].description);
+    }
+    return 0;
+}
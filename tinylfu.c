@@ -0,0 +1,143 @@
+/*
+ * tinylfu.c - TinyLFU admission filter
+ *
+ * Frequencies are kept in a count-min sketch of four rows of 4-bit
+ * counters, sixteen to a 64-bit word. A key's first access in each aging
+ * period only sets its bits in the doorkeeper bloom filter, so one-hit
+ * wonders never reach the sketch. Once ten accesses per counter column
+ * have been recorded, every counter is halved and the doorkeeper is
+ * cleared, which keeps the estimates tracking recent popularity.
+ */
+#include <stdlib.h>
+#include "tinylfu.h"
+
+#define SKETCH_DEPTH 4
+#define SAMPLE_FACTOR 10 /* accesses per column between agings */
+#define HALVE_MASK 0x7777777777777777ULL /* keeps the low three bits of every nibble */
+
+static const unsigned long long row_seeds[SKETCH_DEPTH] = {
+    0xc3a5c85c97cb3127ULL, 0xb492b66fbe98f273ULL, 0x9ae16a3b2f90404fULL, 0xcbf29ce484222325ULL};
+
+struct tinylfu {
+    unsigned long long* rows[SKETCH_DEPTH]; /* 4-bit counters, sixteen per word */
+    unsigned long long* doorkeeper;         /* bloom filter bits */
+    unsigned long long width_mask;          /* counters per row minus one */
+    unsigned long long door_mask;           /* doorkeeper bits minus one */
+    unsigned long long additions;           /* accesses recorded since the last aging */
+    unsigned long long sample_size;         /* accesses between agings */
+};
+
+static unsigned long long spread(unsigned long long key)
+{
+    key ^= key >> 33;
+    key *= 0xff51afd7ed558ccdULL;
+    key ^= key >> 33;
+    key *= 0xc4ceb9fe1a85ec53ULL;
+    key ^= key >> 33;
+    return key;
+}
+
+static unsigned long long counterIndex(const tinylfu_t* f, unsigned long long hash, int row)
+{
+    unsigned long long h = (hash + row_seeds[row]) * row_seeds[row];
+    return (h ^ (h >> 32)) & f->width_mask;
+}
+
+static unsigned int counterAt(const tinylfu_t* f, int row, unsigned long long index)
+{
+    return (f->rows[row][index >> 4] >> ((index & 15) << 2)) & 0xf;
+}
+
+static int doorkeeperContains(const tinylfu_t* f, unsigned long long hash)
+{
+    unsigned long long a = hash & f->door_mask, b = (hash >> 32) & f->door_mask;
+    return (f->doorkeeper[a >> 6] >> (a & 63)) & (f->doorkeeper[b >> 6] >> (b & 63)) & 1;
+}
+
+/*
+ * age - Halve every counter and clear the doorkeeper
+ */
+static void age(tinylfu_t* f)
+{
+    unsigned long long words = (f->width_mask + 1) >> 4;
+    for (int row = 0; row < SKETCH_DEPTH; row++)
+        for (unsigned long long i = 0; i < words; i++)
+            f->rows[row][i] = (f->rows[row][i] >> 1) & HALVE_MASK;
+    for (unsigned long long i = 0; i <= f->door_mask >> 6; i++)
+        f->doorkeeper[i] = 0;
+    f->additions = 0;
+}
+
+/*
+ * tinylfuCreate - Create a filter sized for about expected_items keys
+ */
+tinylfu_t* tinylfuCreate(unsigned long long expected_items)
+{
+    tinylfu_t* f = calloc(1, sizeof(tinylfu_t));
+    unsigned long long width = 64;
+    while (width < expected_items)
+        width <<= 1;
+    f->width_mask = width - 1;
+    f->door_mask = width * 8 - 1; /* eight bits per item keeps false positives low */
+    f->sample_size = SAMPLE_FACTOR * width;
+    for (int row = 0; row < SKETCH_DEPTH; row++)
+        f->rows[row] = calloc(width >> 4, sizeof(unsigned long long));
+    f->doorkeeper = calloc((f->door_mask + 1) >> 6, sizeof(unsigned long long));
+    return f;
+}
+
+/*
+ * tinylfuDestroy - Free a filter
+ */
+void tinylfuDestroy(tinylfu_t* f)
+{
+    for (int row = 0; row < SKETCH_DEPTH; row++)
+        free(f->rows[row]);
+    free(f->doorkeeper);
+    free(f);
+}
+
+/*
+ * tinylfuRecord - Count one access; saturated counters stay at 15
+ */
+void tinylfuRecord(tinylfu_t* f, unsigned long long key)
+{
+    unsigned long long hash = spread(key);
+    if (!doorkeeperContains(f, hash)) {
+        unsigned long long a = hash & f->door_mask, b = (hash >> 32) & f->door_mask;
+        f->doorkeeper[a >> 6] |= 1ULL << (a & 63);
+        f->doorkeeper[b >> 6] |= 1ULL << (b & 63);
+    } else {
+        for (int row = 0; row < SKETCH_DEPTH; row++) {
+            unsigned long long index = counterIndex(f, hash, row);
+            unsigned int shift = (index & 15) << 2;
+            unsigned long long* word = &f->rows[row][index >> 4];
+            /* Add one unless the nibble is already 15, without branching */
+            *word += (unsigned long long)(((*word >> shift) & 0xf) != 0xf) << shift;
+        }
+    }
+    if (++f->additions >= f->sample_size)
+        age(f);
+}
+
+/*
+ * tinylfuEstimate - Minimum over the rows, plus one for the doorkeeper
+ */
+unsigned int tinylfuEstimate(const tinylfu_t* f, unsigned long long key)
+{
+    unsigned long long hash = spread(key);
+    unsigned int estimate = 15;
+    for (int row = 0; row < SKETCH_DEPTH; row++) {
+        unsigned int count = counterAt(f, row, counterIndex(f, hash, row));
+        estimate = count < estimate ? count : estimate;
+    }
+    return estimate + doorkeeperContains(f, hash);
+}
+
+/*
+ * tinylfuAdmit - Admit only keys that are more popular than the victim
+ */
+int tinylfuAdmit(const tinylfu_t* f, unsigned long long key, unsigned long long victim_key)
+{
+    return tinylfuEstimate(f, key) > tinylfuEstimate(f, victim_key);
+}
@@ -0,0 +1,26 @@
+/*
+ * tinylfu.h - TinyLFU admission filter: a 4-bit count-min sketch with
+ *     periodic aging and a doorkeeper bloom filter
+ */
+
+#ifndef TINYLFU_H
+#define TINYLFU_H
+
+typedef struct tinylfu tinylfu_t;
+
+/* Create a filter sized for about expected_items distinct hot keys */
+tinylfu_t* tinylfuCreate(unsigned long long expected_items);
+
+/* Free a filter */
+void tinylfuDestroy(tinylfu_t* filter);
+
+/* Count one access to key */
+void tinylfuRecord(tinylfu_t* filter, unsigned long long key);
+
+/* Estimated recent access count of key */
+unsigned int tinylfuEstimate(const tinylfu_t* filter, unsigned long long key);
+
+/* Whether a missed key is worth more than the victim it would displace */
+int tinylfuAdmit(const tinylfu_t* filter, unsigned long long key, unsigned long long victim_key);
+
+#endif /* TINYLFU_H */
@@ -0,0 +1,386 @@
+/*
+ * transgen.c - Generates fully unrolled transpose functions for fixed
+ *     matrix sizes, choosing for each size the schedule with the fewest
+ *     misses in csim. The Makefile runs it to produce trans-gen.c.
+ *
+ * A schedule cuts A into bh x bw tiles, visited row- or column-major.
+ * Each tile is transposed in groups of g rows: the group's g * bw elements
+ * are loaded into temporaries, then stored either one row of B at a time
+ * or one row of A at a time. Square tiles of side k that divide the matrix
+ * can instead be parked: the top half of the tile goes to B's top
+ * quarters, the top-right one transposed into the wrong quarter; each
+ * parked row is then read back from B together with a column of A's
+ * bottom-left quarter, and the bottom-right quarter goes last. That is the
+ * classic 8 x 8 schedule for 64 x 64 on a direct-mapped cache.
+ *
+ * Every schedule that fits the temporaries budget is written out as a
+ * trace, with A and B placed like tracegen places them, and counted by
+ * running csim on the (s, E, b) cache. The best one is written out as
+ * straight-line code together with registerGeneratedFunctions(), which
+ * test-kernels calls. Each function is registered for its own size only.
+ *
+ * Temporaries are numbered by their position in the tile; the order of the
+ * accesses is searched, not which register holds what.
+ */
+#define _POSIX_C_SOURCE 200809L /* For mkstemp(), fdopen() and popen() */
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <getopt.h>
+
+/* Largest matrix dimension and number of sizes per run */
+#define MAXN 256
+#define MAX_SIZES 16
+
+/* Tile sides tried along each dimension */
+static const int tile_sides[] = {1, 2, 4, 8, 16};
+#define NUM_TILE_SIDES (sizeof(tile_sides) / sizeof(tile_sides[0]))
+
+/* One way to order the loads and stores of a transpose */
+typedef struct schedule {
+    int bh, bw;     /* tile rows and columns of A */
+    int col_order;  /* visit tiles column by column */
+    int g;          /* A rows loaded before storing */
+    int by_b_row;   /* store the group one B row at a time */
+    int park;       /* square tiles, top-right quarter parked in B */
+} schedule_t;
+
+/* Receives the accesses of a schedule, in program order; loads may read B too */
+typedef struct sink {
+    void (*access)(struct sink* sink, int is_store, int in_b, int row, int col, int temp);
+} sink_t;
+
+/* Trace writer, in the format csim reads */
+typedef struct trace_sink {
+    sink_t sink;
+    int M, N;
+    FILE* out;
+} trace_sink_t;
+
+/* Code writer */
+typedef struct code_sink {
+    sink_t sink;
+    FILE* out;
+} code_sink_t;
+
+/* Globals set on the command line */
+static int s = 5, E = 1, b = 5;
+static int temps = 8;
+static unsigned long long a_base = 0, b_base = MAXN * MAXN * sizeof(int);
+static char* csim = "./csim";
+
+/*
+ * walkParked - The k x k tile of A at (r0, c0), its top-right quarter
+ *     parked in B's top-right quarter on the way to B's bottom-left one
+ */
+void walkParked(int k, int r0, int c0, sink_t* sink)
+{
+    int q = k / 2;
+
+    for (int i = 0; i < q; i++) {
+        for (int j = 0; j < k; j++)
+            sink->access(sink, 0, 0, r0 + i, c0 + j, j);
+        for (int j = 0; j < q; j++)
+            sink->access(sink, 1, 1, c0 + j, r0 + i, j);
+        for (int j = 0; j < q; j++)
+            sink->access(sink, 1, 1, c0 + j, r0 + q + i, q + j);
+    }
+    for (int j = 0; j < q; j++) {
+        for (int m = 0; m < q; m++)
+            sink->access(sink, 0, 1, c0 + j, r0 + q + m, m);
+        for (int m = 0; m < q; m++)
+            sink->access(sink, 0, 0, r0 + q + m, c0 + j, q + m);
+        for (int m = 0; m < q; m++)
+            sink->access(sink, 1, 1, c0 + j, r0 + q + m, q + m);
+        for (int m = 0; m < q; m++)
+            sink->access(sink, 1, 1, c0 + q + j, r0 + m, m);
+    }
+    for (int i = q; i < k; i++) {
+        for (int j = 0; j < q; j++)
+            sink->access(sink, 0, 0, r0 + i, c0 + q + j, j);
+        for (int j = 0; j < q; j++)
+            sink->access(sink, 1, 1, c0 + q + j, r0 + i, j);
+    }
+}
+
+/*
+ * walk - Feed the accesses of a schedule on an N x M matrix A to a sink
+ */
+void walk(const schedule_t* sched, int M, int N, sink_t* sink)
+{
+    int rows = (N + sched->bh - 1) / sched->bh, cols = (M + sched->bw - 1) / sched->bw;
+
+    for (int t = 0; t < rows * cols; t++) {
+        int ti = sched->col_order ? t % rows : t / cols;
+        int tj = sched->col_order ? t / rows : t % cols;
+        int r0 = ti * sched->bh, c0 = tj * sched->bw;
+        int r1 = r0 + sched->bh < N ? r0 + sched->bh : N;
+        int c1 = c0 + sched->bw < M ? c0 + sched->bw : M;
+        if (sched->park) {
+            walkParked(sched->bh, r0, c0, sink);
+            continue;
+        }
+        for (int g0 = r0; g0 < r1; g0 += sched->g) {
+            int g1 = g0 + sched->g < r1 ? g0 + sched->g : r1;
+            int width = c1 - c0;
+            for (int i = g0; i < g1; i++)
+                for (int j = c0; j < c1; j++)
+                    sink->access(sink, 0, 0, i, j, (i - g0) * width + j - c0);
+            if (sched->by_b_row) {
+                for (int j = c0; j < c1; j++)
+                    for (int i = g0; i < g1; i++)
+                        sink->access(sink, 1, 1, j, i, (i - g0) * width + j - c0);
+            } else {
+                for (int i = g0; i < g1; i++)
+                    for (int j = c0; j < c1; j++)
+                        sink->access(sink, 1, 1, j, i, (i - g0) * width + j - c0);
+            }
+        }
+    }
+}
+
+/*
+ * traceAccess - Write one access as a trace record
+ */
+void traceAccess(sink_t* sink, int is_store, int in_b, int row, int col, int temp)
+{
+    trace_sink_t* trace = (trace_sink_t*)sink;
+    unsigned long long addr = in_b ? b_base + ((unsigned long long)row * trace->N + col) * sizeof(int)
+                                   : a_base + ((unsigned long long)row * trace->M + col) * sizeof(int);
+
+    fprintf(trace->out, " %c %llx,%d\n", is_store ? 'S' : 'L', addr, (int)sizeof(int));
+}
+
+/*
+ * simulate - Misses of a schedule on an empty cache, counted by csim
+ */
+unsigned long simulate(const schedule_t* sched, int M, int N)
+{
+    char path[] = "/tmp/transgen.XXXXXX", cmd[512];
+    unsigned long hits, misses;
+    trace_sink_t trace = {{traceAccess}, M, N, NULL};
+    int fd = mkstemp(path);
+    FILE* result;
+
+    if (fd < 0 || !(trace.out = fdopen(fd, "w"))) {
+        perror("transgen: trace file");
+        exit(1);
+    }
+    walk(sched, M, N, &trace.sink);
+    fclose(trace.out);
+
+    snprintf(cmd, sizeof(cmd), "%s -s %d -E %d -b %d -t %s", csim, s, E, b, path);
+    result = popen(cmd, "r");
+    if (!result || fscanf(result, "hits:%lu misses:%lu", &hits, &misses) != 2) {
+        fprintf(stderr, "transgen: no result from %s\n", cmd);
+        exit(1);
+    }
+    pclose(result);
+    unlink(path);
+    return misses;
+}
+
+/*
+ * codeAccess - Write one access as a statement
+ */
+void codeAccess(sink_t* sink, int is_store, int in_b, int row, int col, int temp)
+{
+    code_sink_t* code = (code_sink_t*)sink;
+
+    if (is_store)
+        fprintf(code->out, "    B[%d][%d] = t%d;\n", row, col, temp);
+    else
+        fprintf(code->out, "    t%d = %c[%d][%d];\n", temp, in_b ? 'B' : 'A', row, col);
+}
+
+/*
+ * describe - One-line summary of a schedule
+ */
+void describe(const schedule_t* sched, char* buf, size_t len)
+{
+    if (sched->park) {
+        snprintf(buf, len, "%dx%d tiles %s, top-right quarter parked in B", sched->bh, sched->bw,
+                 sched->col_order ? "column-major" : "row-major");
+        return;
+    }
+    snprintf(buf, len, "%dx%d tiles %s, %d-row groups stored by %s row", sched->bh, sched->bw,
+             sched->col_order ? "column-major" : "row-major", sched->g, sched->by_b_row ? "B" : "A");
+}
+
+/*
+ * consider - Simulate one schedule and keep it if it beats the best so far
+ */
+void consider(const schedule_t* sched, int M, int N, schedule_t* best, unsigned long* best_misses, int verbose)
+{
+    unsigned long misses = simulate(sched, M, N);
+
+    if (verbose) {
+        char buf[128];
+        describe(sched, buf, sizeof(buf));
+        fprintf(stderr, "%dx%d: %s: %lu misses\n", M, N, buf, misses);
+    }
+    if (misses < *best_misses) {
+        *best_misses = misses;
+        *best = *sched;
+    }
+}
+
+/*
+ * search - Find the schedule with the fewest misses for an N x M matrix
+ */
+unsigned long search(int M, int N, schedule_t* best, int verbose)
+{
+    unsigned long best_misses = (unsigned long)-1;
+
+    for (size_t h = 0; h < NUM_TILE_SIDES; h++) {
+        for (size_t w = 0; w < NUM_TILE_SIDES; w++) {
+            schedule_t sched = {tile_sides[h], tile_sides[w], 0, 1, 0, 0};
+            if (sched.bh > N || sched.bw > M)
+                continue;
+            for (sched.col_order = 0; sched.col_order < 2; sched.col_order++) {
+                for (sched.g = 1; sched.g <= sched.bh && sched.g * sched.bw <= temps; sched.g++)
+                    for (sched.by_b_row = 0; sched.by_b_row < 2; sched.by_b_row++)
+                        consider(&sched, M, N, best, &best_misses, verbose);
+                /* Parked square tiles hold a whole tile row and must tile the matrix exactly */
+                sched.g = sched.bh;
+                sched.by_b_row = 0;
+                sched.park = 1;
+                if (h == w && sched.bh >= 2 && sched.bw <= temps && M % sched.bw == 0 && N % sched.bh == 0)
+                    consider(&sched, M, N, best, &best_misses, verbose);
+                sched.park = 0;
+            }
+        }
+    }
+    return best_misses;
+}
+
+/*
+ * emit - Write the unrolled function for one size
+ */
+void emit(FILE* out, int M, int N, const schedule_t* sched, unsigned long misses)
+{
+    schedule_t scan = {1, 1, 0, 1, 0, 0}; /* the simple row-wise trans() */
+    code_sink_t code = {{codeAccess}, out};
+    int used = sched->park ? sched->bw : sched->g * sched->bw;
+    char buf[128];
+
+    describe(sched, buf, sizeof(buf));
+    fprintf(out, "\n/*\n * trans_gen_%dx%d - %s;\n", M, N, buf);
+    fprintf(out, " *     %lu misses simulated, %lu for a row-wise scan\n */\n", misses, simulate(&scan, M, N));
+    fprintf(out, "char trans_gen_%dx%d_desc[] = \"Generated %dx%d: %s\";\n", M, N, M, N, buf);
+    fprintf(out, "void trans_gen_%dx%d(int M, int N, int A[N][M], int B[M][N])\n{\n", M, N);
+    fprintf(out, "    int ");
+    for (int t = 0; t < used; t++)
+        fprintf(out, "t%d%s", t, t + 1 < used ? ", " : ";\n\n");
+    fprintf(out, "    if (M != %d || N != %d)\n", M, N);
+    fprintf(out, "        return; /* generated for one size only; B is left untouched */\n");
+    walk(sched, M, N, &code.sink);
+    fprintf(out, "}\n");
+    fprintf(out, "static kernel_desc_t trans_gen_%dx%d_kernel; /* the transpose family, for %dx%d only */\n", M, N,
+            M, N);
+    fprintf(out, "static int trans_gen_%dx%d_fits(const kernel_dims_t* dims)\n{\n", M, N);
+    fprintf(out, "    return dims->M == %d && dims->N == %d;\n}\n", M, N);
+}
+
+/*
+ * usage - Print usage info
+ */
+void usage(char* argv[])
+{
+    printf("Usage: %s [-hv] [-s <s>] [-E <E>] [-b <b>] [-r <temps>] [-a <addr>] [-B <addr>] [-c <csim>] <M>x<N>...\n",
+           argv[0]);
+    printf("Options:\n");
+    printf("  -h          Print this help message.\n");
+    printf("  -v          Print the misses of every schedule tried to stderr.\n");
+    printf("  -s -E -b    Cache the schedules are searched for (default s=5, E=1, b=5)\n");
+    printf("  -r <temps>  Temporaries a schedule may hold (default 8)\n");
+    printf("  -a <addr>   Address of A (default 0)\n");
+    printf("  -B <addr>   Address of B (default %d, after a %dx%d int A)\n", MAXN * MAXN * (int)sizeof(int), MAXN,
+           MAXN);
+    printf("  -c <csim>   Simulator that counts the misses of each schedule (default ./csim)\n");
+    printf("  <M>x<N>     Matrix size: M columns and N rows of A (max %d)\n", MAXN);
+    printf("Example: %s 32x32 64x64 61x67 > trans-gen.c\n", argv[0]);
+}
+
+/*
+ * main - Main routine
+ */
+int main(int argc, char* argv[])
+{
+    int sizes[MAX_SIZES][2], num_sizes = 0, verbose = 0;
+    int c;
+
+    while ((c = getopt(argc, argv, "s:E:b:r:a:B:c:vh")) != -1) {
+        switch (c) {
+        case 's':
+            s = atoi(optarg);
+            break;
+        case 'E':
+            E = atoi(optarg);
+            break;
+        case 'b':
+            b = atoi(optarg);
+            break;
+        case 'r':
+            temps = atoi(optarg);
+            break;
+        case 'a':
+            a_base = strtoull(optarg, NULL, 0);
+            break;
+        case 'B':
+            b_base = strtoull(optarg, NULL, 0);
+            break;
+        case 'c':
+            csim = optarg;
+            break;
+        case 'v':
+            verbose = 1;
+            break;
+        case 'h':
+            usage(argv);
+            exit(0);
+        default:
+            usage(argv);
+            exit(1);
+        }
+    }
+    for (; optind < argc; optind++) {
+        int M, N, used = 0;
+        if (num_sizes == MAX_SIZES || sscanf(argv[optind], "%dx%d%n", &M, &N, &used) != 2 ||
+            argv[optind][used] != '\0' || M < 1 || N < 1 || M > MAXN || N > MAXN) {
+            fprintf(stderr, "Invalid matrix size: %s\n", argv[optind]);
+            exit(1);
+        }
+        sizes[num_sizes][0] = M;
+        sizes[num_sizes][1] = N;
+        num_sizes++;
+    }
+    if (num_sizes == 0 || s < 0 || s > 20 || E < 1 || b < 0 || b > 20 || temps < 1) {
+        usage(argv);
+        exit(1);
+    }
+
+    printf("/*\n * trans-gen.c - Unrolled transposes generated by transgen for a cache with\n");
+    printf(" *     s=%d, E=%d, b=%d, A at 0x%llx and B at 0x%llx. Do not edit; change\n", s, E, b, a_base, b_base);
+    printf(" *     TRANSGEN_FLAGS in the Makefile instead.\n */\n");
+    printf("#include \"cachelab.h\"\n");
+    for (int i = 0; i < num_sizes; i++) {
+        schedule_t best;
+        unsigned long misses = search(sizes[i][0], sizes[i][1], &best, verbose);
+        emit(stdout, sizes[i][0], sizes[i][1], &best, misses);
+    }
+
+    printf("\n/*\n * registerGeneratedFunctions - Called by test-kernels; each function is\n");
+    printf(" *     evaluated only at the size it was generated for\n */\n");
+    printf("void registerGeneratedFunctions()\n{\n");
+    for (int i = 0; i < num_sizes; i++) {
+        int M = sizes[i][0], N = sizes[i][1];
+        printf("    trans_gen_%dx%d_kernel = transpose_kernel;\n", M, N);
+        printf("    trans_gen_%dx%d_kernel.valid = trans_gen_%dx%d_fits;\n", M, N, M, N);
+        printf("    registerKernelFunction(&trans_gen_%dx%d_kernel, (kernel_impl_t)trans_gen_%dx%d, trans_gen_%dx%d_desc);\n",
+               M, N, M, N, M, N);
+    }
+    printf("}\n");
+    return 0;
+}